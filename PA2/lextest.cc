@@ -18,6 +18,8 @@
 #include <unistd.h>     // for getopt
 #include "cool-parse.h" // bison-generated file; defines tokens
 #include "utilities.h"
+#include "phase-stats.h"
+#include "trace.h"
 
 //
 //  The lexer keeps this global variable up to date with the line number
@@ -59,10 +61,13 @@ extern void dump_cool_token(ostream& out, int lineno,
 
 int main(int argc, char** argv) {
 	int token;
+	long ntokens = 0;
 	
 	handle_flags(argc,argv);
 
+	PhaseTimer lex_timer("lex");
 	while (optind < argc) {
+	    TRACE_SCOPE("lex", argv[optind]);
 	    fin = fopen(argv[optind], "r");
 	    if (fin == NULL) {
 		cerr << "Could not open input file " << argv[optind] << endl;
@@ -73,6 +78,7 @@ int main(int argc, char** argv) {
             // this counter, so let's make the stand-alone lexer
             // do the same thing
             curr_lineno = 1;
+	    curr_filename = argv[optind];
 
 	    //
 	    // Scan and print all tokens.
@@ -80,10 +86,13 @@ int main(int argc, char** argv) {
 	    cout << "#name \"" << argv[optind] << "\"" << endl;
 	    while ((token = cool_yylex()) != 0) {
 		dump_cool_token(cout, curr_lineno, token, cool_yylval);
+		ntokens++;
 	    }
 	    fclose(fin);
 	    optind++;
 	}
+	lex_timer.count("tokens", ntokens);
+	lex_timer.stop();
 	exit(0);
 }
 
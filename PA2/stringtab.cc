@@ -5,8 +5,12 @@
 #include "copyright.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
 #include "stringtab_functions.h"
 #include "stringtab.h"
+#include "int-const.h"
 
 extern char *pad(int n);
 
@@ -72,7 +76,25 @@ void dump_Symbol(ostream& s, int n, Symbol sym)
 
 StringEntry::StringEntry(char *s, int l, int i) : Entry(s,l,i) { }
 IdEntry::IdEntry(char *s, int l, int i) : Entry(s,l,i) { }
-IntEntry::IntEntry(char *s, int l, int i) : Entry(s,l,i) { }
+
+//
+// An Int constant is parsed here, once, and its value kept after the
+// NUL of a longer copy of the string (see int-const.h).
+//
+IntEntry::IntEntry(char *s, int l, int i) : Entry(s,l,i)
+{
+  IntConstValue v;
+  errno = 0;
+  long n = strtol(str, NULL, 10);
+  v.value = (int) n;
+  v.overflow = errno == ERANGE || n > INT_MAX;
+
+  char *p = new char [len + 1 + sizeof(v)];
+  memcpy(p, str, len + 1);
+  memcpy(p + len + 1, &v, sizeof(v));
+  delete [] str;
+  str = p;
+}
 
 IdTable idtable;
 IntTable inttable;
@@ -0,0 +1,166 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  trace.cc
+//
+//  Implements TraceScope (see trace.h).  Every thread appends events
+//  to its own chain of fixed-size chunks, so recording never takes a
+//  lock; a thread links its buffer into the global list with a single
+//  compare-and-swap the first time it records an event.  The first
+//  recorded event also registers trace_dump() with atexit, so the
+//  trace is written on every normal exit, including exit(1) after
+//  errors.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <string>
+#include "trace.h"
+
+#define TRACE_CHUNK_EVENTS 4096
+
+struct TraceEvent {
+  const char *cat;
+  const char *name;
+  Symbol scope_sym;
+  Symbol name_sym;
+  long long start_ns;
+  long long end_ns;
+};
+
+struct TraceChunk {
+  TraceEvent events[TRACE_CHUNK_EVENTS];
+  int count;
+  TraceChunk *next;
+};
+
+struct TraceBuffer {
+  int tid;
+  TraceChunk *head;
+  TraceChunk *tail;
+  TraceBuffer *next;
+};
+
+static TraceBuffer *all_buffers;       // pushed with compare-and-swap
+static int next_tid;
+static int dump_registered;
+static __thread TraceBuffer *thread_buffer;
+
+static void trace_dump();
+
+static TraceChunk *new_chunk()
+{
+  TraceChunk *c = (TraceChunk *) malloc(sizeof(TraceChunk));
+  c->count = 0;
+  c->next = NULL;
+  return c;
+}
+
+static TraceBuffer *register_thread()
+{
+  TraceBuffer *b = (TraceBuffer *) malloc(sizeof(TraceBuffer));
+  b->tid = __sync_add_and_fetch(&next_tid, 1);
+  b->head = b->tail = new_chunk();
+  do {
+    b->next = all_buffers;
+  } while (!__sync_bool_compare_and_swap(&all_buffers, b->next, b));
+
+  if (__sync_bool_compare_and_swap(&dump_registered, 0, 1))
+    atexit(trace_dump);
+  return b;
+}
+
+long long TraceScope::now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void TraceScope::record()
+{
+  long long end_ns = now();
+  TraceBuffer *b = thread_buffer;
+  if (b == NULL)
+    b = thread_buffer = register_thread();
+
+  TraceChunk *c = b->tail;
+  if (c->count == TRACE_CHUNK_EVENTS)
+    c = b->tail = c->next = new_chunk();
+
+  TraceEvent &e = c->events[c->count++];
+  e.cat = cat;
+  e.name = name;
+  e.scope_sym = scope_sym;
+  e.name_sym = name_sym;
+  e.start_ns = start_ns;
+  e.end_ns = end_ns;
+}
+
+//
+// Names are file names and Cool identifiers, so only quotes and
+// backslashes need escaping.
+//
+static void append_escaped(std::string &out, const char *s)
+{
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      out += '\\';
+    out += *s;
+  }
+}
+
+static void append_event(std::string &out, int pid, int tid, TraceEvent &e)
+{
+  char buf[128];
+
+  out += "{\"name\": \"";
+  if (e.scope_sym) {
+    append_escaped(out, e.scope_sym->get_string());
+    out += '.';
+  }
+  append_escaped(out, e.name_sym ? e.name_sym->get_string() : e.name);
+  snprintf(buf, sizeof(buf),
+      "\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %lld.%03lld, "
+      "\"dur\": %lld.%03lld, \"pid\": %d, \"tid\": %d},\n",
+      e.cat, e.start_ns / 1000, e.start_ns % 1000,
+      (e.end_ns - e.start_ns) / 1000, (e.end_ns - e.start_ns) % 1000,
+      pid, tid);
+  out += buf;
+}
+
+//
+// The JSON array format lets the closing bracket be left off, which is
+// what allows several processes to append to one file.  Whoever
+// creates the file writes the opening bracket; each process writes all
+// of its events in one O_APPEND write so they are not interleaved.
+//
+static void trace_dump()
+{
+  std::string out;
+  int pid = (int) getpid();
+
+  int fd = open(trace_file, O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0666);
+  if (fd >= 0)
+    out += "[\n";
+  else if (errno == EEXIST)
+    fd = open(trace_file, O_WRONLY | O_APPEND);
+  if (fd < 0) {
+    perror(trace_file);
+    return;
+  }
+
+  for (TraceBuffer *b = all_buffers; b; b = b->next)
+    for (TraceChunk *c = b->head; c; c = c->next)
+      for (int i = 0; i < c->count; i++)
+        append_event(out, pid, b->tid, c->events[i]);
+
+  if (write(fd, out.data(), out.size()) != (ssize_t) out.size())
+    perror(trace_file);
+  close(fd);
+}
@@ -8,6 +8,7 @@
 #include "tree.h"
 #include "cool.h"
 #include "stringtab.h"
+#include "span-table.h"
 #define yylineno curr_lineno;
 extern int yylineno;
 
@@ -44,7 +45,13 @@ typedef Expressions_class *Expressions;
 typedef list_node<Case> Cases_class;
 typedef Cases_class *Cases;
 
+// First in each phylum, so that it takes the padding after line_number.
+#define SPAN_EXTRAS                             \
+SpanRef span = node_span_ref();                 \
+SpanRef get_span() { return span; }
+
 #define Program_EXTRAS                          \
+SPAN_EXTRAS                                     \
 virtual void dump_with_types(ostream&, int) = 0; 
 
 
@@ -53,6 +60,7 @@ virtual void dump_with_types(ostream&, int) = 0;
 void dump_with_types(ostream&, int);            
 
 #define Class__EXTRAS                   \
+SPAN_EXTRAS                             \
 virtual Symbol get_filename() = 0;      \
 virtual void dump_with_types(ostream&,int) = 0; 
 
@@ -63,6 +71,7 @@ void dump_with_types(ostream&,int);
 
 
 #define Feature_EXTRAS                                        \
+SPAN_EXTRAS                                                   \
 virtual void dump_with_types(ostream&,int) = 0; 
 
 
@@ -74,6 +83,7 @@ void dump_with_types(ostream&,int);
 
 
 #define Formal_EXTRAS                              \
+SPAN_EXTRAS                                        \
 virtual void dump_with_types(ostream&,int) = 0;
 
 
@@ -82,6 +92,7 @@ void dump_with_types(ostream&,int);
 
 
 #define Case_EXTRAS                             \
+SPAN_EXTRAS                                     \
 virtual void dump_with_types(ostream& ,int) = 0;
 
 
@@ -90,6 +101,7 @@ void dump_with_types(ostream& ,int);
 
 
 #define Expression_EXTRAS                    \
+SPAN_EXTRAS                                  \
 Symbol type;                                 \
 Symbol get_type() { return type; }           \
 Expression set_type(Symbol s) { type = s; return this; } \
@@ -13,63 +13,41 @@
   
   
   /* Locations */
-  #define YYLTYPE int              /* the type of locations */
-  #define cool_yylloc curr_lineno  /* use the curr_lineno from the lexer
-  for the location of tokens */
+  #define YYLTYPE Span             /* the type of locations (span-table.h) */
+  extern int curr_lineno;          /* the line of the last token read */
     
     extern int node_lineno;          /* set before constructing a tree node
     to whatever you want the line number
     for the tree node to be */
       
       
-      #define YYLLOC_DEFAULT(Current, Rhs, N)         \
-      Current = Rhs[1];                             \
-      node_lineno = Current;
+      #define YYLLOC_DEFAULT(Current, Rhs, N)                              \
+      do {                                                                \
+        if (N) {                                                          \
+          (Current).first_line = (Rhs)[1].first_line;                     \
+          (Current).last_line = (Rhs)[N].last_line;                       \
+        } else                                                            \
+          (Current).first_line = (Current).last_line = (Rhs)[0].last_line; \
+        node_span = (Current);                                            \
+        node_lineno = curr_lineno;                                        \
+      } while (0)
     
     
     #define SET_NODELOC(Current)  \
-    node_lineno = Current;
-    
-    /* IMPORTANT NOTE ON LINE NUMBERS
-    *********************************
-    * The above definitions and macros cause every terminal in your grammar to 
-    * have the line number supplied by the lexer. The only task you have to
-    * implement for line numbers to work correctly, is to use SET_NODELOC()
-    * before constructing any constructs from non-terminals in your grammar.
-    * Example: Consider you are matching on the following very restrictive 
-    * (fictional) construct that matches a plus between two integer constants. 
-    * (SUCH A RULE SHOULD NOT BE  PART OF YOUR PARSER):
-    
-    plus_consts	: INT_CONST '+' INT_CONST 
-    
-    * where INT_CONST is a terminal for an integer constant. Now, a correct
-    * action for this rule that attaches the correct line number to plus_const
-    * would look like the following:
-    
-    plus_consts	: INT_CONST '+' INT_CONST 
-    {
-      // Set the line number of the current non-terminal:
-      // ***********************************************
-      // You can access the line numbers of the i'th item with @i, just
-      // like you acess the value of the i'th exporession with $i.
-      //
-      // Here, we choose the line number of the last INT_CONST (@3) as the
-      // line number of the resulting expression (@$). You are free to pick
-      // any reasonable line as the line number of non-terminals. If you 
-      // omit the statement @$=..., bison has default rules for deciding which 
-      // line number to use. Check the manual for details if you are interested.
-      @$ = @3;
-      
-      
-      // Observe that we call SET_NODELOC(@3); this will set the global variable
-      // node_lineno to @3. Since the constructor call "plus" uses the value of 
-      // this global, the plus node will now have the correct line number.
-      SET_NODELOC(@3);
-      
-      // construct the result node:
-      $$ = plus(int_const($1), int_const($3));
-    }
+    node_span = (Current);        \
+    node_lineno = (Current).first_line;
     
+    /* LINE NUMBERS AND SPANS
+    *************************
+    * Every token is located at its line (recovering_lex() sets yylloc),
+    * and YYLLOC_DEFAULT gives each phrase the span from its first token
+    * to its last.  Before each action it sets node_span to that span,
+    * which every node built in the action records (see span-table.h),
+    * and node_lineno to the line of the last token read, which is the
+    * line number the reference coolc gives: the line of the token after
+    * the phrase if Bison needed it to decide on the reduction, or else
+    * of the phrase's last token.  SET_NODELOC(@n) makes the nodes built
+    * next take the span and line of the n'th symbol instead.
     */
     
     
@@ -77,6 +55,28 @@
     void yyerror(char *s);        /*  defined below; called for each parse error */
     extern int yylex();           /*  the entry point to the lexer  */
     
+    /* The parser reads its tokens through recovering_lex(), defined below.
+       rd-parse.cc reads them the same way. */
+    int recovering_lex();
+    #undef yylex
+    #define yylex recovering_lex
+    int resume_at_class = 0;      /* the parse ended early; start it again */
+    int resyncs;                  /* errors shifted since the last token */
+    void (*class_parsed)(Class_); /* if set, given each class as it is reduced */
+    
+    /* The no_expr of a let binding without an initializer; it takes the
+       line of the token after the type, as in the reference coolc. */
+    static Expression no_init(YYLTYPE after)
+    {
+      Span span = node_span;
+      int line = node_lineno;
+      SET_NODELOC(after);
+      Expression e = no_expr();
+      node_span = span;
+      node_lineno = line;
+      return e;
+    }
+    
     /************************************************************************/
     /*                DONT CHANGE ANYTHING IN THIS SECTION                  */
     
@@ -86,6 +86,10 @@
     %}
     
     /* A union of all the types that can be the result of parsing actions. */
+    %locations
+    /* cool_yyparse() pulls tokens from the lexer; push_token(), below,
+       takes them from a producer one at a time. */
+    %define api.push-pull both
     %union {
       Boolean boolean;
       Symbol symbol;
@@ -144,6 +148,8 @@
     %type <expression> loop block let_expr let case_expr new isvoid comparison arithmetic
     
     /* Precedence declarations go here. */
+    /* IN binds loosest: the body of a let extends as far right as it can. */
+    %nonassoc IN
     %right ASSIGN
     %left NOT
     %nonassoc LE '<' '='
@@ -168,28 +174,32 @@
     | class_list class	/* several classes */
     { $$ = append_Classes($1,single_Classes($2)); 
     parse_results = $$; }
-    | error ';'
+    | error			/* skip to the next class */
     { $$ = nil_Classes(); }
+    | class_list error
+    { $$ = $1; }
     ;
     
     /* If no parent is specified, the class inherits from the Object class. */
     class	: CLASS TYPEID '{' feature_list '}' ';'
     { $$ = class_($2,idtable.add_string("Object"),$4,
-    stringtable.add_string(curr_filename)); }
+    stringtable.add_string(curr_filename));
+    if (class_parsed) class_parsed($$); }
     | CLASS TYPEID INHERITS TYPEID '{' feature_list '}' ';'
-    { $$ = class_($2,$4,$6,stringtable.add_string(curr_filename)); }
+    { $$ = class_($2,$4,$6,stringtable.add_string(curr_filename));
+    if (class_parsed) class_parsed($$); }
     ;
     
     /* Feature list may be empty, but no empty features in list. */
     feature_list
-    : feature
-    { $$ = single_Features($1); }
-    | feature_list feature
+    : feature_list feature
     { $$ = append_Features($1, single_Features($2)); }
     |
     {  $$ = nil_Features(); }
-    | error ';'
-    { $$ = nil_Features(); }
+    | feature_list resync ';'	/* skip to the end of an attribute */
+    { $$ = $1; }
+    | feature_list resync '}' ';'	/* or of a method */
+    { $$ = $1; }
     ;
 
     feature
@@ -231,7 +241,7 @@
     { $$ = single_Expressions($1); }
     | semicolon_expression_list expression ';'
     { $$ = append_Expressions($1, single_Expressions($2)); }
-    | error ';'
+    | resync ';'
     { $$ = nil_Expressions(); }
     ;
 
@@ -314,19 +324,25 @@
 
     let
     : OBJECTID ':' TYPEID IN expression
-    { $$ = let($1, $3, no_expr(), $5); }
+    { $$ = let($1, $3, no_init(@4), $5); }
     | OBJECTID ':' TYPEID ASSIGN expression IN expression
     { $$ = let($1, $3, $5, $7); }
-    | error IN expression
+    | resync IN expression
     { $$ = $3; }
     | OBJECTID ':' TYPEID ',' let
-    { $$ = let($1, $3, no_expr(), $5); }
+    { $$ = let($1, $3, no_init(@4), $5); }
     | OBJECTID ':' TYPEID ASSIGN expression ',' let
     { $$ = let($1, $3, $5, $7); }
-    | error ',' let
+    | resync ',' let
     { $$ = $3; }
     ;
 
+    /* The error token of the error rules within a class. */
+    resync
+    : error
+    { resyncs++; }
+    ;
+
     case_expr
     : CASE expression OF case_list ESAC
     { $$ = typcase($2, $4); }
@@ -391,8 +407,131 @@
       print_cool_token(yychar);
       cerr << endl;
       omerrs++;
-      
-      if(omerrs>50) {fprintf(stdout, "More than 50 errors\n"); exit(1);}
     }
     
-    
\ No newline at end of file
+    /*
+    Panic-mode recovery.  On an error Bison pops the stack to the nearest
+    state that shifts `error', then discards tokens until one that state
+    accepts: CLASS at the top, and inside a class ';' or '}' ';' after a
+    feature, ';' in a block, IN or ',' in a let.  Inside a class nothing
+    stops at the end of the class, so a broken feature can discard its
+    way into the next classes and hide their errors.  The error rules
+    inside a class go through resync, so each token such a recovery
+    discards is followed by a resync before the next one is read, and
+    recovering_lex() bounds the discarding from there:
+    
+      - when it has discarded a CLASS, the parse ends with an end of
+        file (which Bison, still recovering, takes without a message)
+        and parser-phase.cc starts a new one at that CLASS;
+    
+      - when it has discarded MAX_SKIPPED_TOKENS tokens in a row, the
+        lexer skips to the next CLASS, and the parse ends and starts
+        again there.
+    
+    (The classes parsed before a restart are lost, but a parse with
+    errors builds no tree.)
+    */
+    #define MAX_SKIPPED_TOKENS 256
+    
+    static int skipped;           /* tokens discarded in a row */
+    static int last_token;
+    
+    /* The token recovery puts before the next one of the input: CLASS
+       to start again at a discarded class, or 0 to end the parse that
+       discarded it.  -1 if the parser is to read the input. */
+    static int recovery_token()
+    {
+      if (resume_at_class) {
+        resume_at_class = 0;
+        resyncs = skipped = 0;
+        return CLASS;
+      }
+      skipped = resyncs ? skipped + 1 : 0;
+      resyncs = 0;
+      if (skipped && last_token == CLASS) {
+        resume_at_class = 1;
+        return 0;
+      }
+      return -1;
+    }
+    
+    static int next_token()
+    {
+      int token = recovery_token();
+      if (token >= 0)
+        return token;
+      if (skipped > MAX_SKIPPED_TOKENS) {
+        while ((token = cool_yylex()) != 0 && token != CLASS)
+          ;
+        resume_at_class = token == CLASS;
+        return 0;
+      }
+      return cool_yylex();
+    }
+    
+    int recovering_lex()
+    {
+      last_token = next_token();
+      yylloc.first_line = yylloc.last_line = curr_lineno;
+      return last_token;
+    }
+    
+    /*
+    Push mode.  A producer that gets its tokens in batches, from the lexer
+    or a socket, hands each to push_token() as it comes, with its value
+    in cool_yylval and its line in curr_lineno, as cool_yylex() leaves
+    them; the end of the input is token 0.  Recovery is bounded as in
+    recovering_lex(), and a parse that ends at a discarded CLASS starts
+    again there, so it reports the errors cool_yyparse() does, and on a
+    correct program builds the same tree.
+    With class_parsed set, each class is passed on as soon as its ';'
+    has been pushed.
+    */
+    static cool_yypstate *push_state;
+    static int push_waiting;      /* the parser waits for a token of the input */
+    static int push_ended;        /* the input has ended */
+    
+    static void push(int token)
+    {
+      yychar = last_token = token;  /* an impure push parser reads yychar,
+                                       yylval (cool_yylval) and yylloc */
+      yylloc.first_line = yylloc.last_line = curr_lineno;
+      if (!push_state)
+        push_state = cool_yypstate_new();
+      if (cool_yypush_parse(push_state) == YYPUSH_MORE)
+        return;
+      cool_yypstate_delete(push_state);
+      push_state = NULL;
+      push_ended = !resume_at_class;
+    }
+    
+    /* Returns 0 once the input has ended, else 1. */
+    int push_token(int token)
+    {
+      int taken = 0;
+      while (!push_ended) {
+        if (!push_waiting) {
+          int inserted = recovery_token();
+          if (inserted >= 0) {
+            push(inserted);
+            continue;
+          }
+          push_waiting = 1;
+        }
+        if (taken)
+          break;
+        taken = 1;
+        if (skipped > MAX_SKIPPED_TOKENS) {
+          /* the lexer would skip to the next CLASS; so does the input */
+          if (token != 0 && token != CLASS)
+            break;
+          resume_at_class = token == CLASS;
+          push_waiting = 0;
+          push(0);
+          continue;
+        }
+        push_waiting = 0;
+        push(token);
+      }
+      return !push_ended;
+    }
@@ -118,9 +118,10 @@ void Expression_class::dump_type(ostream& stream, int n)
     { stream << pad(n) << ": _no_type" << endl; }
 }
 
-void dump_line(ostream& stream, int n, tree_node *t)
+template <class Node> void dump_line(ostream& stream, int n, Node *t)
 {
   stream << pad(n) << "#" << t->get_line_number() << "\n";
+  span_dump_node(n, t->get_span());     // -X (see span-table.cc)
 }
 
 //
@@ -25,12 +25,20 @@
 extern int yy_flex_debug;       // for the lexer; prints recognized rules
 extern int cool_yydebug;        // for the parser
        int lex_verbose;         // also for the lexer; prints tokens
+       int lex_warnings;        // also for the lexer; warns about Int overflow
        int semant_debug;        // for semantic analysis
        int cgen_debug;          // for code gen
        bool disable_reg_alloc;  // Don't do register allocation
 
        int cgen_optimize;       // optimize switch for code generator 
+       int inline_budget = 40;  // largest method body -O inlines, in nodes
        char *out_filename;      // file name for generated code
+       char *phase_stats_file;  // per-phase statistics go here ("-" is stderr)
+       char *trace_file;        // Chrome trace events go here
+       int ast_hashcons;        // share identical closed AST subtrees
+       int rd_parser;           // parse with rd-parse.cc rather than Bison
+       int stream_classes;      // print each class as soon as it is parsed
+       char *spans_path;        // source spans of the AST nodes go here
        Memmgr cgen_Memmgr = GC_NOGC;      // enable/disable garbage collection
        Memmgr_Test cgen_Memmgr_Test = GC_NORMAL;  // normal/test GC
        Memmgr_Debug cgen_Memmgr_Debug = GC_QUICK; // check heap frequently
@@ -53,7 +61,7 @@ void handle_flags(int argc, char *argv[]) {
   disable_reg_alloc = 0;
   
 
-  while ((c = getopt(argc, argv, "lpscvrOo:gtT")) != -1) {
+  while ((c = getopt(argc, argv, "lpscvrWOo:gtTP:E:HI:RSX:")) != -1) {
     switch (c) {
 #ifdef DEBUG
     case 'l':
@@ -96,9 +104,37 @@ void handle_flags(int argc, char *argv[]) {
     case 'o':  // set the name of the output file
       out_filename = optarg;
       break;
+    case 'W':  // warn about Int constants that do not fit in 32 bits
+      lex_warnings = 1;
+      break;
     case 'O':  // enable optimization
       cgen_optimize = 1;
       break;
+    case 'I':  // set the inlining budget of -O (see optimize.h)
+      inline_budget = atoi(optarg);
+      break;
+    case 'P':  // report time and memory of each phase (see phase-stats.h)
+      phase_stats_file = optarg;
+      break;
+    case 'H':  // hash-cons the AST (see hashcons.h)
+      ast_hashcons = 1;
+      break;
+    case 'R':  // use the recursive-descent parser (see rd-parse.cc)
+      rd_parser = 1;
+      break;
+    case 'S':  // push tokens to the parser and stream the classes out
+      stream_classes = 1;
+      break;
+    case 'X':  // write (parser) or read (semant) the spans of the AST nodes
+      spans_path = optarg;
+      break;
+    case 'E':  // record trace events (see trace.h)
+#ifdef TRACE
+      trace_file = optarg;
+#else
+      cerr << "No tracing available\n";
+#endif
+      break;
     case '?':
       unknownopt = 1;
       break;
@@ -111,9 +147,9 @@ void handle_flags(int argc, char *argv[]) {
   if (unknownopt) {
       cerr << "usage: " << argv[0] << 
 #ifdef DEBUG
-	  " [-lvpscOgtTr -o outname] [input-files]\n";
+	  " [-lvpscOgtTrHWRS -o outname -P statsfile -E tracefile -I size -X spans] [input-files]\n";
 #else
-      " [-OgtT -o outname] [input-files]\n";
+      " [-OgtTHWRS -o outname -P statsfile -E tracefile -I size -X spans] [input-files]\n";
 #endif
       exit(1);
   }
@@ -14,10 +14,14 @@
 
 #include <stdio.h>     // for Linux system
 #include <unistd.h>    // for getopt
+#include <sstream>
+#include <string>
 #include "cool-io.h"  //includes iostream
 #include "cool-tree.h"
 #include "utilities.h"  // for fatal_error
 #include "cool-parse.h"
+#include "phase-stats.h"
+#include "trace.h"
 
 //
 // These globals keep everything working.
@@ -27,20 +31,97 @@ extern Classes parse_results;	 // list of classes; used for multiple files
 extern Program ast_root;	 // the AST produced by the parse
 
 char *curr_filename = "<stdin>";
+int curr_lineno;                // the line of the last token read
 
 extern int omerrs;             // a count of lex and parse errors
 
 extern int cool_yyparse();
+extern int cool_yylex();
+extern int push_token(int token);  // cool.y; feeds the parser one token
+extern int rd_parse();          // the same parse by hand (rd-parse.cc)
+extern int rd_parser;           // -R: use it
+extern int resume_at_class;    // error recovery ended the parse at a class
+extern void (*class_parsed)(Class_);  // cool.y; called as each class is reduced
+extern int stream_classes;      // -S: push the tokens, print classes as parsed
+extern char *spans_path;        // -X: write the spans of the nodes here
 void handle_flags(int argc, char *argv[]);
 
+//
+// Under -S each class is printed as soon as it is parsed, so that the
+// next phase can read it while the rest of the file is parsed.  The
+// _program line has to come first, before the end of the file is
+// seen, so it takes the line of the first class.  The last line of
+// the output is held back until the next class or the end of the
+// parse.  After an error no more classes are printed; the output,
+// cut off inside a class, ends with the line of the last token read
+// and a parse_error line, which the AST reader of the next phase
+// reports rather than taking what came before it for a whole
+// program.  The spans of a class's nodes are
+// written with it; the program's span, which comes last in postorder,
+// follows the last class.
+//
+static std::string held_line;
+
+static void print_class(Class_ c)
+{
+    if (omerrs != 0)
+	return;
+    std::ostringstream out;
+    if (held_line.empty())
+	out << "#" << c->get_line_number() << "\n_program\n";
+    out << held_line;
+    c->dump_with_types(out, 2);
+    span_dump_flush();
+    std::string text = out.str();
+    size_t last = text.rfind('\n', text.size() - 2) + 1;
+    cout.write(text.data(), last);
+    held_line = text.substr(last);
+}
+
 int main(int argc, char *argv[]) {
     handle_flags(argc, argv);
-    cool_yyparse();
+    if (spans_path)
+	span_dump_open(spans_path);
+
+    PhaseTimer parse_timer("parse");
+    {
+	TRACE_SCOPE("parse", "parse");
+	if (stream_classes)
+	    class_parsed = print_class;
+	if (stream_classes && !rd_parser)
+	    while (push_token(cool_yylex()))
+		;
+	else
+	    do
+		if (rd_parser)
+		    rd_parse();
+		else
+		    cool_yyparse();
+	    while (resume_at_class);
+    }
+    parse_timer.count("ast_nodes", tree_node_count);
+    parse_timer.stop();
+
     if (omerrs != 0) {
+	if (stream_classes)
+	    cout << "#" << curr_lineno << "\nparse_error\n";
 	cerr << "Compilation halted due to lex and parse errors\n";
 	exit(1);
     }
-    ast_root->dump_with_types(cout,0);
+
+    if (stream_classes) {
+	cout << held_line;
+	span_dump_node(0, ast_root->get_span());
+	span_dump_flush();
+	return 0;
+    }
+    PhaseTimer dump_timer("dump");
+    {
+	TRACE_SCOPE("dump", "dump");
+	ast_root->dump_with_types(cout,0);
+	span_dump_flush();
+    }
+    dump_timer.stop();
     return 0;
 }
 
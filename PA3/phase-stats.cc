@@ -0,0 +1,139 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  phase-stats.cc
+//
+//  Implements PhaseTimer (see phase-stats.h) and the allocation
+//  counters behind it.  Global operator new is replaced here so that
+//  every allocation in the compiler, including AST nodes and string
+//  table entries, is counted; the counters are two additions per
+//  allocation and are always on.  The additions are atomic (relaxed),
+//  since intern-bench allocates from several threads.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <new>
+#include "stringtab.h"
+#include "phase-stats.h"
+
+static long alloc_count;
+static long alloc_bytes;
+
+void *operator new(size_t size)
+{
+  __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&alloc_bytes, (long) size, __ATOMIC_RELAXED);
+  void *p = malloc(size ? size : 1);
+  if (p == NULL)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) throw()
+{
+  free(p);
+}
+
+static double wall_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double cpu_ms(struct rusage &ru)
+{
+  return ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3 +
+         ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3;
+}
+
+//
+// The string tables only expose an index iterator, so their sizes are
+// counted when a report is written rather than kept up to date.
+//
+template <class Elem>
+static long table_size(StringTable<Elem> &table)
+{
+  long n = 0;
+  for (int i = table.first(); table.more(i); i = table.next(i))
+    n++;
+  return n;
+}
+
+PhaseTimer::PhaseTimer(const char *n) : name(n), ncounts(0)
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  cpu_start = cpu_ms(ru);
+  allocs_start = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+  bytes_start = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED);
+  wall_start = wall_ms();
+}
+
+void PhaseTimer::count(const char *what, long n)
+{
+  if (ncounts < MAX_PHASE_COUNTS) {
+    count_names[ncounts] = what;
+    count_values[ncounts] = n;
+    ncounts++;
+  }
+}
+
+PhaseStat PhaseTimer::stop()
+{
+  PhaseStat stat;
+  struct rusage ru;
+
+  stat.wall_ms = wall_ms() - wall_start;
+  stat.allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - allocs_start;
+  stat.alloc_bytes = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED) - bytes_start;
+  getrusage(RUSAGE_SELF, &ru);
+  stat.cpu_ms = cpu_ms(ru) - cpu_start;
+  stat.maxrss_kb = ru.ru_maxrss;
+
+  if (phase_stats_file == NULL)
+    return stat;
+
+  // Build the line first so it reaches the file in a single write.
+  char line[512];
+  int len = snprintf(line, sizeof(line),
+      "{\"pid\": %d, \"phase\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, "
+      "\"maxrss_kb\": %ld, \"allocs\": %ld, \"alloc_bytes\": %ld, "
+      "\"idtable\": %ld, \"inttable\": %ld, \"stringtable\": %ld",
+      (int) getpid(), name, stat.wall_ms, stat.cpu_ms, stat.maxrss_kb,
+      stat.allocs, stat.alloc_bytes,
+      table_size(idtable), table_size(inttable), table_size(stringtable));
+  for (int i = 0; i < ncounts && len < (int) sizeof(line); i++)
+    len += snprintf(line + len, sizeof(line) - len, ", \"%s\": %ld",
+                    count_names[i], count_values[i]);
+  if (len < (int) sizeof(line))
+    snprintf(line + len, sizeof(line) - len, "}\n");
+
+  write_phase_record(line);
+  return stat;
+}
+
+//
+// Appends one line to the -P file, or writes it to stderr for "-".
+//
+void write_phase_record(const char *line)
+{
+  if (phase_stats_file == NULL)
+    return;
+
+  bool to_stderr = phase_stats_file[0] == '-' && phase_stats_file[1] == '\0';
+  FILE *out = to_stderr ? stderr : fopen(phase_stats_file, "a");
+  if (out == NULL) {
+    perror(phase_stats_file);
+    return;
+  }
+  fputs(line, out);
+  if (to_stderr)
+    fflush(out);
+  else
+    fclose(out);
+}
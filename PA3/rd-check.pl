@@ -0,0 +1,174 @@
+#!/usr/bin/perl -w
+#
+# rd-check.pl - checks the recursive-descent parser against Bison's
+#
+# Runs ./parser and ./parser -R on the same token streams and fails if
+# their output (tree or errors) or exit status differ in any byte.
+# The token streams are
+#
+#     the grading cases, lexed with ./lexer;
+#     copies of them with one to four tokens deleted, duplicated,
+#     swapped or inserted at random (-mutants, from -seed);
+#     a generated program of -classes classes, 30% of them broken by
+#     deleting one word.
+#
+# The mutants and the generated program are the same from run to run
+# for the same -seed.  The parse of the program takes time quadratic
+# in -classes, since the string tables of the support code are lists:
+# 1000 classes take under a second, 5000 several minutes.  The streams
+# that differ are left in <dir>/rd-check/ together with both outputs.
+#
+
+use strict;
+
+use Getopt::Long;
+
+my $grading_dir = "./grading";
+my $mutants = 3000;
+my $classes = 1000;
+my $seed = 1;
+my $keep;
+
+sub usage {
+    print "Usage: $0 [options]\n";
+    print "    Options: -dir <path>     - grading directory, unpacked by the grading\n";
+    print "                               script if it has no cases file\n";
+    print "                               [default = \"$grading_dir\"]\n";
+    print "             -mutants <n>    - mutated token streams [default = $mutants]\n";
+    print "             -classes <n>    - classes in the generated program [default = $classes]\n";
+    print "             -seed <n>       - seed for the mutants and the program [default = $seed]\n";
+    print "             -keep           - keep the token streams that agree too\n";
+    return "\n";
+}
+
+die usage()
+    unless(GetOptions("dir=s" => \$grading_dir,
+		      "mutants=i" => \$mutants,
+		      "classes=i" => \$classes,
+		      "seed=i" => \$seed,
+		      "keep" => \$keep,
+		      "help" => sub { usage(); exit 0; }));
+
+foreach my $b ("lexer", "parser") {
+    die "$0: ./$b not found; run make $b first\n" unless(-x $b);
+}
+unless(-r "$grading_dir/cases") {
+    system("perl pa2-grading.pl -x -dir $grading_dir > /dev/null") == 0
+	or die "$0: could not unpack the test cases with pa2-grading.pl\n";
+}
+my $work = "$grading_dir/rd-check";
+system("rm -rf $work; mkdir -p $work") == 0
+    or die "$0: could not make $work\n";
+
+my ($checked, $differ) = (0, 0);
+
+# Parses tok with both parsers; returns 1 if they agree.
+sub compare {
+    my ($tok) = @_;
+    system("../../parser < $tok > $tok.bison 2>&1");
+    my $bison = $?;
+    system("../../parser -R < $tok > $tok.rd 2>&1");
+    my $rd = $?;
+    $checked++;
+    if ($bison == $rd and system("cmp -s $tok.bison $tok.rd") == 0) {
+	unlink "$tok.bison", "$tok.rd" unless($keep);
+	unlink $tok unless($keep);
+	return 1;
+    }
+    $differ++;
+    print "differ   $tok\n";
+    return 0;
+}
+
+sub write_file {
+    my ($name, @lines) = @_;
+    open OUT, ">", $name or die "$0: could not write $name\n";
+    print OUT @lines;
+    close OUT;
+}
+
+chdir($work) or die "$0: can't change directory to '$work'\n";
+
+# ---------------------------------------------------------------------------
+# The grading cases
+
+my @streams;
+open CASES, "../cases" or die "$0: could not open $grading_dir/cases\n";
+while (defined(my $line = <CASES>)) {
+    next if($line =~ /^#/ or $line =~ /^\s*$/ or $line =~ /maxscore/i);
+    my ($file) = split /;/, $line;
+    $file =~ s/^\s+|\s+$//g;
+    my $tok = "$file.tok";
+    system("cd .. && ../lexer $file > rd-check/$tok 2>/dev/null");
+    open TOK, $tok or die "$0: could not read $tok\n";
+    my @lines = <TOK>;
+    close TOK;
+    push @streams, \@lines if(grep { !/^#name/ } @lines);
+    compare($tok);
+}
+close CASES;
+die "$0: no test cases with tokens\n" unless(@streams);
+my $graded = $checked;
+
+# ---------------------------------------------------------------------------
+# Mutants
+
+srand($seed);
+my @extra = ("CLASS", "IN", "LET", "';'", "'}'", "'{'", "','", "'('", "')'",
+	     "'<'", "'='", "ASSIGN", "OBJECTID x", "TYPEID T", "FI", "ESAC",
+	     "'.'", "'\@'", "INT_CONST 3", "NOT", "ISVOID");
+for (my $k = 0; $k < $mutants; $k++) {
+    my $lines = $streams[int(rand(@streams))];
+    my @head = grep { /^#name/ } @$lines;
+    my @body = grep { !/^#name/ } @$lines;
+    my $changes = 1 + int(rand(4));
+    for (my $m = 0; $m < $changes and @body; $m++) {
+	my $i = int(rand(@body));
+	my $op = rand();
+	if ($op < 0.35) {
+	    splice @body, $i, 1;
+	} elsif ($op < 0.55) {
+	    splice @body, $i, 0, $body[int(rand(@body))];
+	} elsif ($op < 0.8) {
+	    my ($lineno) = split ' ', $body[$i];
+	    splice @body, $i, 0, "$lineno $extra[int(rand(@extra))]\n";
+	} else {
+	    # Swap the tokens of two lines, keeping their line numbers.
+	    my $j = int(rand(@body));
+	    my ($li, $ti) = $body[$i] =~ /^(\S+) (.*)$/s;
+	    my ($lj, $tj) = $body[$j] =~ /^(\S+) (.*)$/s;
+	    ($body[$i], $body[$j]) = ("$li $tj", "$lj $ti") if(defined($ti) and defined($tj));
+	}
+    }
+    my $tok = sprintf("m%04d.tok", $k);
+    write_file($tok, @head, @body);
+    compare($tok);
+}
+
+# ---------------------------------------------------------------------------
+# A generated program
+
+my @program;
+for (my $i = 0; $i < $classes; $i++) {
+    my @body;
+    for (my $j = 0; $j < 6; $j++) {
+	push @body, "  a$j : Int <- $j + $i;\n";
+	push @body, "  m$j(x : Int, y : Int) : Int { let z : Int <- x * y, w : Int <- z in" .
+	    " { z <- z + w; if z < 3 then z else w fi; } };\n";
+    }
+    my $text = "class C$i inherits IO {\n" . join("", @body) . "};\n";
+    if (rand() < 0.3) {
+	my @words = split / /, $text;
+	splice @words, int(rand(@words)), 1;
+	$text = join(" ", @words);
+    }
+    push @program, $text;
+}
+write_file("generated.cl", @program);
+system("../../lexer generated.cl > generated.tok 2>/dev/null");
+unlink "generated.cl" unless($keep);
+compare("generated.tok");
+
+printf "\n%d of %d token streams parse the same with -R (%d cases, %d mutants, %d classes generated)\n",
+    $checked - $differ, $checked, $graded, $mutants, $classes;
+exit($differ == 0 ? 0 : 1);
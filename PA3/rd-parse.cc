@@ -0,0 +1,526 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  rd-parse.cc
+//
+//  A hand-written parser for the grammar of cool.y, used instead of
+//  cool_yyparse() under -R.  Classes, features and statements are
+//  parsed by recursive descent, and expressions by precedence climbing
+//  with the binding powers of the precedence declarations of cool.y.
+//  It calls the same constructors in the same order as the actions of
+//  cool.y, and locates each as YYLLOC_DEFAULT does (see locate()), so
+//  the two parsers build the same tree, with the same spans.
+//
+//  Errors are handled as Bison handles them, so that the messages are
+//  the same too.  An error is thrown to the innermost construct whose
+//  Bison state shifts `error': a let binding, a block, a class body or
+//  the class list.  That construct discards tokens until one that its
+//  error rule accepts, and errstatus counts the tokens shifted since, as
+//  yyerrstatus does.  Tokens are read through recovering_lex() of
+//  cool.y, so the bounds on the discarding, and the restart at a
+//  discarded CLASS, are the same.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "cool-io.h"
+#include "cool-tree.h"
+#include "stringtab.h"
+#include "utilities.h"
+#include "cool-parse.h"
+#include "span-table.h"
+
+extern char *curr_filename;
+extern int curr_lineno;
+extern int node_lineno;
+extern int omerrs;
+extern Program ast_root;
+extern Classes parse_results;
+extern int recovering_lex();    // cool.y
+extern int resyncs;             // cool.y; counted by the error rules
+extern void (*class_parsed)(Class_);  // cool.y
+
+// Binding powers, from the precedence declarations of cool.y.  An
+// expression parsed at a power takes only operators that bind tighter.
+enum {
+  IN_PREC,              // a whole expression
+  ASSIGN_PREC,
+  NOT_PREC,
+  COMPARE_PREC,         // nonassociative
+  ADD_PREC,
+  MUL_PREC,
+  ISVOID_PREC,
+  NEG_PREC,
+  AT_PREC,
+  DOT_PREC
+};
+
+struct SyntaxError {};          // unwinds to the construct that recovers
+struct Abort {};                // end of input while recovering (YYABORT)
+
+static int la;                  // the lookahead token
+static YYSTYPE la_val;          // and its value
+static int la_line;             // and its line
+static int last_line;           // the line of the last token shifted
+static int errstatus;           // as yyerrstatus
+
+static void advance()
+{
+  la = recovering_lex();
+  la_val = cool_yylval;
+  la_line = curr_lineno;
+}
+
+// Shifts the lookahead, returning its value.
+static YYSTYPE shift()
+{
+  YYSTYPE val = la_val;
+  last_line = la_line;
+  if (errstatus)
+    errstatus--;
+  advance();
+  return val;
+}
+
+// Sets the span and line of the nodes built next, for the phrase from
+// line first to the last token shifted.  The line is that of the last
+// token read, as in cool.y: the token after the phrase if Bison reads
+// it to reduce the phrase (read_ahead), or else the phrase's last.
+static void locate(int first, bool read_ahead)
+{
+  node_span.first_line = first;
+  node_span.last_line = last_line;
+  node_lineno = read_ahead ? la_line : last_line;
+}
+
+static void syntax_error()
+{
+  if (!errstatus) {
+    cerr << "\"" << curr_filename << "\", line " << curr_lineno << ": "
+         << "syntax error at or near ";
+    print_cool_token(la);
+    cerr << endl;
+    omerrs++;
+  }
+  throw SyntaxError();
+}
+
+static YYSTYPE expect(int token)
+{
+  if (la != token)
+    syntax_error();
+  return shift();
+}
+
+// The recovery of the error rules that go through resync: shift error,
+// then discard tokens until a or b, which is left to the caller.
+static void resync(int a, int b)
+{
+  for (;;) {
+    resyncs++;
+    errstatus = 3;
+    if (la == a || la == b)
+      return;
+    if (la == 0)
+      throw Abort();
+    advance();
+  }
+}
+
+static bool starts_expression(int token)
+{
+  switch (token) {
+  case '(': case BOOL_CONST: case STR_CONST: case INT_CONST: case OBJECTID:
+  case IF: case WHILE: case '{': case LET: case CASE: case NEW: case ISVOID:
+  case NOT: case '~':
+    return true;
+  default:
+    return false;
+  }
+}
+
+static int infix_prec(int token)
+{
+  switch (token) {
+  case '<': case '=': case LE: return COMPARE_PREC;
+  case '+': case '-':          return ADD_PREC;
+  case '*': case '/':          return MUL_PREC;
+  case '@':                    return AT_PREC;
+  case '.':                    return DOT_PREC;
+  default:                     return -1;
+  }
+}
+
+static Expression expression(int prec);
+
+// The arguments of a dispatch, after its '('.  As in cool.y, the list
+// may start with a comma.
+static Expressions arguments()
+{
+  Expressions args;
+  if (starts_expression(la))
+    args = single_Expressions(expression(IN_PREC));
+  else
+    args = nil_Expressions();
+  while (la == ',') {
+    shift();
+    Expression e = expression(IN_PREC);
+    args = append_Expressions(args, single_Expressions(e));
+  }
+  expect(')');
+  return args;
+}
+
+// The statements of a block, after its '{'.  An error skips to the next
+// ';' and drops the statements before it (resync ';').
+static Expression block_body(int line)
+{
+  Expressions body = NULL;
+  for (;;) {
+    try {
+      do {
+        Expression e = expression(IN_PREC);
+        expect(';');
+        body = body ? append_Expressions(body, single_Expressions(e))
+                    : single_Expressions(e);
+      } while (la != '}');
+      break;
+    } catch (SyntaxError &) {
+      resync(';', ';');
+      shift();
+      body = nil_Expressions();
+      if (la == '}')
+        break;
+    }
+  }
+  shift();
+  locate(line, false);
+  return block(body);
+}
+
+// The bindings and body of a let, after its LET or a ','.  An error
+// here or in the body skips to the next IN, to parse a body, or ',', to
+// parse further bindings (resync IN expression, resync ',' let).
+static Expression let_bindings()
+{
+  bool in_body = false;         // an error was followed by IN
+  for (;;) {
+    try {
+      if (in_body)
+        return expression(IN_PREC);
+      int line = la_line;
+      Symbol name = expect(OBJECTID).symbol;
+      expect(':');
+      Symbol type = expect(TYPEID).symbol;
+      Expression init = NULL, body;
+      if (la == ASSIGN) {
+        shift();
+        init = expression(IN_PREC);
+      }
+      int sep = la_line;        // of the IN or ',', for a missing init
+      if (la == ',') {
+        shift();
+        body = let_bindings();
+      } else {
+        expect(IN);
+        body = expression(IN_PREC);
+      }
+      if (!init) {              // as no_init() in cool.y
+        node_span.first_line = node_span.last_line = node_lineno = sep;
+        init = no_expr();
+      }
+      locate(line, true);
+      return let(name, type, init, body);
+    } catch (SyntaxError &) {
+      resync(IN, ',');
+    }
+    if (la == ',') {
+      shift();
+      return let_bindings();
+    }
+    shift();
+    in_body = true;
+  }
+}
+
+static Case branch_decl()
+{
+  int line = la_line;
+  Symbol name = expect(OBJECTID).symbol;
+  expect(':');
+  Symbol type = expect(TYPEID).symbol;
+  expect(DARROW);
+  Expression e = expression(IN_PREC);
+  expect(';');
+  locate(line, false);
+  return branch(name, type, e);
+}
+
+// The operand an expression starts with: a constant, a name, a
+// keyword construct or a prefix operator and its operand.
+static Expression operand()
+{
+  int line = la_line;
+  YYSTYPE v;
+  Expression e, e2, e3;
+  switch (la) {
+  case '(':
+    shift();
+    e = expression(IN_PREC);
+    expect(')');
+    return e;
+  case BOOL_CONST:
+    v = shift();
+    locate(line, false);
+    return bool_const(v.boolean);
+  case STR_CONST:
+    v = shift();
+    locate(line, false);
+    return string_const(v.symbol);
+  case INT_CONST:
+    v = shift();
+    locate(line, false);
+    return int_const(v.symbol);
+  case OBJECTID:
+    v = shift();
+    if (la == ASSIGN) {
+      shift();
+      e = expression(ASSIGN_PREC);
+      locate(line, true);
+      return assign(v.symbol, e);
+    }
+    if (la == '(') {
+      shift();
+      Expressions args = arguments();
+      locate(line, false);
+      return dispatch(object(idtable.add_string("self")), v.symbol, args);
+    }
+    locate(line, true);
+    return object(v.symbol);
+  case IF:
+    shift();
+    e = expression(IN_PREC);
+    expect(THEN);
+    e2 = expression(IN_PREC);
+    expect(ELSE);
+    e3 = expression(IN_PREC);
+    expect(FI);
+    locate(line, false);
+    return cond(e, e2, e3);
+  case WHILE:
+    shift();
+    e = expression(IN_PREC);
+    expect(LOOP);
+    e2 = expression(IN_PREC);
+    expect(POOL);
+    locate(line, false);
+    return loop(e, e2);
+  case '{':
+    shift();
+    return block_body(line);
+  case LET:
+    shift();
+    return let_bindings();
+  case CASE: {
+    shift();
+    e = expression(IN_PREC);
+    expect(OF);
+    Cases cases = single_Cases(branch_decl());
+    while (la == OBJECTID) {
+      Case c = branch_decl();
+      cases = append_Cases(cases, single_Cases(c));
+    }
+    expect(ESAC);
+    locate(line, false);
+    return typcase(e, cases);
+  }
+  case NEW:
+    shift();
+    v = expect(TYPEID);
+    locate(line, false);
+    return new_(v.symbol);
+  case ISVOID:
+    shift();
+    e = expression(ISVOID_PREC);
+    locate(line, true);
+    return isvoid(e);
+  case NOT:
+    shift();
+    e = expression(NOT_PREC);
+    locate(line, true);
+    return comp(e);
+  case '~':
+    shift();
+    e = expression(NEG_PREC);
+    locate(line, true);
+    return neg(e);
+  default:
+    syntax_error();
+    return NULL;
+  }
+}
+
+// An expression taking only the operators that bind tighter than prec.
+// Its nodes span from its first token.
+static Expression expression(int prec)
+{
+  int line = la_line;
+  Expression e = operand();
+  for (;;) {
+    int op = la, op_prec = infix_prec(op);
+    if (op_prec <= prec)
+      return e;
+    shift();
+    if (op == '.' || op == '@') {
+      Symbol type = NULL;
+      if (op == '@') {
+        type = expect(TYPEID).symbol;
+        expect('.');
+      }
+      Symbol name = expect(OBJECTID).symbol;
+      expect('(');
+      Expressions args = arguments();
+      locate(line, false);
+      e = type ? static_dispatch(e, type, name, args)
+               : dispatch(e, name, args);
+      continue;
+    }
+    Expression rhs = expression(op_prec);
+    locate(line, true);
+    switch (op) {
+    case '<': e = lt(e, rhs);     break;
+    case '=': e = eq(e, rhs);     break;
+    case LE:  e = leq(e, rhs);    break;
+    case '+': e = plus(e, rhs);   break;
+    case '-': e = sub(e, rhs);    break;
+    case '*': e = mul(e, rhs);    break;
+    case '/': e = divide(e, rhs); break;
+    }
+    if (op_prec == COMPARE_PREC && infix_prec(la) == COMPARE_PREC)
+      syntax_error();
+  }
+}
+
+static Formal formal_decl()
+{
+  int line = la_line;
+  Symbol name = expect(OBJECTID).symbol;
+  expect(':');
+  Symbol type = expect(TYPEID).symbol;
+  locate(line, false);
+  return formal(name, type);
+}
+
+static Feature feature()
+{
+  int line = la_line;
+  Symbol name = shift().symbol;
+  Symbol type;
+  Expression e;
+  if (la == ':') {
+    shift();
+    type = expect(TYPEID).symbol;
+    e = NULL;
+    if (la == ASSIGN) {
+      shift();
+      e = expression(IN_PREC);
+    }
+    expect(';');
+    locate(line, false);
+    return attr(name, type, e ? e : no_expr());
+  }
+  expect('(');
+  Formals formals = NULL;
+  if (la != ')') {
+    formals = single_Formals(formal_decl());
+    while (la == ',') {
+      shift();
+      Formal f = formal_decl();
+      formals = append_Formals(formals, single_Formals(f));
+    }
+  }
+  expect(')');
+  expect(':');
+  type = expect(TYPEID).symbol;
+  expect('{');
+  e = expression(IN_PREC);
+  expect('}');
+  expect(';');
+  locate(line, false);
+  return method(name, formals ? formals : nil_Formals(), type, e);
+}
+
+// A class, at its CLASS.  An error in the body, or at its closing '}'
+// ';', skips to the next ';' or '}' ';' and goes on with the features.
+static Class_ class_decl()
+{
+  int line = la_line;
+  shift();
+  Symbol name = expect(TYPEID).symbol;
+  Symbol parent = NULL;
+  if (la == INHERITS) {
+    shift();
+    parent = expect(TYPEID).symbol;
+  }
+  expect('{');
+  Features features = nil_Features();
+  for (;;) {
+    try {
+      while (la == OBJECTID) {
+        Feature f = feature();
+        features = append_Features(features, single_Features(f));
+      }
+      expect('}');
+      expect(';');
+      break;
+    } catch (SyntaxError &) {
+      for (;;) {
+        resync(';', '}');
+        if (la == ';' || (shift(), la == ';'))
+          break;
+      }
+      shift();
+    }
+  }
+  locate(line, false);
+  Class_ c = class_(name, parent ? parent : idtable.add_string("Object"),
+                    features, stringtable.add_string(curr_filename));
+  if (class_parsed)
+    class_parsed(c);
+  return c;
+}
+
+// Parses the token stream as cool_yyparse() does: sets ast_root and
+// parse_results, and returns 0, or 1 if it gave up at the end of the
+// input while recovering from an error.
+int rd_parse()
+{
+  errstatus = 0;
+  try {
+    advance();
+    Classes classes = NULL;
+    int line = la_line;
+    for (;;) {
+      try {
+        if (la == 0 && classes)
+          break;
+        if (la != CLASS)
+          syntax_error();
+        Class_ c = class_decl();
+        classes = classes ? append_Classes(classes, single_Classes(c))
+                          : single_Classes(c);
+        parse_results = classes;
+      } catch (SyntaxError &) {
+        // class_list: error, and class_list error
+        errstatus = 3;
+        while (la != CLASS && la != 0)
+          advance();
+        if (!classes)
+          classes = nil_Classes();
+      }
+    }
+    locate(line, true);
+    ast_root = program(classes);
+    return 0;
+  } catch (Abort &) {
+    return 1;
+  }
+}
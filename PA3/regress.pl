@@ -0,0 +1,314 @@
+#!/usr/bin/perl -w
+#
+# regress.pl - runs the grading test cases in parallel
+#
+# The pa*-grading.pl scripts unpack their test cases and run them one
+# after another through 143gradesingle.  This script runs the same
+# cases, judged the same way (chomp, the case's filter, diff -w -i,
+# and the .out1, .out2, ... alternatives), on several workers at once.
+# The cases are handed out largest first, one at a time, to whichever
+# worker is free.
+#
+# The assignment is found from the files in the current directory:
+#
+#     PA2   cool.flex    ../lexer case
+#     PA3   cool.y       ../lexer case | ../parser
+#     PA4   semant.cc    ../lexer case | ../parser | ../semant
+#
+# With -server (PA4 only) each worker starts its own semant-server and
+# sends its cases to it, so the checker and the parses of its cases
+# stay in one process for the whole run; the workers share one parse
+# cache.  The lexer and parser are separate programs, so PA2 and PA3
+# start them for every case.
+#
+# -parser-flags passes flags to ../parser in PA3 and PA4, for example
+# -parser-flags -R to grade the recursive-descent parser.
+#
+# Every case is reported with its time; a failed one also gets
+# <dir>/test-output/<case>.diff.  -json writes one JSON line per case.
+# The exit status is 1 if any case failed.
+#
+
+use strict;
+
+use Getopt::Long;
+use IO::Handle;
+use IO::Select;
+use Socket;
+use POSIX qw(:sys_wait_h setpgid);
+use Time::HiRes qw(time);
+use Cwd qw(getcwd);
+
+my $grading_dir = "./grading";
+my $jobs;
+my $use_server;
+my $verbose;
+my $json_file;
+my $timeout = 60;
+my $parser_flags = "";
+
+sub usage {
+    print "Usage: $0 [options] [case ...]\n";
+    print "    Options: -dir <path>  - grading directory, unpacked by the grading\n";
+    print "                            script if it has no cases file\n";
+    print "                            [default = \"$grading_dir\"]\n";
+    print "             -j <n>       - number of workers [default = number of CPUs]\n";
+    print "             -server      - PA4: check through one semant-server per worker\n";
+    print "             -parser-flags <flags>\n";
+    print "                          - PA3, PA4: flags for ../parser, e.g. -R\n";
+    print "             -timeout <s> - seconds before a case is killed [default = $timeout]\n";
+    print "             -json <file> - write the result of each case as a JSON line\n";
+    print "             -v           - print passing cases too\n";
+    return "\n";
+}
+
+die usage()
+    unless(GetOptions("dir=s" => \$grading_dir,
+		      "j=i" => \$jobs,
+		      "server" => \$use_server,
+		      "parser-flags=s" => \$parser_flags,
+		      "timeout=i" => \$timeout,
+		      "json=s" => \$json_file,
+		      "v" => \$verbose,
+		      "help" => sub { usage(); exit 0; }));
+
+# ---------------------------------------------------------------------------
+# Assignment, test cases
+
+my ($assign, $grading_script, @binaries);
+if (-r "cool.flex") {
+    ($assign, $grading_script, @binaries) = ("PA2", "pa1-grading.pl", "lexer");
+} elsif (-r "cool.y") {
+    ($assign, $grading_script, @binaries) = ("PA3", "pa2-grading.pl", "lexer", "parser");
+} elsif (-r "semant.cc") {
+    ($assign, $grading_script, @binaries) = ("PA4", "pa3-grading.pl", "lexer", "parser", "semant");
+    push @binaries, "semant-server" if($use_server);
+} else {
+    die "$0: run this from an assignment directory\n";
+}
+die "$0: -server needs PA4\n" if($use_server and $assign ne "PA4");
+die "$0: -parser-flags needs PA3 or PA4\n" if($parser_flags ne "" and $assign eq "PA2");
+die "$0: -parser-flags does not go through semant-server\n"
+    if($parser_flags ne "" and $use_server);
+$json_file = getcwd() . "/$json_file" if(defined($json_file) and $json_file !~ m{^/});
+foreach my $b (@binaries) {
+    die "$0: ./$b not found; run make $b first\n" unless(-x $b);
+}
+
+unless(-r "$grading_dir/cases") {
+    system("perl $grading_script -x -dir $grading_dir > /dev/null") == 0
+	or die "$0: could not unpack the test cases with $grading_script\n";
+}
+chdir($grading_dir) or die "$0: can't change directory to '$grading_dir'\n";
+system("mkdir -p test-output");
+
+my @cases;
+open CASES, "cases" or die "$0: could not open $grading_dir/cases\n";
+while (defined(my $line = <CASES>)) {
+    chomp $line;
+    next if($line =~ /^#/ or $line =~ /^\s*$/ or $line =~ /maxscore/i);
+    my @field = split /;/, $line;
+    my $file = $field[0];
+    $file =~ s/^\s+|\s+$//g;
+    my $filter = defined($field[4]) ? $field[4] : "$assign-filter";
+    $filter =~ s/ //g;
+    $filter = "$assign-filter" if($filter eq "");
+    my $points = defined($field[1]) ? $field[1] : 0;
+    $points =~ s/ //g;
+    my ($prefix) = split /\./, $file;
+    next if(@ARGV and !grep { $_ eq $file or $_ eq $prefix } @ARGV);
+    push @cases, { file => $file, prefix => $prefix, points => $points,
+		   comment => defined($field[2]) ? $field[2] : "",
+		   filter => $filter, size => -s $file || 0 };
+}
+close CASES;
+die "$0: no test cases\n" unless(@cases);
+
+# Longest cases first, so that no worker is left with a big one at the end.
+my @order = sort { $cases[$b]{size} <=> $cases[$a]{size} } 0 .. $#cases;
+
+unless(defined($jobs)) {
+    $jobs = `getconf _NPROCESSORS_ONLN 2>/dev/null`;
+    chomp $jobs;
+    $jobs = 1 unless($jobs and $jobs > 0);
+}
+$jobs = @cases if($jobs > @cases);
+
+# ---------------------------------------------------------------------------
+# Worker
+
+# Runs cmd in its own process group with output to out; returns the
+# wait status, or -1 if it was killed after $timeout seconds.
+sub run_case {
+    my ($cmd, $out) = @_;
+    my $pid = fork();
+    die "$0: fork: $!\n" unless(defined($pid));
+    if ($pid == 0) {
+	setpgid(0, 0);
+	open STDOUT, ">", $out;
+	open STDERR, ">&STDOUT";
+	exec("/bin/sh", "-c", $cmd);
+	exit 127;
+    }
+    my $status;
+    eval {
+	local $SIG{ALRM} = sub { die "timeout\n"; };
+	alarm $timeout;
+	waitpid($pid, 0);
+	$status = $?;
+	alarm 0;
+    };
+    if ($@) {
+	kill -9, $pid;
+	waitpid($pid, 0);
+	return -1;
+    }
+    return $status;
+}
+
+# The diff of out against the expected output of the case, or "" if
+# one of the expected outputs matches.  Judged as 143gradesingle does.
+sub diff_case {
+    my ($c, $out) = @_;
+    system("./chomp < $out > $out.chomp");
+    system("./$c->{filter} < $out.chomp > $out") if(-r $c->{filter});
+    unlink "$out.chomp";
+    my $first = "";
+    for (my $n = 0; ; $n++) {
+	my $good = $c->{file} . ".out" . ($n ? $n : "");
+	last unless(-r $good);
+	my $diff = `./chomp < $good | ./$c->{filter} | diff -w -i - $out`;
+	$first = $diff if($n == 0);
+	return "" unless(grep { /^[<>]/ and !/^[<>]\s+$/ } split /\n/, $diff);
+    }
+    return $first eq "" ? "no expected output\n" : $first;
+}
+
+sub worker {
+    my ($w, $fh) = @_;
+    my $socket;
+    if ($use_server) {
+	$socket = "/tmp/regress-$$-$w.sock";
+	system("../semant-server -s $socket -L ../lexer -R ../parser -C .cool-cache &");
+	for (my $i = 0; $i < 100 and !-S $socket; $i++) {
+	    select(undef, undef, undef, 0.05);
+	}
+    }
+    while (defined(my $line = <$fh>)) {
+	chomp $line;
+	last if($line eq "quit");
+	my $c = $cases[$line];
+	my $cmd;
+	if ($use_server) {
+	    $cmd = "../semant-server -c -s $socket $c->{file}";
+	} elsif ($assign eq "PA2") {
+	    $cmd = "../lexer $c->{file}";
+	} elsif ($assign eq "PA3") {
+	    $cmd = "../lexer $c->{file} | ../parser $parser_flags";
+	} else {
+	    $cmd = "../lexer $c->{file} | ../parser $parser_flags | ../semant";
+	}
+	my $out = "test-output/$c->{prefix}.out";
+	my $start = time();
+	my $status = run_case($cmd, $out);
+	my $ms = (time() - $start) * 1000;
+
+	my $result = "pass";
+	if ($status == -1) {
+	    $result = "timeout";
+	} elsif (($status & 127) or ($assign eq "PA2" and $status != 0)) {
+	    $result = "crash";
+	} else {
+	    my $diff = diff_case($c, $out);
+	    if ($diff ne "") {
+		$result = "fail";
+		open DIFF, ">", "test-output/$c->{prefix}.diff";
+		print DIFF $diff;
+		close DIFF;
+	    }
+	}
+	unlink $out if($result eq "pass");
+	printf $fh "%d %s %.3f\n", $line, $result, $ms;
+    }
+    system("../semant-server -k -s $socket") if($use_server);
+    exit 0;
+}
+
+# ---------------------------------------------------------------------------
+# Scheduler
+
+unlink glob("test-output/*.diff");
+my $wall_start = time();
+my (%worker_of, @handles);
+my $select = IO::Select->new();
+for (my $w = 0; $w < $jobs; $w++) {
+    socketpair(my $parent, my $child, AF_UNIX, SOCK_STREAM, PF_UNSPEC)
+	or die "$0: socketpair: $!\n";
+    $parent->autoflush(1);
+    $child->autoflush(1);
+    my $pid = fork();
+    die "$0: fork: $!\n" unless(defined($pid));
+    if ($pid == 0) {
+	close $parent;
+	worker($w, $child);
+    }
+    close $child;
+    $select->add($parent);
+    push @handles, $parent;
+}
+
+my $next = 0;
+foreach my $h (@handles) {
+    print $h ($next < @order ? $order[$next++] : "quit"), "\n";
+}
+
+my ($passed, $lost, $done) = (0, 0, 0);
+my @results;
+while ($done < @order) {
+    foreach my $h ($select->can_read()) {
+	my $line = <$h>;
+	unless(defined($line)) {
+	    $select->remove($h);
+	    next;
+	}
+	my ($i, $result, $ms) = split ' ', $line;
+	my $c = $cases[$i];
+	$c->{result} = $result;
+	$c->{ms} = $ms;
+	$done++;
+	if ($result eq "pass") {
+	    $passed++;
+	    printf "%-8s %9.1f ms  %s\n", "pass", $ms, $c->{file} if($verbose);
+	} else {
+	    $lost += $c->{points};
+	    printf "%-8s %9.1f ms  %s\t%s\n", $result, $ms, $c->{file}, $c->{comment};
+	}
+	print $h ($next < @order ? $order[$next++] : "quit"), "\n";
+    }
+    last unless($select->count());
+}
+while (wait() != -1) { }
+my $wall_ms = (time() - $wall_start) * 1000;
+
+# ---------------------------------------------------------------------------
+# Summary
+
+my $case_ms = 0;
+$case_ms += $_->{ms} || 0 foreach @cases;
+printf "\n%d of %d cases passed (-%d points); %.1f ms of cases in %.1f ms on %d workers\n",
+    $passed, scalar(@cases), $lost, $case_ms, $wall_ms, $jobs;
+my @slowest = sort { ($b->{ms} || 0) <=> ($a->{ms} || 0) } @cases;
+print "slowest:";
+printf " %s %.1f ms;", $_->{file}, $_->{ms} || 0 foreach @slowest[0 .. ($#slowest < 4 ? $#slowest : 4)];
+print "\n";
+
+if (defined($json_file)) {
+    open JSON, ">", $json_file or die "$0: could not open $json_file\n";
+    foreach my $c (@cases) {
+	printf JSON "{\"case\": \"%s\", \"result\": \"%s\", \"ms\": %.3f, \"points\": %s}\n",
+	    $c->{file}, $c->{result} || "lost", $c->{ms} || 0, $c->{points} || 0;
+    }
+    close JSON;
+}
+
+exit($passed == @cases ? 0 : 1);
@@ -0,0 +1,120 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  span-table.cc
+//
+//  Implements the per-file span tables (see span-table.h).  Nodes are
+//  built in the order their phrases end, so the nodes of one reduction,
+//  and a node and the chain of reductions above it, often have the
+//  same span; a span equal to the last one in its table reuses it.
+//
+//  The side file of -X is written from dump_line(), which sees the
+//  nodes in preorder.  A node is held back on a stack until the dump
+//  reaches a node at its depth or above, when all of its children
+//  have been written, which turns the preorder into postorder.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "span-table.h"
+
+extern char *curr_filename;
+
+#define SPAN_INDEX_BITS (32 - SPAN_FILE_BITS)
+#define MAX_SPAN_FILES ((1 << SPAN_FILE_BITS) - 1)
+#define MAX_FILE_SPANS (1 << SPAN_INDEX_BITS)
+
+Span node_span = { 1, 1 };
+
+struct SpanFile {
+  char *name;
+  std::vector<Span> spans;
+};
+
+static std::vector<SpanFile> files;
+static int current = -1;        // the file of curr_filename
+
+static int file_of(char *name)
+{
+  for (size_t i = 0; i < files.size(); i++)
+    if (files[i].name == name || strcmp(files[i].name, name) == 0)
+      return i;
+  if (files.size() == MAX_SPAN_FILES)
+    return -1;
+  files.push_back(SpanFile());
+  files.back().name = name;
+  return files.size() - 1;
+}
+
+SpanRef node_span_ref()
+{
+  if (current < 0 || files[current].name != curr_filename)
+    if ((current = file_of(curr_filename)) < 0)
+      return NO_SPAN;
+  std::vector<Span> &spans = files[current].spans;
+  if (spans.empty() || spans.back().first_line != node_span.first_line ||
+      spans.back().last_line != node_span.last_line) {
+    if (spans.size() == MAX_FILE_SPANS)
+      return NO_SPAN;
+    spans.push_back(node_span);
+  }
+  return ((SpanRef) (current + 1) << SPAN_INDEX_BITS) | (spans.size() - 1);
+}
+
+Span span_lines(SpanRef ref)
+{
+  Span none = { 0, 0 };
+  if (ref == NO_SPAN)
+    return none;
+  return files[(ref >> SPAN_INDEX_BITS) - 1].spans[ref & (MAX_FILE_SPANS - 1)];
+}
+
+char *span_file(SpanRef ref)
+{
+  return ref == NO_SPAN ? NULL : files[(ref >> SPAN_INDEX_BITS) - 1].name;
+}
+
+static FILE *dump_file;
+
+struct HeldSpan {
+  int depth;
+  SpanRef ref;
+};
+
+static std::vector<HeldSpan> held;
+
+void span_dump_open(char *path)
+{
+  if ((dump_file = fopen(path, "w")) == NULL) {
+    perror(path);
+    exit(1);
+  }
+}
+
+static void write_held(int depth)
+{
+  while (!held.empty() && held.back().depth >= depth) {
+    Span s = span_lines(held.back().ref);
+    fprintf(dump_file, "%d %d\n", s.first_line, s.last_line);
+    held.pop_back();
+  }
+}
+
+void span_dump_node(int depth, SpanRef ref)
+{
+  if (dump_file == NULL)
+    return;
+  write_held(depth);
+  HeldSpan h = { depth, ref };
+  held.push_back(h);
+}
+
+void span_dump_flush()
+{
+  if (dump_file == NULL)
+    return;
+  write_held(0);
+  fflush(dump_file);
+}
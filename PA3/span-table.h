@@ -0,0 +1,46 @@
+#ifndef SPAN_TABLE_H_
+#define SPAN_TABLE_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  span-table.h
+//
+//  Source spans of AST nodes.  Every node of a phylum carries a
+//  SpanRef (SPAN_EXTRAS in cool-tree.handcode.h), a 32-bit reference
+//  into the span table of its file: the top SPAN_FILE_BITS bits number
+//  the file and the rest an entry of that file's table.  The reference
+//  sits in the 4 bytes of padding tree_node leaves after line_number,
+//  so no node is bigger for it.
+//
+//  The token stream gives each token a line but no column, so a span
+//  is the lines of the first and last token of the phrase.  The parser
+//  sets node_span before it builds nodes, as it sets node_lineno (see
+//  YYLLOC_DEFAULT in cool.y).
+//
+//  With -X the parser also writes the spans to a side file, one line
+//  "first last" per node, in the order the next phase's AST reader
+//  builds the nodes: postorder, children before their parent.  The
+//  AST dump itself is unchanged.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+struct Span {
+  int first_line, last_line;
+};
+
+typedef unsigned SpanRef;
+
+#define SPAN_FILE_BITS 8
+#define NO_SPAN 0               // for nodes built after the tables filled up
+
+extern Span node_span;          // the span of the nodes built next
+
+SpanRef node_span_ref();        // node_span in the table of curr_filename
+Span span_lines(SpanRef ref);   // 0, 0 for NO_SPAN
+char *span_file(SpanRef ref);   // NULL for NO_SPAN
+
+void span_dump_open(char *path);            // -X: start the side file
+void span_dump_node(int depth, SpanRef ref); // a node, in dump order
+void span_dump_flush();         // write the nodes still held back
+
+#endif
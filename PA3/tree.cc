@@ -18,6 +18,9 @@
 /* line number to assign to the current node being constructed */
 int node_lineno = 1;
 
+/* number of nodes constructed so far; reported by -P */
+long tree_node_count = 0;
+
 ///////////////////////////////////////////////////////////////////////////
 //
 // tree_node::tree_node
@@ -28,6 +31,7 @@ int node_lineno = 1;
 tree_node::tree_node()
 {
     line_number = node_lineno;
+    tree_node_count++;
 }
 
 ///////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,627 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  ast-cache.cc
+//
+//  Implements the cache of parsed files (see ast-cache.h).  An entry
+//  is the format and key, then the classes:
+//
+//      "COOLAST" AST_CACHE_FORMAT key:8 classes
+//
+//  Every node is its tag and line number followed by its fields in the
+//  order the constructor takes them, lists are a count followed by the
+//  elements, and a symbol is its index among the symbols seen so far,
+//  or, the first time, the next index followed by its length and bytes.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <algorithm>
+#include "ast-cache.h"
+
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME  1099511628211UL
+
+extern int node_lineno;
+
+static const char MAGIC[] = "COOLAST";
+
+enum AstTag {
+  TAG_CLASS = 1, TAG_METHOD, TAG_ATTR, TAG_FORMAL, TAG_BRANCH,
+  TAG_ASSIGN, TAG_STATIC_DISPATCH, TAG_DISPATCH, TAG_COND, TAG_LOOP,
+  TAG_TYPCASE, TAG_BLOCK, TAG_LET, TAG_PLUS, TAG_SUB, TAG_MUL,
+  TAG_DIVIDE, TAG_NEG, TAG_LT, TAG_EQ, TAG_LEQ, TAG_COMP, TAG_INT,
+  TAG_BOOL, TAG_STRING, TAG_NEW, TAG_ISVOID, TAG_NO_EXPR, TAG_OBJECT
+};
+
+unsigned long content_hash(const char *bytes, size_t n, unsigned long seed)
+{
+  unsigned long h = FNV_OFFSET ^ seed;
+  for (size_t i = 0; i < n; i++)
+    h = (h ^ (unsigned char) bytes[i]) * FNV_PRIME;
+  return h;
+}
+
+// The hash of the contents of path, or seed if it cannot be read.
+unsigned long file_hash(const char *path, unsigned long seed)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return seed;
+  char buf[8192];
+  size_t n;
+  unsigned long h = seed;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    h = content_hash(buf, n, h);
+  fclose(f);
+  return h;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// AstWriter, and save() for each kind of node
+//
+//////////////////////////////////////////////////////////////////////
+
+void AstWriter::number(unsigned long n)
+{
+  while (n >= 0x80) {
+    out += (char) (n | 0x80);
+    n >>= 7;
+  }
+  out += (char) n;
+}
+
+void AstWriter::symbol(Symbol s)
+{
+  std::map<Symbol, unsigned long>::iterator it = symbols.find(s);
+  if (it != symbols.end()) {
+    number(it->second);
+    return;
+  }
+  unsigned long index = symbols.size();
+  symbols[s] = index;
+  number(index);
+  number(s->get_len());
+  out.append(s->get_string(), s->get_len());
+}
+
+void AstWriter::node(int tag, tree_node *t)
+{
+  out += (char) tag;
+  number(t->get_line_number());
+}
+
+void AstWriter::exprs(Expressions l)
+{
+  number(l->len());
+  for (int i = l->first(); l->more(i); i = l->next(i))
+    expr(l->nth(i));
+}
+
+void AstWriter::classes(Classes l)
+{
+  number(l->len());
+  for (int i = l->first(); l->more(i); i = l->next(i))
+    l->nth(i)->save(*this);
+}
+
+void AstWriter::symbol_list(std::vector<Symbol> &out)
+{
+  out.resize(symbols.size());
+  for (std::map<Symbol, unsigned long>::iterator it = symbols.begin();
+       it != symbols.end(); ++it)
+    out[it->second] = it->first;
+}
+
+void class__class::save(AstWriter &w)
+{
+  w.node(TAG_CLASS, this);
+  w.symbol(name);
+  w.symbol(parent);
+  w.number(features->len());
+  for (int i = features->first(); features->more(i); i = features->next(i))
+    features->nth(i)->save(w);
+}
+
+void method_class::save(AstWriter &w)
+{
+  w.node(TAG_METHOD, this);
+  w.symbol(name);
+  w.number(formals->len());
+  for (int i = formals->first(); formals->more(i); i = formals->next(i))
+    formals->nth(i)->save(w);
+  w.symbol(return_type);
+  w.expr(expr);
+}
+
+void attr_class::save(AstWriter &w)
+{
+  w.node(TAG_ATTR, this);
+  w.symbol(name);
+  w.symbol(type_decl);
+  w.expr(init);
+}
+
+void formal_class::save(AstWriter &w)
+{
+  w.node(TAG_FORMAL, this);
+  w.symbol(name);
+  w.symbol(type_decl);
+}
+
+void branch_class::save(AstWriter &w)
+{
+  w.node(TAG_BRANCH, this);
+  w.symbol(name);
+  w.symbol(type_decl);
+  w.expr(expr);
+}
+
+void assign_class::save(AstWriter &w)
+{
+  w.node(TAG_ASSIGN, this);
+  w.symbol(name);
+  w.expr(expr);
+}
+
+void static_dispatch_class::save(AstWriter &w)
+{
+  w.node(TAG_STATIC_DISPATCH, this);
+  w.expr(expr);
+  w.symbol(type_name);
+  w.symbol(name);
+  w.exprs(actual);
+}
+
+void dispatch_class::save(AstWriter &w)
+{
+  w.node(TAG_DISPATCH, this);
+  w.expr(expr);
+  w.symbol(name);
+  w.exprs(actual);
+}
+
+void cond_class::save(AstWriter &w)
+{
+  w.node(TAG_COND, this);
+  w.expr(pred);
+  w.expr(then_exp);
+  w.expr(else_exp);
+}
+
+void loop_class::save(AstWriter &w)
+{
+  w.node(TAG_LOOP, this);
+  w.expr(pred);
+  w.expr(body);
+}
+
+void typcase_class::save(AstWriter &w)
+{
+  w.node(TAG_TYPCASE, this);
+  w.expr(expr);
+  w.number(cases->len());
+  for (int i = cases->first(); cases->more(i); i = cases->next(i))
+    cases->nth(i)->save(w);
+}
+
+void block_class::save(AstWriter &w)
+{
+  w.node(TAG_BLOCK, this);
+  w.exprs(body);
+}
+
+void let_class::save(AstWriter &w)
+{
+  w.node(TAG_LET, this);
+  w.symbol(identifier);
+  w.symbol(type_decl);
+  w.expr(init);
+  w.expr(body);
+}
+
+void plus_class::save(AstWriter &w)
+{ w.node(TAG_PLUS, this); w.expr(e1); w.expr(e2); }
+void sub_class::save(AstWriter &w)
+{ w.node(TAG_SUB, this); w.expr(e1); w.expr(e2); }
+void mul_class::save(AstWriter &w)
+{ w.node(TAG_MUL, this); w.expr(e1); w.expr(e2); }
+void divide_class::save(AstWriter &w)
+{ w.node(TAG_DIVIDE, this); w.expr(e1); w.expr(e2); }
+void lt_class::save(AstWriter &w)
+{ w.node(TAG_LT, this); w.expr(e1); w.expr(e2); }
+void eq_class::save(AstWriter &w)
+{ w.node(TAG_EQ, this); w.expr(e1); w.expr(e2); }
+void leq_class::save(AstWriter &w)
+{ w.node(TAG_LEQ, this); w.expr(e1); w.expr(e2); }
+void neg_class::save(AstWriter &w)
+{ w.node(TAG_NEG, this); w.expr(e1); }
+void comp_class::save(AstWriter &w)
+{ w.node(TAG_COMP, this); w.expr(e1); }
+void isvoid_class::save(AstWriter &w)
+{ w.node(TAG_ISVOID, this); w.expr(e1); }
+
+void int_const_class::save(AstWriter &w)
+{ w.node(TAG_INT, this); w.symbol(token); }
+void bool_const_class::save(AstWriter &w)
+{ w.node(TAG_BOOL, this); w.number(val ? 1 : 0); }
+void string_const_class::save(AstWriter &w)
+{ w.node(TAG_STRING, this); w.symbol(token); }
+void new__class::save(AstWriter &w)
+{ w.node(TAG_NEW, this); w.symbol(type_name); }
+void no_expr_class::save(AstWriter &w)
+{ w.node(TAG_NO_EXPR, this); }
+void object_class::save(AstWriter &w)
+{ w.node(TAG_OBJECT, this); w.symbol(name); }
+
+//////////////////////////////////////////////////////////////////////
+//
+// AstReader
+//
+//////////////////////////////////////////////////////////////////////
+
+unsigned long AstReader::number()
+{
+  unsigned long n = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (p == end) {
+      bad = true;
+      return 0;
+    }
+    unsigned char b = *p++;
+    n |= (unsigned long) (b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return n;
+  }
+  bad = true;
+  return 0;
+}
+
+// Reads a node's tag and sets node_lineno to its line, so that the
+// constructor functions give the node that line.
+int AstReader::node()
+{
+  if (p == end) {
+    bad = true;
+    return 0;
+  }
+  int tag = *p++;
+  node_lineno = number() + line_offset;
+  return tag;
+}
+
+template <class Elem> Symbol AstReader::symbol(StringTable<Elem> &table)
+{
+  unsigned long index = number();
+  if (index < nsymbols)
+    return (*symbols)[index];
+  unsigned long len = number();
+  if (bad || index != nsymbols || len > (unsigned long) (end - p)) {
+    bad = true;
+    return idtable.add_string("");
+  }
+  nsymbols++;
+  if (index < symbols->size()) {
+    p += len;
+    return (*symbols)[index];
+  }
+  std::string s((const char *) p, len);
+  p += len;
+  Symbol sym = table.add_string(&s[0], len);
+  symbols->push_back(sym);
+  return sym;
+}
+
+Expressions AstReader::exprs()
+{
+  Expressions l = nil_Expressions();
+  for (unsigned long n = number(); n > 0 && !bad; n--)
+    l = append_Expressions(l, single_Expressions(expr()));
+  return l;
+}
+
+Expression AstReader::expr()
+{
+  int tag = node();
+  int line = node_lineno;
+  Expression e1, e2, e3;
+  Symbol s1, s2;
+  Expression result;
+
+  switch (tag) {
+  case TAG_ASSIGN:
+    s1 = id();
+    e1 = expr();
+    node_lineno = line;
+    return assign(s1, e1);
+  case TAG_STATIC_DISPATCH: {
+    e1 = expr();
+    s1 = id();
+    s2 = id();
+    Expressions actual = exprs();
+    node_lineno = line;
+    return static_dispatch(e1, s1, s2, actual);
+  }
+  case TAG_DISPATCH: {
+    e1 = expr();
+    s1 = id();
+    Expressions actual = exprs();
+    node_lineno = line;
+    return dispatch(e1, s1, actual);
+  }
+  case TAG_COND:
+    e1 = expr();
+    e2 = expr();
+    e3 = expr();
+    node_lineno = line;
+    return cond(e1, e2, e3);
+  case TAG_LOOP:
+    e1 = expr();
+    e2 = expr();
+    node_lineno = line;
+    return loop(e1, e2);
+  case TAG_TYPCASE: {
+    e1 = expr();
+    Cases cases = nil_Cases();
+    for (unsigned long n = number(); n > 0 && !bad; n--)
+      cases = append_Cases(cases, single_Cases(branch()));
+    node_lineno = line;
+    return typcase(e1, cases);
+  }
+  case TAG_BLOCK: {
+    Expressions body = exprs();
+    node_lineno = line;
+    return block(body);
+  }
+  case TAG_LET:
+    s1 = id();
+    s2 = id();
+    e1 = expr();
+    e2 = expr();
+    node_lineno = line;
+    return let(s1, s2, e1, e2);
+  case TAG_PLUS: case TAG_SUB: case TAG_MUL: case TAG_DIVIDE:
+  case TAG_LT: case TAG_EQ: case TAG_LEQ:
+    e1 = expr();
+    e2 = expr();
+    node_lineno = line;
+    switch (tag) {
+    case TAG_PLUS:   return plus(e1, e2);
+    case TAG_SUB:    return sub(e1, e2);
+    case TAG_MUL:    return mul(e1, e2);
+    case TAG_DIVIDE: return divide(e1, e2);
+    case TAG_LT:     return lt(e1, e2);
+    case TAG_EQ:     return eq(e1, e2);
+    default:         return leq(e1, e2);
+    }
+  case TAG_NEG: case TAG_COMP: case TAG_ISVOID:
+    e1 = expr();
+    node_lineno = line;
+    if (tag == TAG_NEG)
+      return neg(e1);
+    return tag == TAG_COMP ? comp(e1) : isvoid(e1);
+  case TAG_INT:
+    return int_const(symbol(inttable));
+  case TAG_BOOL:
+    return bool_const(number() != 0);
+  case TAG_STRING:
+    return string_const(symbol(stringtable));
+  case TAG_NEW:
+    return new_(id());
+  case TAG_OBJECT:
+    return object(id());
+  case TAG_NO_EXPR:
+    return no_expr();
+  default:
+    bad = true;
+    return no_expr();
+  }
+}
+
+Formal AstReader::formal()
+{
+  if (node() != TAG_FORMAL)
+    bad = true;
+  int line = node_lineno;
+  Symbol name = id();
+  Symbol type_decl = id();
+  node_lineno = line;
+  return ::formal(name, type_decl);
+}
+
+Case AstReader::branch()
+{
+  if (node() != TAG_BRANCH)
+    bad = true;
+  int line = node_lineno;
+  Symbol name = id();
+  Symbol type_decl = id();
+  Expression e = expr();
+  node_lineno = line;
+  return ::branch(name, type_decl, e);
+}
+
+Feature AstReader::feature()
+{
+  int tag = node();
+  int line = node_lineno;
+  Symbol name = id();
+  if (tag == TAG_METHOD) {
+    Formals formals = nil_Formals();
+    for (unsigned long n = number(); n > 0 && !bad; n--)
+      formals = append_Formals(formals, single_Formals(formal()));
+    Symbol return_type = id();
+    Expression body = expr();
+    node_lineno = line;
+    return method(name, formals, return_type, body);
+  }
+  if (tag != TAG_ATTR)
+    bad = true;
+  Symbol type_decl = id();
+  Expression init = expr();
+  node_lineno = line;
+  return attr(name, type_decl, init);
+}
+
+Classes AstReader::classes()
+{
+  Classes l = nil_Classes();
+  for (unsigned long n = number(); n > 0 && !bad; n--) {
+    if (node() != TAG_CLASS)
+      bad = true;
+    int line = node_lineno;
+    Symbol name = id();
+    Symbol parent = id();
+    Features features = nil_Features();
+    for (unsigned long k = number(); k > 0 && !bad; k--)
+      features = append_Features(features, single_Features(feature()));
+    node_lineno = line;
+    l = append_Classes(l, single_Classes(class_(name, parent, features, filename)));
+  }
+  return bad || p != end ? NULL : l;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// AstCache
+//
+//////////////////////////////////////////////////////////////////////
+
+AstCache::AstCache(const char *d, long max, unsigned long v)
+  : dir(d), max_bytes(max), total_bytes(0),
+    hits(0), misses(0), stored(0), evicted(0)
+{
+  version = content_hash(MAGIC, sizeof(MAGIC), v ^ AST_CACHE_FORMAT);
+  if (max_bytes > 0)
+    evict();
+}
+
+unsigned long AstCache::key(const std::string &source)
+{
+  return content_hash(source.data(), source.size(), version);
+}
+
+std::string AstCache::entry_path(unsigned long key)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "/%016lx.ast", key);
+  return dir + name;
+}
+
+static std::string header(unsigned long key)
+{
+  std::string h(MAGIC, sizeof(MAGIC) - 1);
+  h += (char) AST_CACHE_FORMAT;
+  for (int i = 0; i < 8; i++)
+    h += (char) (key >> (8 * i));
+  return h;
+}
+
+Classes AstCache::lookup(unsigned long key, Symbol filename)
+{
+  std::string path = entry_path(key);
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == NULL) {
+    misses++;
+    return NULL;
+  }
+  std::string data;
+  char buf[8192];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    data.append(buf, n);
+  fclose(f);
+
+  std::string h = header(key);
+  Classes classes = NULL;
+  if (data.compare(0, h.size(), h) == 0) {
+    AstReader reader(data.data() + h.size(), data.size() - h.size(), filename);
+    classes = reader.classes();
+  }
+  if (classes == NULL) {
+    if (unlink(path.c_str()) == 0)
+      total_bytes -= data.size();
+    misses++;
+    return NULL;
+  }
+  utimes(path.c_str(), NULL);
+  hits++;
+  return classes;
+}
+
+void AstCache::store(unsigned long key, Classes classes)
+{
+  std::string data = header(key);
+  AstWriter writer(data);
+  writer.classes(classes);
+
+  mkdir(dir.c_str(), 0777);
+  std::string path = entry_path(key);
+  char tmp[32];
+  snprintf(tmp, sizeof(tmp), ".tmp%d", (int) getpid());
+  std::string tmp_path = path + tmp;
+  FILE *f = fopen(tmp_path.c_str(), "wb");
+  if (f == NULL)
+    return;
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) < 0) {
+    unlink(tmp_path.c_str());
+    return;
+  }
+  stored++;
+  total_bytes += data.size();
+  if (total_bytes > max_bytes)
+    evict();
+}
+
+struct CacheEntry {
+  time_t mtime;
+  off_t size;
+  std::string path;
+  bool operator<(const CacheEntry &e) const { return mtime < e.mtime; }
+};
+
+// Counts the entries and, if they do not fit, removes the least
+// recently used until the rest take up three quarters of the limit,
+// so that the next stores do not find the cache full again at once.
+void AstCache::evict()
+{
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL)
+    return;
+  std::vector<CacheEntry> entries;
+  long total = 0;
+  struct dirent *de;
+  while ((de = readdir(d)) != NULL) {
+    size_t len = strlen(de->d_name);
+    if (len < 4 || strcmp(de->d_name + len - 4, ".ast") != 0)
+      continue;
+    CacheEntry e;
+    e.path = dir + "/" + de->d_name;
+    struct stat st;
+    if (stat(e.path.c_str(), &st) < 0)
+      continue;
+    e.mtime = st.st_mtime;
+    e.size = st.st_size;
+    total += st.st_size;
+    entries.push_back(e);
+  }
+  closedir(d);
+  total_bytes = total;
+  if (total <= max_bytes)
+    return;
+
+  std::sort(entries.begin(), entries.end());
+  long low = max_bytes - max_bytes / 4;
+  for (size_t i = 0; i < entries.size() && total_bytes > low; i++)
+    if (unlink(entries[i].path.c_str()) == 0) {
+      total_bytes -= entries[i].size;
+      evicted++;
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef AST_CACHE_H_
+#define AST_CACHE_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  ast-cache.h
+//
+//  A content-addressed cache of parsed files on disk.  The classes
+//  the parser built for a file are saved in a compact binary form
+//  (AstWriter, and the save() method of each node) under a key that
+//  hashes the bytes of the file together with a version: the format
+//  and whatever the caller adds, such as the lexer and parser that
+//  produced them.  A file whose bytes have been parsed before by the
+//  same lexer and parser is then read back (AstReader) instead of
+//  being lexed and parsed again, wherever it lives.
+//
+//  Each entry is one file, <dir>/<key>.ast, written to a temporary
+//  name and renamed into place, so a reader never sees half of one.
+//  Entries are touched when they are read.  When the entries add up
+//  to more than the limit, the least recently used are removed until
+//  they take up three quarters of it.  The total is counted once, when
+//  the cache is opened, and then kept up to date with what this
+//  process stores, so the directory is only scanned again when that
+//  count passes the limit.  Entries other processes store are only
+//  seen by that scan.
+//
+//  An entry holds no file name; the classes read back get the one the
+//  caller gives.  Types are not saved: entries are written before
+//  semant runs.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "cool-tree.h"
+
+#define AST_CACHE_FORMAT 1
+
+unsigned long content_hash(const char *bytes, size_t n, unsigned long seed);
+unsigned long file_hash(const char *path, unsigned long seed);
+
+// Serializes nodes: a tag and line number per node, then its fields.
+// Integers are varints, and a symbol is written once and then named by
+// its index.
+class AstWriter {
+private:
+  std::string &out;
+  std::map<Symbol, unsigned long> symbols;
+
+public:
+  AstWriter(std::string &o) : out(o) { }
+  void number(unsigned long n);
+  void symbol(Symbol s);
+  void node(int tag, tree_node *t);
+  void expr(Expression e) { e->save(*this); }
+  void exprs(Expressions l);
+  void classes(Classes l);
+  void symbol_list(std::vector<Symbol> &out);     // in order of index
+};
+
+// Rebuilds what AstWriter wrote with the constructor functions of
+// cool-tree.cc, so -H applies.  Returns NULL from classes() if the
+// data is cut short or malformed.  line_offset is added to every line
+// number read.  Given a vector to keep the symbols in, a reader of
+// data read before takes them from it instead of from the tables.
+class AstReader {
+private:
+  const unsigned char *p, *end;
+  Symbol filename;
+  int line_offset;
+  std::vector<Symbol> own_symbols;
+  std::vector<Symbol> *symbols;
+  unsigned long nsymbols;       // symbols read so far
+  bool bad;
+
+  int node();
+  template <class Elem> Symbol symbol(StringTable<Elem> &table);
+  Symbol id() { return symbol(idtable); }
+  Expression expr();
+  Expressions exprs();
+  Feature feature();
+  Formal formal();
+  Case branch();
+
+public:
+  AstReader(const char *data, size_t n, Symbol f, int offset = 0,
+            std::vector<Symbol> *known = NULL)
+    : p((const unsigned char *) data), end((const unsigned char *) data + n),
+      filename(f), line_offset(offset), symbols(known ? known : &own_symbols),
+      nsymbols(0), bad(false) { }
+  unsigned long number();
+  Classes classes();
+};
+
+class AstCache {
+private:
+  std::string dir;
+  long max_bytes;
+  long total_bytes;             // of the entries, as far as we know
+  unsigned long version;
+
+  std::string entry_path(unsigned long key);
+  void evict();
+
+public:
+  long hits, misses, stored, evicted;
+
+  AstCache(const char *dir, long max_bytes, unsigned long version);
+  unsigned long key(const std::string &source);
+  Classes lookup(unsigned long key, Symbol filename);
+  void store(unsigned long key, Classes classes);
+};
+
+#endif
@@ -1989,10 +1989,17 @@ yyreturn:
 #line 243 "ast.y"
 
 
+/*
+ * parser -S ends a failed parse with a parse_error line after the
+ * classes it has printed; it is never valid where it stands.
+ */
 void ast_yyerror(char *msg)
 {
    cerr << "Error in ast parsing (line " << current_line << "): ";
-   cerr << msg << endl;
+   if (yychar == ID && strcmp(yylval.symbol->get_string(), "parse_error") == 0)
+      cerr << "the parser stopped at a parse error, so the tree is incomplete" << endl;
+   else
+      cerr << msg << endl;
    exit(1);
 }
 
@@ -0,0 +1,218 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  ast-pool.cc
+//
+//  Implements the AST node pool (see ast-pool.h).  The whole range a
+//  NodeRef can address is reserved up front without access rights, and
+//  committed a chunk at a time as nodes are allocated, so memory is
+//  only used for nodes that exist.  When -P is given the size of every
+//  allocation is also recorded, so that ast_pool_report() can walk the
+//  pool and report the bytes used by each kind of node.  Resetting the
+//  pool to a mark frees everything above it at once.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <typeinfo>
+#include <map>
+#include <string>
+#include <vector>
+#include "tree.h"
+#include "ast-pool.h"
+#include "phase-stats.h"
+
+#define AST_POOL_RESERVE  (32UL << 30)   // everything a NodeRef can address
+#define AST_POOL_MIN      (256UL << 20)
+#define AST_POOL_CHUNK    (1UL << 20)    // committed at a time
+
+char *ast_pool_base;
+static size_t pool_reserved;
+static size_t pool_committed;
+static size_t pool_top;
+static std::vector<unsigned> *alloc_sizes;   // only kept for -P
+
+//
+// Some systems refuse to reserve 32GB of address space; take the
+// largest power of two that is granted.
+//
+static void reserve_pool()
+{
+  for (size_t size = AST_POOL_RESERVE; size >= AST_POOL_MIN; size >>= 1) {
+    void *p = mmap(NULL, size, PROT_NONE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p != MAP_FAILED) {
+      ast_pool_base = (char *) p;
+      pool_reserved = size;
+      pool_top = 8;            // offset 0 is the NULL reference
+      if (phase_stats_file)
+        alloc_sizes = new std::vector<unsigned>;
+      return;
+    }
+  }
+  perror("ast pool");
+  exit(1);
+}
+
+void *ast_pool_alloc(size_t size)
+{
+  if (ast_pool_base == NULL)
+    reserve_pool();
+
+  size = (size + 7) & ~(size_t) 7;
+  if (pool_top + size > pool_committed) {
+    size_t want = (pool_top + size + AST_POOL_CHUNK - 1) & ~(AST_POOL_CHUNK - 1);
+    if (want > pool_reserved ||
+        mprotect(ast_pool_base + pool_committed, want - pool_committed,
+                 PROT_READ | PROT_WRITE) != 0) {
+      fprintf(stderr, "ast pool: out of memory after %lu bytes\n",
+              (unsigned long) pool_top);
+      exit(1);
+    }
+    pool_committed = want;
+  }
+
+  void *p = ast_pool_base + pool_top;
+  pool_top += size;
+  if (alloc_sizes)
+    alloc_sizes->push_back((unsigned) size);
+  return p;
+}
+
+//
+// Gives back the memory of the node allocated last, for hash-consing
+// (see hashcons.cc), which only learns after building a node that it
+// already has one like it.  Memory that is not at the top of the pool
+// is left alone.
+//
+void ast_pool_release(void *p, size_t size)
+{
+  size = (size + 7) & ~(size_t) 7;
+  if ((char *) p + size != ast_pool_base + pool_top)
+    return;
+  pool_top -= size;
+  if (alloc_sizes)
+    alloc_sizes->pop_back();
+}
+
+size_t ast_pool_mark()
+{
+  if (ast_pool_base == NULL)
+    reserve_pool();
+  return pool_top;
+}
+
+//
+// The pages above the mark stay committed but are given back to the
+// system, and read as zeros when they are used again.
+//
+void ast_pool_reset(size_t mark)
+{
+  if (alloc_sizes)
+    while (pool_top > mark) {
+      pool_top -= alloc_sizes->back();
+      alloc_sizes->pop_back();
+    }
+  pool_top = mark;
+  size_t keep = (mark + AST_POOL_CHUNK - 1) & ~(AST_POOL_CHUNK - 1);
+  if (keep < pool_committed)
+    madvise(ast_pool_base + keep, pool_committed - keep, MADV_DONTNEED);
+}
+
+size_t ast_pool_used()
+{
+  return ast_pool_base ? pool_top - 8 : 0;
+}
+
+//
+// What a node of the given size would have cost as a separate malloc
+// chunk (glibc: an 8-byte header, 16-byte rounding, 32 bytes minimum).
+//
+static size_t malloc_chunk(size_t size)
+{
+  size_t chunk = (size + 8 + 15) & ~(size_t) 15;
+  return chunk < 32 ? 32 : chunk;
+}
+
+//
+// The kinds whose children are NodeRefs (see cool-tree.h).  The leaf
+// kinds are not compacted; see "AST memory" in the README for why.
+//
+static const char *compact_kinds[] = {
+  "plus", "sub", "mul", "divide", "lt", "eq", "leq", NULL
+};
+
+static bool is_compact(const std::string &kind)
+{
+  for (int i = 0; compact_kinds[i] != NULL; i++)
+    if (kind == compact_kinds[i])
+      return true;
+  return false;
+}
+
+struct KindStat {
+  long count;
+  long bytes;
+  long malloc_bytes;
+};
+
+//
+// Appends one JSON line to the -P file with the number of nodes of
+// each class and the bytes they use in the pool, and what they would
+// have used if each had been allocated with malloc, and whether the
+// kind holds its children as NodeRefs.
+//
+void ast_pool_report(const char *phase)
+{
+  if (phase_stats_file == NULL || alloc_sizes == NULL)
+    return;
+
+  std::map<std::string, KindStat> kinds;
+  long pool_bytes = 0, malloc_bytes = 0;
+  size_t off = 8;
+  for (size_t i = 0; i < alloc_sizes->size(); i++) {
+    unsigned size = (*alloc_sizes)[i];
+    tree_node *node = (tree_node *) (ast_pool_base + off);
+    off += size;
+
+    // typeid names are mangled as <length><name>; drop the length
+    // and the _class suffix.
+    const char *name = typeid(*node).name();
+    while (*name >= '0' && *name <= '9')
+      name++;
+    std::string kind(name);
+    if (kind.size() > 6 && kind.compare(kind.size() - 6, 6, "_class") == 0)
+      kind.erase(kind.size() - 6);
+
+    KindStat &k = kinds[kind];
+    k.count++;
+    k.bytes += size;
+    k.malloc_bytes += malloc_chunk(size);
+    pool_bytes += size;
+    malloc_bytes += malloc_chunk(size);
+  }
+
+  std::string line;
+  char buf[192];
+  snprintf(buf, sizeof(buf),
+      "{\"pid\": %d, \"phase\": \"%s\", \"nodes\": %lu, \"pool_bytes\": %ld, "
+      "\"malloc_bytes\": %ld, \"kinds\": {",
+      (int) getpid(), phase, (unsigned long) alloc_sizes->size(),
+      pool_bytes, malloc_bytes);
+  line += buf;
+  for (std::map<std::string, KindStat>::iterator it = kinds.begin();
+       it != kinds.end(); ++it) {
+    snprintf(buf, sizeof(buf),
+        "%s\"%s\": {\"count\": %ld, \"bytes\": %ld, \"malloc_bytes\": %ld, "
+        "\"compact\": %s}",
+        it == kinds.begin() ? "" : ", ", it->first.c_str(),
+        it->second.count, it->second.bytes, it->second.malloc_bytes,
+        is_compact(it->first) ? "true" : "false");
+    line += buf;
+  }
+  line += "}}\n";
+  write_phase_record(line.c_str());
+}
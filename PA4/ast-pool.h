@@ -0,0 +1,55 @@
+#ifndef AST_POOL_H_
+#define AST_POOL_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  ast-pool.h
+//
+//  Compact storage for the AST.  Every node is bump-allocated from one
+//  contiguous pool instead of from malloc, which saves the allocator's
+//  per-chunk header and rounding and keeps nodes of one class together.
+//  Because the pool is contiguous, a node can be named by its offset
+//  from the start of the pool in 8-byte units.  NodeRef is such a
+//  32-bit reference; the binary operator nodes use it for their
+//  children (see cool-tree.h), which takes them from 40 to 32 bytes.
+//  A reference addresses up to 32GB of nodes.
+//
+//  Nodes are never freed one at a time.  ast_pool_reset() frees every
+//  node allocated since ast_pool_mark() returned the mark at once, so
+//  that a long-running semant-server can drop the ASTs of earlier
+//  requests; a NodeRef or pointer above the mark is then dangling.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+extern char *ast_pool_base;
+
+void *ast_pool_alloc(size_t size);
+void ast_pool_release(void *p, size_t size);
+size_t ast_pool_mark();
+void ast_pool_reset(size_t mark);
+size_t ast_pool_used();
+void ast_pool_report(const char *phase);
+
+// Added to each phylum in cool-tree.handcode.h, so that every node
+// class allocates from the pool.
+#define AST_POOL_ALLOCATED                                            \
+static void *operator new(size_t size) { return ast_pool_alloc(size); } \
+static void operator delete(void *) { }
+
+template <class P> class NodeRef {
+private:
+  unsigned ref;          // offset from ast_pool_base / 8; 0 is NULL
+
+public:
+  NodeRef() : ref(0) { }
+  NodeRef(P p)
+    : ref(p ? (unsigned) (((char *) p - ast_pool_base) >> 3) : 0) { }
+  operator P() const
+    { return ref ? (P) (ast_pool_base + ((size_t) ref << 3)) : (P) NULL; }
+  P operator->() const
+    { return (P) (ast_pool_base + ((size_t) ref << 3)); }
+};
+
+#endif
@@ -0,0 +1,231 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  class-chunks.cc
+//
+//  Implements the splitting of files into class chunks (see
+//  class-chunks.h).  The scanner follows the states of cool.flex that
+//  decide where a token starts: INITIAL, nested comments, line
+//  comments and string constants with their escapes.  It does not
+//  mirror the lexer's error states; a file that has lexical errors
+//  gives an ERROR token in whichever chunk holds the first of them,
+//  and the caller then parses the whole file.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <map>
+#include "class-chunks.h"
+#include "ast-cache.h"
+
+// The keyword and the byte after it decide whether a chunk starts.
+#define KEYWORD_BYTES 6
+
+static bool ident_char(unsigned char c)
+{
+  return isalnum(c) || c == '_';
+}
+
+static int count_lines(const std::string &s, size_t from, size_t to)
+{
+  return (int) std::count(s.begin() + from, s.begin() + to, '\n');
+}
+
+static ClassChunk new_chunk(size_t start, int line)
+{
+  ClassChunk c;
+  c.start = start;
+  c.len = 0;
+  c.line = line;
+  c.key = 0;
+  c.ast_line = 0;
+  c.classes = NULL;
+  c.classes_line = 0;
+  return c;
+}
+
+// Scans s from from, the start of a chunk at line line with the lexer
+// in INITIAL, appending the chunks found to out.  Stops at the end of
+// s, or at a chunk start p >= resync for which at(p) gives the index
+// of an old chunk starting at the same bytes; returns that index, or
+// -1 if the scan reached the end.
+template <class At>
+static long scan(const std::string &s, size_t from, int line, size_t resync,
+                 At at, std::vector<ClassChunk> &out)
+{
+  enum { INITIAL, COMMENT, STRING } state = INITIAL;
+  size_t n = s.size(), i = from;
+  int depth = 0;
+  bool seen_class = false;      // the current chunk has its keyword
+
+  out.push_back(new_chunk(from, line));
+  while (i < n) {
+    unsigned char c = s[i];
+    if (c == '\n')
+      line++;
+    switch (state) {
+    case INITIAL:
+      if (c == '-' && i + 1 < n && s[i + 1] == '-') {
+        while (i < n && s[i] != '\n')
+          i++;
+        continue;
+      }
+      if (c == '(' && i + 1 < n && s[i + 1] == '*') {
+        state = COMMENT;
+        depth = 1;
+        i += 2;
+        continue;
+      }
+      if (c == '"')
+        state = STRING;
+      else if (isdigit(c)) {
+        while (i < n && isdigit((unsigned char) s[i]))
+          i++;
+        continue;
+      } else if (isalpha(c)) {
+        size_t j = i;
+        while (j < n && ident_char(s[j]))
+          j++;
+        if (j - i == 5 && strncasecmp(s.data() + i, "class", 5) == 0) {
+          if (!seen_class)
+            seen_class = true;
+          else {
+            out.back().len = i - out.back().start;
+            long old = i >= resync ? at(i) : -1;
+            if (old >= 0)
+              return old;
+            out.push_back(new_chunk(i, line));
+          }
+        }
+        i = j;
+        continue;
+      }
+      break;
+    case COMMENT:
+      if (c == '(' && i + 1 < n && s[i + 1] == '*') {
+        depth++;
+        i += 2;
+        continue;
+      }
+      if (c == '*' && i + 1 < n && s[i + 1] == ')') {
+        if (--depth == 0)
+          state = INITIAL;
+        i += 2;
+        continue;
+      }
+      break;
+    case STRING:
+      if (c == '\\' && i + 1 < n) {
+        if (s[i + 1] == '\n')
+          line++;
+        i += 2;
+        continue;
+      }
+      if (c == '"' || c == '\n')
+        state = INITIAL;
+      break;
+    }
+    i++;
+  }
+  out.back().len = n - out.back().start;
+  return -1;
+}
+
+// Appends c to out, moved by delta bytes and line_delta lines.  Its
+// ast is taken rather than copied.
+static void move_chunk(ClassChunk &c, long delta, int line_delta,
+                       std::vector<ClassChunk> &out)
+{
+  out.push_back(new_chunk(c.start + delta, c.line + line_delta));
+  ClassChunk &m = out.back();
+  m.len = c.len;
+  m.key = c.key;
+  m.ast.swap(c.ast);
+  m.symbols.swap(c.symbols);
+  m.ast_line = c.ast_line;
+  m.classes = c.classes;
+  m.classes_line = c.classes_line;
+}
+
+// Finds the old chunk that starts at p - delta, if p is a resync point.
+struct OldStart {
+  const std::vector<ClassChunk> *old;
+  long delta;
+
+  long operator()(size_t p) const
+  {
+    size_t q = p - delta;
+    size_t lo = 0, hi = old->size();
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if ((*old)[mid].start < q)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo < old->size() && (*old)[lo].start == q ? (long) lo : -1;
+  }
+};
+
+int update_chunks(std::vector<ClassChunk> &chunks,
+                  const std::string &old_source, const std::string &source)
+{
+  std::vector<ClassChunk> old;
+  old.swap(chunks);
+  size_t n_old = old.empty() ? 0 : old_source.size(), n = source.size();
+
+  // The bytes the edit left alone at either end.
+  size_t prefix = 0, suffix = 0, m = std::min(n_old, n);
+  while (prefix < m && old_source[prefix] == source[prefix])
+    prefix++;
+  while (suffix < m - prefix &&
+         old_source[n_old - 1 - suffix] == source[n - 1 - suffix])
+    suffix++;
+  if (!old.empty() && prefix == n && n == n_old) {
+    chunks.swap(old);
+    return 0;
+  }
+
+  // Keep the chunks that end, keyword of the next included, before it.
+  chunks.reserve(old.size() + 16);
+  size_t kept = 0;
+  while (kept + 1 < old.size() && old[kept + 1].start + KEYWORD_BYTES <= prefix)
+    move_chunk(old[kept++], 0, 0, chunks);
+  size_t from = kept ? old[kept].start : 0;
+  int line = kept ? old[kept].line : 1;
+  size_t first_new = chunks.size();
+
+  long delta = (long) n - (long) n_old;
+  int line_delta = count_lines(source, prefix, n - suffix) -
+                   count_lines(old_source, prefix, n_old - suffix);
+  OldStart at = { &old, delta };
+  long resumed = scan(source, from, line, n - suffix + 1, at, chunks);
+  int scanned = chunks.size() - first_new;
+
+  // Rescanned chunks with unchanged bytes keep their parse.
+  size_t old_end = resumed >= 0 ? resumed : old.size();
+  std::map<unsigned long, size_t> by_key;
+  for (size_t k = kept; k < old_end; k++)
+    if (!old[k].ast.empty())
+      by_key[old[k].key] = k;
+  for (size_t k = first_new; k < chunks.size(); k++) {
+    ClassChunk &c = chunks[k];
+    c.key = content_hash(source.data() + c.start, c.len, 0);
+    std::map<unsigned long, size_t>::iterator it = by_key.find(c.key);
+    if (it != by_key.end() && old[it->second].len == c.len) {
+      ClassChunk &o = old[it->second];
+      c.ast.swap(o.ast);
+      c.symbols.swap(o.symbols);
+      c.ast_line = o.ast_line;
+      c.classes = o.classes;
+      c.classes_line = o.classes_line;
+      by_key.erase(it);
+    }
+  }
+
+  for (size_t k = old_end; k < old.size(); k++)
+    move_chunk(old[k], delta, line_delta, chunks);
+  return scanned;
+}
@@ -0,0 +1,52 @@
+#ifndef CLASS_CHUNKS_H_
+#define CLASS_CHUNKS_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  class-chunks.h
+//
+//  Splits a Cool source file into chunks of one class each, so that
+//  after an edit only the classes it touched are lexed and parsed
+//  again (see semant-server.cc).
+//
+//  A chunk starts at a "class" keyword, as the lexer (cool.flex) would
+//  see it: outside comments and strings, and not part of a longer
+//  word.  The first chunk also holds whatever comes before the first
+//  class.  Every class of the grammar starts with CLASS and has no
+//  other, so a file that parses is the concatenation of its chunks'
+//  parses, and a chunk can be lexed on its own starting in INITIAL.
+//
+//  update_chunks() finds the chunks of a new version of a file from
+//  those of the old one.  The chunks wholly before the first changed
+//  byte are kept; the scan starts again at the last of their
+//  boundaries and stops at the first boundary past the last changed
+//  byte that was also a boundary before the edit, since from there
+//  the scanner is in the same state over the same bytes.  The chunks
+//  after it are kept, moved by the change in size and in lines.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string>
+#include <vector>
+#include "cool-tree.h"
+
+struct ClassChunk {
+  size_t start;             // offset of its first byte in the file
+  size_t len;
+  int line;                 // line of its first byte
+  unsigned long key;        // content_hash() of its bytes
+  std::string ast;          // its class as AstWriter wrote it, or empty
+  int ast_line;             // its line when ast was written
+  std::vector<Symbol> symbols;      // the symbols of ast, once read
+  Classes classes;          // ast read back for line, or NULL
+  int classes_line;         // its line when classes was read
+};
+
+// Replaces chunks, the chunks of old_source (empty the first time),
+// with those of source.  A chunk that was scanned again keeps the ast
+// of an old chunk with the same bytes, if there was one.  Returns the
+// number of chunks scanned.
+int update_chunks(std::vector<ClassChunk> &chunks,
+                  const std::string &old_source, const std::string &source);
+
+#endif
@@ -10,6 +10,7 @@
 #include "tree.h"
 #include "cool-tree.handcode.h"
 #include "cool-tree.h"
+#include "hashcons.h"
 
 
 // constructors' functions
@@ -104,7 +105,7 @@ void branch_class::dump(ostream& stream, int n)
 
 Expression assign_class::copy_Expression()
 {
-   return new assign_class(copy_Symbol(name), expr->copy_Expression());
+   return copy_extras(new assign_class(copy_Symbol(name), expr->copy_Expression()));
 }
 
 
@@ -118,7 +119,7 @@ void assign_class::dump(ostream& stream, int n)
 
 Expression static_dispatch_class::copy_Expression()
 {
-   return new static_dispatch_class(expr->copy_Expression(), copy_Symbol(type_name), copy_Symbol(name), actual->copy_list());
+   return copy_extras(new static_dispatch_class(expr->copy_Expression(), copy_Symbol(type_name), copy_Symbol(name), actual->copy_list()));
 }
 
 
@@ -134,7 +135,10 @@ void static_dispatch_class::dump(ostream& stream, int n)
 
 Expression dispatch_class::copy_Expression()
 {
-   return new dispatch_class(expr->copy_Expression(), copy_Symbol(name), actual->copy_list());
+   dispatch_class *copy = new dispatch_class(expr->copy_Expression(), copy_Symbol(name), actual->copy_list());
+   copy->target_class = target_class;
+   copy->local_receiver = local_receiver;
+   return copy_extras(copy);
 }
 
 
@@ -149,7 +153,7 @@ void dispatch_class::dump(ostream& stream, int n)
 
 Expression cond_class::copy_Expression()
 {
-   return new cond_class(pred->copy_Expression(), then_exp->copy_Expression(), else_exp->copy_Expression());
+   return copy_extras(new cond_class(pred->copy_Expression(), then_exp->copy_Expression(), else_exp->copy_Expression()));
 }
 
 
@@ -164,7 +168,7 @@ void cond_class::dump(ostream& stream, int n)
 
 Expression loop_class::copy_Expression()
 {
-   return new loop_class(pred->copy_Expression(), body->copy_Expression());
+   return copy_extras(new loop_class(pred->copy_Expression(), body->copy_Expression()));
 }
 
 
@@ -178,7 +182,7 @@ void loop_class::dump(ostream& stream, int n)
 
 Expression typcase_class::copy_Expression()
 {
-   return new typcase_class(expr->copy_Expression(), cases->copy_list());
+   return copy_extras(new typcase_class(expr->copy_Expression(), cases->copy_list()));
 }
 
 
@@ -192,7 +196,7 @@ void typcase_class::dump(ostream& stream, int n)
 
 Expression block_class::copy_Expression()
 {
-   return new block_class(body->copy_list());
+   return copy_extras(new block_class(body->copy_list()));
 }
 
 
@@ -205,7 +209,9 @@ void block_class::dump(ostream& stream, int n)
 
 Expression let_class::copy_Expression()
 {
-   return new let_class(copy_Symbol(identifier), copy_Symbol(type_decl), init->copy_Expression(), body->copy_Expression());
+   let_class *copy = new let_class(copy_Symbol(identifier), copy_Symbol(type_decl), init->copy_Expression(), body->copy_Expression());
+   copy->local_init = local_init;
+   return copy_extras(copy);
 }
 
 
@@ -221,7 +227,7 @@ void let_class::dump(ostream& stream, int n)
 
 Expression plus_class::copy_Expression()
 {
-   return new plus_class(e1->copy_Expression(), e2->copy_Expression());
+   return copy_extras(new plus_class(e1->copy_Expression(), e2->copy_Expression()));
 }
 
 
@@ -235,7 +241,7 @@ void plus_class::dump(ostream& stream, int n)
 
 Expression sub_class::copy_Expression()
 {
-   return new sub_class(e1->copy_Expression(), e2->copy_Expression());
+   return copy_extras(new sub_class(e1->copy_Expression(), e2->copy_Expression()));
 }
 
 
@@ -249,7 +255,7 @@ void sub_class::dump(ostream& stream, int n)
 
 Expression mul_class::copy_Expression()
 {
-   return new mul_class(e1->copy_Expression(), e2->copy_Expression());
+   return copy_extras(new mul_class(e1->copy_Expression(), e2->copy_Expression()));
 }
 
 
@@ -263,7 +269,7 @@ void mul_class::dump(ostream& stream, int n)
 
 Expression divide_class::copy_Expression()
 {
-   return new divide_class(e1->copy_Expression(), e2->copy_Expression());
+   return copy_extras(new divide_class(e1->copy_Expression(), e2->copy_Expression()));
 }
 
 
@@ -277,7 +283,7 @@ void divide_class::dump(ostream& stream, int n)
 
 Expression neg_class::copy_Expression()
 {
-   return new neg_class(e1->copy_Expression());
+   return copy_extras(new neg_class(e1->copy_Expression()));
 }
 
 
@@ -290,7 +296,7 @@ void neg_class::dump(ostream& stream, int n)
 
 Expression lt_class::copy_Expression()
 {
-   return new lt_class(e1->copy_Expression(), e2->copy_Expression());
+   return copy_extras(new lt_class(e1->copy_Expression(), e2->copy_Expression()));
 }
 
 
@@ -304,7 +310,7 @@ void lt_class::dump(ostream& stream, int n)
 
 Expression eq_class::copy_Expression()
 {
-   return new eq_class(e1->copy_Expression(), e2->copy_Expression());
+   return copy_extras(new eq_class(e1->copy_Expression(), e2->copy_Expression()));
 }
 
 
@@ -318,7 +324,7 @@ void eq_class::dump(ostream& stream, int n)
 
 Expression leq_class::copy_Expression()
 {
-   return new leq_class(e1->copy_Expression(), e2->copy_Expression());
+   return copy_extras(new leq_class(e1->copy_Expression(), e2->copy_Expression()));
 }
 
 
@@ -332,7 +338,7 @@ void leq_class::dump(ostream& stream, int n)
 
 Expression comp_class::copy_Expression()
 {
-   return new comp_class(e1->copy_Expression());
+   return copy_extras(new comp_class(e1->copy_Expression()));
 }
 
 
@@ -345,7 +351,7 @@ void comp_class::dump(ostream& stream, int n)
 
 Expression int_const_class::copy_Expression()
 {
-   return new int_const_class(copy_Symbol(token));
+   return copy_extras(new int_const_class(copy_Symbol(token)));
 }
 
 
@@ -358,7 +364,7 @@ void int_const_class::dump(ostream& stream, int n)
 
 Expression bool_const_class::copy_Expression()
 {
-   return new bool_const_class(copy_Boolean(val));
+   return copy_extras(new bool_const_class(copy_Boolean(val)));
 }
 
 
@@ -371,7 +377,7 @@ void bool_const_class::dump(ostream& stream, int n)
 
 Expression string_const_class::copy_Expression()
 {
-   return new string_const_class(copy_Symbol(token));
+   return copy_extras(new string_const_class(copy_Symbol(token)));
 }
 
 
@@ -384,7 +390,7 @@ void string_const_class::dump(ostream& stream, int n)
 
 Expression new__class::copy_Expression()
 {
-   return new new__class(copy_Symbol(type_name));
+   return copy_extras(new new__class(copy_Symbol(type_name)));
 }
 
 
@@ -397,7 +403,7 @@ void new__class::dump(ostream& stream, int n)
 
 Expression isvoid_class::copy_Expression()
 {
-   return new isvoid_class(e1->copy_Expression());
+   return copy_extras(new isvoid_class(e1->copy_Expression()));
 }
 
 
@@ -410,7 +416,7 @@ void isvoid_class::dump(ostream& stream, int n)
 
 Expression no_expr_class::copy_Expression()
 {
-   return new no_expr_class();
+   return copy_extras(new no_expr_class());
 }
 
 
@@ -422,7 +428,7 @@ void no_expr_class::dump(ostream& stream, int n)
 
 Expression object_class::copy_Expression()
 {
-   return new object_class(copy_Symbol(name));
+   return copy_extras(new object_class(copy_Symbol(name)));
 }
 
 
@@ -541,121 +547,121 @@ Case branch(Symbol name, Symbol type_decl, Expression expr)
 
 Expression assign(Symbol name, Expression expr)
 {
-  return new assign_class(name, expr);
+  return hashcons(new assign_class(name, expr));
 }
 
 Expression static_dispatch(Expression expr, Symbol type_name, Symbol name, Expressions actual)
 {
-  return new static_dispatch_class(expr, type_name, name, actual);
+  return hashcons(new static_dispatch_class(expr, type_name, name, actual));
 }
 
 Expression dispatch(Expression expr, Symbol name, Expressions actual)
 {
-  return new dispatch_class(expr, name, actual);
+  return hashcons(new dispatch_class(expr, name, actual));
 }
 
 Expression cond(Expression pred, Expression then_exp, Expression else_exp)
 {
-  return new cond_class(pred, then_exp, else_exp);
+  return hashcons(new cond_class(pred, then_exp, else_exp));
 }
 
 Expression loop(Expression pred, Expression body)
 {
-  return new loop_class(pred, body);
+  return hashcons(new loop_class(pred, body));
 }
 
 Expression typcase(Expression expr, Cases cases)
 {
-  return new typcase_class(expr, cases);
+  return hashcons(new typcase_class(expr, cases));
 }
 
 Expression block(Expressions body)
 {
-  return new block_class(body);
+  return hashcons(new block_class(body));
 }
 
 Expression let(Symbol identifier, Symbol type_decl, Expression init, Expression body)
 {
-  return new let_class(identifier, type_decl, init, body);
+  return hashcons(new let_class(identifier, type_decl, init, body));
 }
 
 Expression plus(Expression e1, Expression e2)
 {
-  return new plus_class(e1, e2);
+  return hashcons(new plus_class(e1, e2));
 }
 
 Expression sub(Expression e1, Expression e2)
 {
-  return new sub_class(e1, e2);
+  return hashcons(new sub_class(e1, e2));
 }
 
 Expression mul(Expression e1, Expression e2)
 {
-  return new mul_class(e1, e2);
+  return hashcons(new mul_class(e1, e2));
 }
 
 Expression divide(Expression e1, Expression e2)
 {
-  return new divide_class(e1, e2);
+  return hashcons(new divide_class(e1, e2));
 }
 
 Expression neg(Expression e1)
 {
-  return new neg_class(e1);
+  return hashcons(new neg_class(e1));
 }
 
 Expression lt(Expression e1, Expression e2)
 {
-  return new lt_class(e1, e2);
+  return hashcons(new lt_class(e1, e2));
 }
 
 Expression eq(Expression e1, Expression e2)
 {
-  return new eq_class(e1, e2);
+  return hashcons(new eq_class(e1, e2));
 }
 
 Expression leq(Expression e1, Expression e2)
 {
-  return new leq_class(e1, e2);
+  return hashcons(new leq_class(e1, e2));
 }
 
 Expression comp(Expression e1)
 {
-  return new comp_class(e1);
+  return hashcons(new comp_class(e1));
 }
 
 Expression int_const(Symbol token)
 {
-  return new int_const_class(token);
+  return hashcons(new int_const_class(token));
 }
 
 Expression bool_const(Boolean val)
 {
-  return new bool_const_class(val);
+  return hashcons(new bool_const_class(val));
 }
 
 Expression string_const(Symbol token)
 {
-  return new string_const_class(token);
+  return hashcons(new string_const_class(token));
 }
 
 Expression new_(Symbol type_name)
 {
-  return new new__class(type_name);
+  return hashcons(new new__class(type_name));
 }
 
 Expression isvoid(Expression e1)
 {
-  return new isvoid_class(e1);
+  return hashcons(new isvoid_class(e1));
 }
 
 Expression no_expr()
 {
-  return new no_expr_class();
+  return hashcons(new no_expr_class());
 }
 
 Expression object(Symbol name)
 {
-  return new object_class(name);
+  return hashcons(new object_class(name));
 }
 
@@ -326,6 +326,8 @@ public:
       expr = a1;
       name = a2;
       actual = a3;
+      target_class = NULL;
+      local_receiver = false;
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
@@ -440,6 +442,7 @@ public:
       type_decl = a2;
       init = a3;
       body = a4;
+      local_init = false;
    }
    Expression copy_Expression();
    void dump(ostream& stream, int n);
@@ -456,8 +459,8 @@ public:
 // define constructor - plus
 class plus_class : public Expression_class {
 protected:
-   Expression e1;
-   Expression e2;
+   NodeRef<Expression> e1;
+   NodeRef<Expression> e2;
 public:
    plus_class(Expression a1, Expression a2) {
       e1 = a1;
@@ -478,8 +481,8 @@ public:
 // define constructor - sub
 class sub_class : public Expression_class {
 protected:
-   Expression e1;
-   Expression e2;
+   NodeRef<Expression> e1;
+   NodeRef<Expression> e2;
 public:
    sub_class(Expression a1, Expression a2) {
       e1 = a1;
@@ -500,8 +503,8 @@ public:
 // define constructor - mul
 class mul_class : public Expression_class {
 protected:
-   Expression e1;
-   Expression e2;
+   NodeRef<Expression> e1;
+   NodeRef<Expression> e2;
 public:
    mul_class(Expression a1, Expression a2) {
       e1 = a1;
@@ -522,8 +525,8 @@ public:
 // define constructor - divide
 class divide_class : public Expression_class {
 protected:
-   Expression e1;
-   Expression e2;
+   NodeRef<Expression> e1;
+   NodeRef<Expression> e2;
 public:
    divide_class(Expression a1, Expression a2) {
       e1 = a1;
@@ -564,8 +567,8 @@ public:
 // define constructor - lt
 class lt_class : public Expression_class {
 protected:
-   Expression e1;
-   Expression e2;
+   NodeRef<Expression> e1;
+   NodeRef<Expression> e2;
 public:
    lt_class(Expression a1, Expression a2) {
       e1 = a1;
@@ -586,8 +589,8 @@ public:
 // define constructor - eq
 class eq_class : public Expression_class {
 protected:
-   Expression e1;
-   Expression e2;
+   NodeRef<Expression> e1;
+   NodeRef<Expression> e2;
 public:
    eq_class(Expression a1, Expression a2) {
       e1 = a1;
@@ -608,8 +611,8 @@ public:
 // define constructor - leq
 class leq_class : public Expression_class {
 protected:
-   Expression e1;
-   Expression e2;
+   NodeRef<Expression> e1;
+   NodeRef<Expression> e2;
 public:
    leq_class(Expression a1, Expression a2) {
       e1 = a1;
@@ -8,6 +8,8 @@
 #include "tree.h"
 #include "cool.h"
 #include "stringtab.h"
+#include "ast-pool.h"
+#include "span-table.h"
 #define yylineno curr_lineno;
 extern int yylineno;
 
@@ -44,62 +46,196 @@ typedef Expressions_class *Expressions;
 typedef list_node<Case> Cases_class;
 typedef Cases_class *Cases;
 
+class TypeEnv;
+class NodeKey;
+class ClassTable;
+class Compiler;
+class Optimizer;
+class Renaming;
+class Escape;
+class AstWriter;
+
+#define SPAN_EXTRAS                             \
+SpanRef span = node_span_ref();                 \
+SpanRef get_span() { return span; }
+
 #define Program_EXTRAS                          \
+AST_POOL_ALLOCATED           \
+SPAN_EXTRAS                                     \
 virtual void semant() = 0;			\
+virtual int check(ostream&) = 0;                \
+virtual Classes get_classes() = 0;              \
+virtual ClassTable *get_classtable() = 0;       \
 virtual void dump_with_types(ostream&, int) = 0; 
 
 
 
 #define program_EXTRAS                          \
+ClassTable *classtable = NULL;                  \
+ClassTable *get_classtable() { return classtable; } \
 void semant();     				\
+int check(ostream&);                            \
+Classes get_classes() { return classes; }       \
 void dump_with_types(ostream&, int);            
 
 #define Class__EXTRAS                   \
+AST_POOL_ALLOCATED                      \
+SPAN_EXTRAS                             \
+virtual Symbol get_name() = 0;          \
+virtual Symbol get_parent() = 0;        \
+virtual Features get_features() = 0;    \
 virtual Symbol get_filename() = 0;      \
+virtual void save(AstWriter&) = 0;      \
 virtual void dump_with_types(ostream&,int) = 0; 
 
 
 #define class__EXTRAS                                 \
+Symbol get_name() { return name; }                     \
+Symbol get_parent() { return parent; }                 \
+Features get_features() { return features; }           \
 Symbol get_filename() { return filename; }             \
+void save(AstWriter&);                                 \
 void dump_with_types(ostream&,int);                    
 
 
 #define Feature_EXTRAS                                        \
+AST_POOL_ALLOCATED                                            \
+SPAN_EXTRAS                                                   \
+virtual Symbol get_name() = 0;                                \
+virtual bool is_method() = 0;                                 \
+virtual void check(TypeEnv&) = 0;                             \
+virtual void optimize(Optimizer&) = 0;                        \
+virtual void save(AstWriter&) = 0;                            \
 virtual void dump_with_types(ostream&,int) = 0; 
 
 
 #define Feature_SHARED_EXTRAS                                       \
+void check(TypeEnv&);                                               \
+void optimize(Optimizer&);                                          \
+void save(AstWriter&);                                              \
 void dump_with_types(ostream&,int);    
 
 
+#define method_EXTRAS                                   \
+Symbol get_name() { return name; }                      \
+bool is_method() { return true; }                       \
+Formals get_formals() { return formals; }               \
+Symbol get_return_type() { return return_type; }        \
+Expression get_expr() { return expr; }
+
 
+#define attr_EXTRAS                                     \
+Symbol get_name() { return name; }                      \
+bool is_method() { return false; }                      \
+Symbol get_type_decl() { return type_decl; }            \
+Expression get_init() { return init; }
 
 
 #define Formal_EXTRAS                              \
+AST_POOL_ALLOCATED                                 \
+SPAN_EXTRAS                                        \
+virtual Symbol get_name() = 0;                     \
+virtual Symbol get_type_decl() = 0;                \
+virtual void save(AstWriter&) = 0;                 \
 virtual void dump_with_types(ostream&,int) = 0;
 
 
 #define formal_EXTRAS                           \
+Symbol get_name() { return name; }              \
+Symbol get_type_decl() { return type_decl; }    \
+void save(AstWriter&);                          \
 void dump_with_types(ostream&,int);
 
 
 #define Case_EXTRAS                             \
+AST_POOL_ALLOCATED                              \
+SPAN_EXTRAS                                     \
+virtual Symbol get_type_decl() = 0;             \
+virtual Symbol check(TypeEnv&) = 0;             \
+virtual void optimize(Optimizer&) = 0;          \
+virtual void rename(Renaming&) = 0;             \
+virtual bool leaks(Symbol, Escape&, bool) = 0;  \
+virtual void save(AstWriter&) = 0;              \
 virtual void dump_with_types(ostream& ,int) = 0;
 
 
 #define branch_EXTRAS                                   \
+Symbol get_type_decl() { return type_decl; }            \
+Symbol get_name() { return name; }                      \
+Expression get_expr() { return expr; }                  \
+Symbol check(TypeEnv&);                                 \
+void optimize(Optimizer&);                              \
+void rename(Renaming&);                                 \
+bool leaks(Symbol, Escape&, bool);                      \
+void save(AstWriter&);                                  \
 void dump_with_types(ostream& ,int);
 
 
 #define Expression_EXTRAS                    \
+AST_POOL_ALLOCATED                           \
+unsigned hc_flags : 8;                       \
+SpanRef span : SPAN_REF_BITS;                \
 Symbol type;                                 \
 Symbol get_type() { return type; }           \
+SpanRef get_span() { return span; }          \
 Expression set_type(Symbol s) { type = s; return this; } \
+Symbol check(TypeEnv&);                      \
+virtual Symbol check_node(TypeEnv&) = 0;     \
+virtual bool key(NodeKey&) = 0;              \
+virtual void compile(Compiler&) = 0;         \
+virtual Expression optimize(Optimizer&) = 0; \
+virtual bool pure() = 0;                     \
+virtual void rename(Renaming&) = 0;          \
+virtual bool leaks(Symbol, Escape&, bool) = 0; \
+virtual void save(AstWriter&) = 0;           \
+virtual bool is_no_expr() { return false; }  \
+virtual bool is_self() { return false; }     \
+virtual bool is_var(Symbol) { return false; } \
+virtual bool is_new(Symbol&) { return false; } \
+virtual bool is_int_const(int&) { return false; }   \
+virtual bool is_bool_const(bool&) { return false; } \
 virtual void dump_with_types(ostream&,int) = 0;  \
 void dump_type(ostream&, int);               \
-Expression_class() { type = (Symbol) NULL; }
+Expression copy_extras(Expression copy)      \
+  { copy->set(this); copy->span = span; copy->type = type; return copy; } \
+Expression_class() { hc_flags = 0; span = node_span_ref(); type = (Symbol) NULL; }
 
 #define Expression_SHARED_EXTRAS           \
+Symbol check_node(TypeEnv&);               \
+bool key(NodeKey&);                        \
+void compile(Compiler&);                   \
+Expression optimize(Optimizer&);           \
+bool pure();                               \
+void rename(Renaming&);                    \
+bool leaks(Symbol, Escape&, bool);         \
+void save(AstWriter&);                     \
 void dump_with_types(ostream&,int); 
 
+#define no_expr_EXTRAS                     \
+bool is_no_expr() { return true; }
+
+#define dispatch_EXTRAS                                 \
+Symbol target_class;       /* bound by -O, see optimize.h */ \
+bool local_receiver;       /* new receiver that does not escape */ \
+Symbol get_target_class() { return target_class; }
+
+#define let_EXTRAS                                      \
+bool local_init;           /* new init that does not escape */
+
+#define new__EXTRAS                                     \
+bool is_new(Symbol &t) { t = type_name; return true; }
+
+#define object_EXTRAS                      \
+bool is_self();                            \
+bool is_var(Symbol v) { return name == v; }
+
+#define int_const_EXTRAS                   \
+bool is_int_const(int&);
+
+#define neg_EXTRAS                         \
+bool is_int_const(int&);
+
+#define bool_const_EXTRAS                  \
+bool is_bool_const(bool &b) { b = val; return true; }
+
 #endif
@@ -0,0 +1,120 @@
+(*
+ *  Dispatch sites for the inline caches of interp, which hold four
+ *  receiver classes: one site sees a single class, one sees three and
+ *  one sees six and becomes megamorphic.  Every class redefines the
+ *  methods, so -O cannot devirtualize these sites; it does devirtualize
+ *  the calls of describe, which no subclass redefines.  The Point in
+ *  the loop of norms does not escape, so under -O it is allocated on
+ *  the local stack.  Run with make interp-test; the output must be the
+ *  same with and without -O.
+ *)
+
+class Shape {
+  name() : String { "shape" };
+  sides() : Int { 0 };
+  describe() : String { name().concat(" has ").concat(digit(sides())) };
+  digit(i : Int) : String { "0123456789".substr(i, 1) };
+};
+
+class Triangle inherits Shape {
+  name() : String { "triangle" };
+  sides() : Int { 3 };
+};
+
+class Square inherits Shape {
+  name() : String { "square" };
+  sides() : Int { 4 };
+};
+
+class Pentagon inherits Shape {
+  name() : String { "pentagon" };
+  sides() : Int { 5 };
+};
+
+class Hexagon inherits Shape {
+  name() : String { "hexagon" };
+  sides() : Int { 6 };
+};
+
+class Heptagon inherits Shape {
+  name() : String { "heptagon" };
+  sides() : Int { 7 };
+};
+
+class Point {
+  x : Int;
+  y : Int;
+
+  init(a : Int, b : Int) : Point {{ x <- a; y <- b; self; }};
+  norm() : Int { x * x + y * y };
+};
+
+class Main inherits IO {
+  shapes : Int <- 6;
+
+  shape(i : Int) : Shape {
+    if i = 0 then new Triangle else
+    if i = 1 then new Square else
+    if i = 2 then new Pentagon else
+    if i = 3 then new Hexagon else
+    if i = 4 then new Heptagon else
+    new Shape fi fi fi fi fi
+  };
+
+  -- Each of these calls sides() on k shapes from a site of its own,
+  -- the i-th shape of class i mod 1, 3 or 6.
+  one_class(k : Int) : Int {
+    let i : Int <- 0, sum : Int <- 0 in {
+      while i < k loop {
+        sum <- sum + shape(0).sides();
+        i <- i + 1;
+      } pool;
+      sum;
+    }
+  };
+
+  three_classes(k : Int) : Int {
+    let i : Int <- 0, sum : Int <- 0 in {
+      while i < k loop {
+        sum <- sum + shape(i - i / 3 * 3).sides();
+        i <- i + 1;
+      } pool;
+      sum;
+    }
+  };
+
+  six_classes(k : Int) : Int {
+    let i : Int <- 0, sum : Int <- 0 in {
+      while i < k loop {
+        sum <- sum + shape(i - i / shapes * shapes).sides();
+        i <- i + 1;
+      } pool;
+      sum;
+    }
+  };
+
+  norms(k : Int) : Int {
+    let i : Int <- 0, sum : Int <- 0 in {
+      while i < k loop {
+        let p : Point <- new Point in {
+          p.init(i, i + 1);
+          sum <- sum + p.norm();
+        };
+        i <- i + 1;
+      } pool;
+      sum;
+    }
+  };
+
+  main() : Object {{
+    out_int(one_class(100)).out_string("\n");
+    out_int(three_classes(99)).out_string("\n");
+    out_int(six_classes(600)).out_string("\n");
+    let i : Int <- 0 in
+      while i < shapes loop {
+        out_string(shape(i).describe()).out_string("\n");
+        i <- i + 1;
+      } pool;
+    out_int(norms(1000)).out_string("\n");
+  }};
+};
@@ -0,0 +1,217 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  escape.cc
+//
+//  Escape analysis for -O (see optimize.h).  new T does not escape in
+//
+//      let x : S <- new T in body         (local_init)
+//      (new T).f(...)                     (local_receiver)
+//
+//  when T is not SELF_TYPE, Int, Bool or String, T's attribute
+//  initializers do not leak self, and body does not leak x or f does
+//  not leak self.  An expression leaks a variable when it assigns it,
+//  passes it as an argument, binds it with a let or case, or has it as
+//  its value where that value is used.  isvoid and = only look at the
+//  pointer, and a dispatch on the variable leaks it when the method it
+//  calls leaks self.  The object's class is known exactly, so that
+//  method is the one T has, not one of the overriding ones.
+//
+//  What a method does with self is summarized once per class and
+//  method, for the cases where the dispatch's value is used and not.
+//  A method is taken to leak self while its own summary is being made,
+//  so recursive methods leak.  Native methods never store self; the
+//  ones that return SELF_TYPE other than copy return it.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "optimize.h"
+
+#define LEAK_UNKNOWN   0
+#define LEAK_NO        1
+#define LEAK_YES       2
+
+static Symbol SELF_TYPE_sym, Int_sym, Bool_sym, Str_sym, Object_sym, self_sym, copy_sym;
+
+static void init_symbols()
+{
+  if (self_sym)
+    return;
+  SELF_TYPE_sym = idtable.add_string("SELF_TYPE");
+  Int_sym       = idtable.add_string("Int");
+  Bool_sym      = idtable.add_string("Bool");
+  Str_sym       = idtable.add_string("String");
+  Object_sym    = idtable.add_string("Object");
+  self_sym      = idtable.add_string("self");
+  copy_sym      = idtable.add_string("copy");
+}
+
+//
+// The class of the object that init creates, if it is a new that could
+// be allocated on a stack, or NULL.
+//
+Symbol Optimizer::local_class(Expression init)
+{
+  init_symbols();
+  Symbol t;
+  if (!init->is_new(t) || t == SELF_TYPE_sym ||
+      t == Int_sym || t == Bool_sym || t == Str_sym)
+    return NULL;
+  return t;
+}
+
+// Whether the attribute initializers of cls, its own and inherited
+// ones, leak self.
+bool Optimizer::init_leaks(Symbol cls)
+{
+  init_symbols();
+  int &state = init_summaries[cls];
+  if (state != LEAK_UNKNOWN)
+    return state == LEAK_YES;
+  state = LEAK_YES;
+  Escape e(*this, cls);
+  for (Symbol c = cls; ; c = classtable->parent_of(c)) {
+    Features fs = classtable->lookup_class(c)->get_features();
+    for (int i = fs->first(); fs->more(i); i = fs->next(i)) {
+      Feature f = fs->nth(i);
+      if (!f->is_method() && ((attr_class *) f)->get_init()->leaks(self_sym, e, true))
+	return true;
+    }
+    if (c == Object_sym)
+      break;
+  }
+  state = LEAK_NO;
+  return false;
+}
+
+// Whether method m, called on an object of class cls, leaks self.
+bool Optimizer::method_leaks(Symbol cls, method_class *m, bool used)
+{
+  init_symbols();
+  Expression body = m->get_expr();
+  if (body->is_no_expr())
+    return used && m->get_return_type() == SELF_TYPE_sym && m->get_name() != copy_sym;
+  int &state = method_summaries[used][std::make_pair(cls, m)];
+  if (state == LEAK_UNKNOWN) {
+    state = LEAK_YES;
+    Escape e(*this, cls);
+    state = body->leaks(self_sym, e, used) ? LEAK_YES : LEAK_NO;
+  }
+  return state == LEAK_YES;
+}
+
+bool Escape::call_leaks(Symbol type, Symbol name, bool used)
+{
+  return opt.method_leaks(cls, opt.classtable->lookup_method(type, name), used);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// leaks(var, e, used) for each kind of node
+//
+//////////////////////////////////////////////////////////////////////
+
+static bool list_leaks(Expressions l, Symbol var, Escape &e)
+{
+  for (int i = l->first(); l->more(i); i = l->next(i))
+    if (l->nth(i)->leaks(var, e, true))
+      return true;
+  return false;
+}
+
+bool assign_class::leaks(Symbol var, Escape &e, bool used)
+{
+  return expr->leaks(var, e, true);
+}
+
+bool static_dispatch_class::leaks(Symbol var, Escape &e, bool used)
+{
+  if (list_leaks(actual, var, e))
+    return true;
+  if (expr->is_var(var))
+    return e.call_leaks(type_name, name, used);
+  return expr->leaks(var, e, true);
+}
+
+bool dispatch_class::leaks(Symbol var, Escape &e, bool used)
+{
+  if (list_leaks(actual, var, e))
+    return true;
+  if (expr->is_var(var))
+    return e.call_leaks(e.cls, name, used);
+  return expr->leaks(var, e, true);
+}
+
+bool cond_class::leaks(Symbol var, Escape &e, bool used)
+{
+  return pred->leaks(var, e, false) || then_exp->leaks(var, e, used) ||
+         else_exp->leaks(var, e, used);
+}
+
+bool loop_class::leaks(Symbol var, Escape &e, bool used)
+{
+  return pred->leaks(var, e, false) || body->leaks(var, e, false);
+}
+
+bool typcase_class::leaks(Symbol var, Escape &e, bool used)
+{
+  if (expr->leaks(var, e, true))
+    return true;
+  for (int i = cases->first(); cases->more(i); i = cases->next(i))
+    if (cases->nth(i)->leaks(var, e, used))
+      return true;
+  return false;
+}
+
+bool branch_class::leaks(Symbol var, Escape &e, bool used)
+{
+  return name != var && expr->leaks(var, e, used);
+}
+
+bool block_class::leaks(Symbol var, Escape &e, bool used)
+{
+  int n = body->len();
+  for (int i = body->first(); body->more(i); i = body->next(i))
+    if (body->nth(i)->leaks(var, e, i == n - 1 && used))
+      return true;
+  return false;
+}
+
+bool let_class::leaks(Symbol var, Escape &e, bool used)
+{
+  return init->leaks(var, e, true) ||
+         (identifier != var && body->leaks(var, e, used));
+}
+
+bool plus_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, true) || e2->leaks(var, e, true); }
+bool sub_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, true) || e2->leaks(var, e, true); }
+bool mul_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, true) || e2->leaks(var, e, true); }
+bool divide_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, true) || e2->leaks(var, e, true); }
+bool lt_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, true) || e2->leaks(var, e, true); }
+bool leq_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, true) || e2->leaks(var, e, true); }
+bool neg_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, true); }
+bool comp_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, true); }
+
+// Comparing objects and testing them for void do not keep them.
+bool eq_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, false) || e2->leaks(var, e, false); }
+bool isvoid_class::leaks(Symbol var, Escape &e, bool used)
+{ return e1->leaks(var, e, false); }
+
+bool int_const_class::leaks(Symbol var, Escape &e, bool used)    { return false; }
+bool bool_const_class::leaks(Symbol var, Escape &e, bool used)   { return false; }
+bool string_const_class::leaks(Symbol var, Escape &e, bool used) { return false; }
+bool new__class::leaks(Symbol var, Escape &e, bool used)         { return false; }
+bool no_expr_class::leaks(Symbol var, Escape &e, bool used)      { return false; }
+
+bool object_class::leaks(Symbol var, Escape &e, bool used)
+{
+  return used && name == var;
+}
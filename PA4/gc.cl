@@ -0,0 +1,113 @@
+(*
+ *  Work for the collector of interp -g.  Reads a size n: a list of n
+ *  nodes outlives many minor collections and, for large n, fills the
+ *  old generation so that major collections run too.  Its old nodes
+ *  are then given new strings, which only the write barrier's
+ *  remembered set keeps alive.  A string too large for the nursery
+ *  goes straight to the old generation, and a local object (-O) holds
+ *  a new string across collections.  Run with make interp-test; the
+ *  output must not depend on n or on -g, -t, -T and -O.
+ *)
+
+class Node {
+  value : String;
+  next : Node;
+
+  init(v : String, n : Node) : Node {{ value <- v; next <- n; self; }};
+  value() : String { value };
+  next() : Node { next };
+  set_value(v : String) : Node {{ value <- v; self; }};
+};
+
+class Holder {
+  held : String;
+
+  hold(s : String) : Holder {{ held <- s; self; }};
+  held() : String { held };
+};
+
+class Main inherits IO {
+  n : Int;
+  list : Node;
+
+  -- Strings that die at once, to fill the nursery.
+  churn(k : Int) : Int {
+    let s : String <- "", i : Int <- 0 in {
+      while i < k loop {
+        s <- s.concat("ab");
+        if 64 < s.length() then s <- "" else s fi;
+        i <- i + 1;
+      } pool;
+      s.length();
+    }
+  };
+
+  digits(i : Int) : String {
+    if i < 10 then "0123456789".substr(i, 1)
+    else digits(i / 10).concat(digits(i - i / 10 * 10)) fi
+  };
+
+  build() : Node {
+    let i : Int <- 0 in {
+      while i < n loop {
+        list <- (new Node).init(digits(i), list);
+        i <- i + 1;
+      } pool;
+      list;
+    }
+  };
+
+  -- The sum of the lengths of the values, and whether each value is
+  -- what relabel (with tag) or build (without) left in it.
+  check(tag : String) : Bool {
+    let l : Node <- list, i : Int <- n, ok : Bool <- true in {
+      while not isvoid l loop {
+        i <- i - 1;
+        if tag = "" then
+          (if not l.value() = digits(i) then ok <- false else ok fi)
+        else
+          (if not l.value() = tag.concat(digits(i)) then ok <- false else ok fi)
+        fi;
+        l <- l.next();
+      } pool;
+      if ok then i = 0 else false fi;
+    }
+  };
+
+  relabel(tag : String) : Object {
+    let l : Node <- list, i : Int <- n in
+      while not isvoid l loop {
+        i <- i - 1;
+        l.set_value(tag.concat(digits(i)));
+        l <- l.next();
+      } pool
+  };
+
+  big() : Int {
+    let s : String <- "x", i : Int <- 0 in {
+      while i < 19 loop { s <- s.concat(s); i <- i + 1; } pool;
+      s.length();
+    }
+  };
+
+  local() : String {
+    let h : Holder <- new Holder in {
+      h.hold("held".concat(digits(42)));
+      churn(n);
+      h.held();
+    }
+  };
+
+  main() : Object {{
+    n <- in_int();
+    build();
+    churn(n);
+    out_string(if check("") then "list ok\n" else "list broken\n" fi);
+    relabel("new");
+    churn(n);
+    out_string(if check("new") then "relabel ok\n" else "relabel broken\n" fi);
+    out_int(big()).out_string("\n");
+    out_string(if check("new") then "list ok\n" else "list broken\n" fi);
+    out_string(local()).out_string("\n");
+  }};
+};
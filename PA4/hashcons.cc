@@ -0,0 +1,248 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  hashcons.cc
+//
+//  Implements structural hashing and hash-consing (see hashcons.h).
+//  The unique closed nodes are kept in an open-addressing table keyed
+//  by the hash of their NodeKey.  A node found to be a duplicate was
+//  the last one allocated from the AST pool, so its memory is handed
+//  back at once.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include <typeinfo>
+#include <sstream>
+#include <streambuf>
+#include "hashcons.h"
+
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME  1099511628211UL
+
+struct HashEntry {
+  unsigned long hash;
+  Expression node;
+};
+
+static std::vector<HashEntry> table;     // size is a power of two
+static long table_count;
+static long hits;
+static NodeKey new_key, old_key;
+
+//////////////////////////////////////////////////////////////////////
+//
+// Structural hashing through dump()
+//
+//////////////////////////////////////////////////////////////////////
+
+// A stream buffer that hashes what is written to it and keeps nothing.
+class HashBuf : public std::streambuf {
+public:
+  unsigned long h;
+  HashBuf() : h(FNV_OFFSET) { }
+protected:
+  int overflow(int c)
+  {
+    if (c != EOF)
+      h = (h ^ (unsigned char) c) * FNV_PRIME;
+    return c;
+  }
+};
+
+unsigned long structural_hash(Expression e)
+{
+  HashBuf buf;
+  std::ostream out(&buf);
+  e->dump(out, 0);
+  return buf.h;
+}
+
+bool structurally_equal(Expression e1, Expression e2)
+{
+  if (e1 == e2)
+    return true;
+  std::ostringstream s1, s2;
+  e1->dump(s1, 0);
+  e2->dump(s2, 0);
+  return s1.str() == s2.str();
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Hash-consing
+//
+//////////////////////////////////////////////////////////////////////
+
+bool NodeKey::child(Expression e)
+{
+  if (!(e->hc_flags & HC_CLOSED))
+    return false;
+  add(e);
+  return true;
+}
+
+unsigned long NodeKey::hash()
+{
+  unsigned long h = FNV_OFFSET;
+  for (size_t i = 0; i < words.size(); i++)
+    h = (h ^ words[i]) * FNV_PRIME;
+  return h ^ (h >> 29);
+}
+
+// The key starts with the node's class, so nodes of different classes
+// with the same fields never compare equal, and then its line number,
+// so only copies on the same line are shared and every node reports
+// the line it would have had without -H.
+static bool make_key(Expression node, NodeKey &k)
+{
+  k.clear();
+  k.add(&typeid(*node));
+  k.add((long) node->get_line_number());
+  Span span = span_lines(node->get_span());
+  k.add((long) span.first_line);
+  k.add((long) span.last_line);
+  return node->key(k);
+}
+
+static void grow_table()
+{
+  std::vector<HashEntry> old;
+  old.swap(table);
+  table.assign(old.empty() ? 1024 : old.size() * 2, HashEntry());
+  size_t mask = table.size() - 1;
+  for (size_t i = 0; i < old.size(); i++) {
+    if (old[i].node == NULL)
+      continue;
+    size_t j = old[i].hash & mask;
+    while (table[j].node != NULL)
+      j = (j + 1) & mask;
+    table[j] = old[i];
+  }
+}
+
+Expression hashcons_node(Expression node, size_t size)
+{
+  if (!make_key(node, new_key))
+    return node;
+  node->hc_flags |= HC_CLOSED;
+
+  if (2 * (table_count + 1) > (long) table.size())
+    grow_table();
+  unsigned long h = new_key.hash();
+  size_t mask = table.size() - 1;
+  size_t j = h & mask;
+  for (; table[j].node != NULL; j = (j + 1) & mask) {
+    if (table[j].hash != h)
+      continue;
+    Expression old = table[j].node;
+    make_key(old, old_key);
+    if (old_key == new_key) {
+      ast_pool_release(node, size);
+      old->hc_flags |= HC_SHARED;
+      hits++;
+      return old;
+    }
+  }
+  table[j].hash = h;
+  table[j].node = node;
+  table_count++;
+  return node;
+}
+
+long hashcons_hits()   { return hits; }
+long hashcons_unique() { return table_count; }
+
+//////////////////////////////////////////////////////////////////////
+//
+// Keys
+//
+// key() adds the fields of a node that distinguish it from other nodes
+// of its class, and returns false if the node depends on its
+// environment and so must not be shared.
+//
+//////////////////////////////////////////////////////////////////////
+
+static bool key_list(NodeKey &k, Expressions l)
+{
+  k.add((long) l->len());
+  for (int i = l->first(); l->more(i); i = l->next(i))
+    if (!k.child(l->nth(i)))
+      return false;
+  return true;
+}
+
+bool assign_class::key(NodeKey &k)   { return false; }
+bool typcase_class::key(NodeKey &k)  { return false; }
+bool let_class::key(NodeKey &k)      { return false; }
+bool object_class::key(NodeKey &k)   { return false; }
+
+bool static_dispatch_class::key(NodeKey &k)
+{
+  k.add(type_name);
+  k.add(name);
+  return k.child(expr) && key_list(k, actual);
+}
+
+bool dispatch_class::key(NodeKey &k)
+{
+  k.add(name);
+  return k.child(expr) && key_list(k, actual);
+}
+
+bool cond_class::key(NodeKey &k)
+{
+  return k.child(pred) && k.child(then_exp) && k.child(else_exp);
+}
+
+bool loop_class::key(NodeKey &k)
+{
+  return k.child(pred) && k.child(body);
+}
+
+bool block_class::key(NodeKey &k)
+{
+  return key_list(k, body);
+}
+
+bool plus_class::key(NodeKey &k)    { return k.child(e1) && k.child(e2); }
+bool sub_class::key(NodeKey &k)     { return k.child(e1) && k.child(e2); }
+bool mul_class::key(NodeKey &k)     { return k.child(e1) && k.child(e2); }
+bool divide_class::key(NodeKey &k)  { return k.child(e1) && k.child(e2); }
+bool lt_class::key(NodeKey &k)      { return k.child(e1) && k.child(e2); }
+bool eq_class::key(NodeKey &k)      { return k.child(e1) && k.child(e2); }
+bool leq_class::key(NodeKey &k)     { return k.child(e1) && k.child(e2); }
+bool neg_class::key(NodeKey &k)     { return k.child(e1); }
+bool comp_class::key(NodeKey &k)    { return k.child(e1); }
+bool isvoid_class::key(NodeKey &k)  { return k.child(e1); }
+
+bool int_const_class::key(NodeKey &k)
+{
+  k.add(token);
+  return true;
+}
+
+bool bool_const_class::key(NodeKey &k)
+{
+  k.add((long) val);
+  return true;
+}
+
+bool string_const_class::key(NodeKey &k)
+{
+  k.add(token);
+  return true;
+}
+
+bool new__class::key(NodeKey &k)
+{
+  // new SELF_TYPE has a different type in every class.
+  if (strcmp(type_name->get_string(), "SELF_TYPE") == 0)
+    return false;
+  k.add(type_name);
+  return true;
+}
+
+bool no_expr_class::key(NodeKey &k)
+{
+  return true;
+}
@@ -0,0 +1,70 @@
+#ifndef HASHCONS_H_
+#define HASHCONS_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  hashcons.h
+//
+//  Structural hashing of Expression subtrees, and hash-consing of the
+//  subtrees that do not depend on their environment.
+//
+//  structural_hash() and structurally_equal() compare two subtrees by
+//  what dump() prints for them, so line numbers and types are ignored.
+//  They cost time linear in the size of the subtrees.
+//
+//  With -H the constructor functions in cool-tree.cc pass each new
+//  Expression to hashcons(), which returns an existing node with the
+//  same structure if there is one.  Its children have already been
+//  through hashcons(), so the lookup compares only the node's own
+//  fields (see the key() methods in hashcons.cc) and the cost per node
+//  is constant.  Only closed subtrees are shared: constants, new of a
+//  named class, and operators, conditionals, loops, blocks and
+//  dispatches over closed subtrees.  The type of such a subtree is the
+//  same wherever it appears, so semant checks a shared node once and
+//  reuses its type (see Expression_class::check in semant.cc).
+//  Identifiers, let, case and assignments are never shared.
+//
+//  The key includes the line number and span, so only copies of a
+//  subtree on the same line and with the same span are shared, and
+//  dump_with_types, error messages and get_span() report the same
+//  lines as without -H.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <vector>
+#include "cool-tree.h"
+
+extern int ast_hashcons;          // set by -H
+
+// Bits of Expression_class::hc_flags.
+#define HC_CLOSED  1              // independent of the environment
+#define HC_SHARED  2              // returned by hashcons() more than once
+#define HC_TYPED   4              // checked without errors; type is final
+
+// The fields of one node that identify it among nodes of its class.
+class NodeKey {
+private:
+  std::vector<unsigned long> words;
+
+public:
+  void clear() { words.clear(); }
+  void add(const void *p) { words.push_back((unsigned long) p); }
+  void add(long n) { words.push_back((unsigned long) n); }
+  bool child(Expression e);
+  unsigned long hash();
+  bool operator==(const NodeKey &k) const { return words == k.words; }
+};
+
+unsigned long structural_hash(Expression e);
+bool structurally_equal(Expression e1, Expression e2);
+
+Expression hashcons_node(Expression node, size_t size);
+long hashcons_hits();
+long hashcons_unique();
+
+template <class T> inline Expression hashcons(T *node)
+{
+  return ast_hashcons ? hashcons_node(node, sizeof(T)) : node;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef INT_CONST_H_
+#define INT_CONST_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  int-const.h
+//
+//  The values of Int constants.  The IntEntry constructor (stringtab.cc)
+//  parses the digits once, when the constant is first added to an
+//  IntTable, and keeps the value after the string's terminating NUL,
+//  since the layout of IntEntry itself is fixed by stringtab.h.  The
+//  value is what (int) strtol() of the digits gives, so a constant
+//  that does not fit in 32 bits keeps the value it always had; it is
+//  also marked, and the lexer warns about it under -W.
+//
+//  Both functions take a Symbol that came from an IntTable (or a
+//  ConcurrentIntTable); on any other Symbol they read garbage.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+#include "stringtab.h"
+
+// What the constructor stores after the NUL.
+struct IntConstValue {
+  int value;
+  char overflow;          // the digits are more than INT_MAX
+};
+
+inline int int_value(Symbol sym)
+{
+  IntConstValue v;
+  memcpy(&v, sym->get_string() + sym->get_len() + 1, sizeof(v));
+  return v.value;
+}
+
+inline bool int_overflow(Symbol sym)
+{
+  IntConstValue v;
+  memcpy(&v, sym->get_string() + sym->get_len() + 1, sizeof(v));
+  return v.overflow;
+}
+
+#endif
@@ -0,0 +1,208 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  intern-bench.cc
+//
+//  Contention benchmark for interning from many threads.
+//
+//  Each thread interns a stream of identifiers the way a lexer working
+//  on its own file would: drawn from a shared vocabulary, with a few
+//  names far more common than the rest.  All threads intern into one
+//  table, which starts empty, so the first occurrences of a name race
+//  to add it.  Two tables are compared:
+//
+//      global       StringTable<IdEntry>, the type of idtable, behind
+//                   one mutex: what sharing the global tables would
+//                   take today
+//      concurrent   ConcurrentIdTable (see intern-table.h)
+//
+//  The total number of strings is fixed and split among 1, 2, 4, ...
+//  up to 64 threads.  For each table and thread count the benchmark
+//  reports the wall time and throughput, and checks that every thread
+//  got the same Symbol for each name and that the table holds each
+//  name once.  The results are written to stdout as JSON.
+//
+//  usage: intern-bench [-n strings] [-w words] [-t max_threads] [-q]
+//         -q runs a tenth of the strings
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <vector>
+#include <string>
+#include "stringtab_functions.h"
+#include "intern-table.h"
+
+//
+// These globals are normally defined by semant-phase.cc, which the
+// benchmark replaces.
+//
+FILE *ast_file = stdin;
+int cool_yydebug;
+char *curr_filename = "<bench>";
+
+extern int optind;
+extern char *optarg;
+
+static std::vector<std::string> words;
+
+struct GlobalTable {
+  StringTable<IdEntry> table;
+  pthread_mutex_t lock;
+
+  GlobalTable() { pthread_mutex_init(&lock, NULL); }
+  Symbol add(char *s, int len)
+  {
+    pthread_mutex_lock(&lock);
+    Symbol sym = table.add_string(s, len);
+    pthread_mutex_unlock(&lock);
+    return sym;
+  }
+  int size()
+  {
+    int n = 0;
+    for (int i = table.first(); table.more(i); i = table.next(i))
+      n++;
+    return n;
+  }
+};
+
+struct ConcurrentTable {
+  ConcurrentIdTable table;
+
+  Symbol add(char *s, int len) { return table.add_string(s, len); }
+  int size() { return table.size(); }
+};
+
+template <class Table> struct Worker {
+  Table *table;
+  long strings;
+  unsigned long seed;
+  std::vector<Symbol> seen;     // the Symbol this thread got for each word
+};
+
+static double now_ms()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// Picks a word index: u^3 for uniform u puts about half of the picks
+// in the first eighth of the vocabulary.
+static int pick(unsigned long &x)
+{
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  double u = (x >> 11) * (1.0 / 9007199254740992.0);
+  return (int) (u * u * u * words.size());
+}
+
+template <class Table> static void *run_worker(void *arg)
+{
+  Worker<Table> *w = (Worker<Table> *) arg;
+  unsigned long x = w->seed;
+  for (long i = 0; i < w->strings; i++) {
+    int k = pick(x);
+    Symbol s = w->table->add((char *) words[k].c_str(), words[k].size());
+    if (w->seen[k] == NULL)
+      w->seen[k] = s;
+    else if (w->seen[k] != s)
+      w->seen[k] = (Symbol) 1;  // two Symbols for one word
+  }
+  return NULL;
+}
+
+template <class Table>
+static void run(const char *name, int threads, long strings, bool last)
+{
+  Table *table = new Table;
+  std::vector<Worker<Table> > workers(threads);
+  std::vector<pthread_t> tids(threads);
+  for (int t = 0; t < threads; t++) {
+    workers[t].table = table;
+    workers[t].strings = strings / threads;
+    workers[t].seed = 88172645463325252UL + 7919 * t;
+    workers[t].seen.assign(words.size(), (Symbol) NULL);
+  }
+
+  double start = now_ms();
+  for (int t = 0; t < threads; t++)
+    pthread_create(&tids[t], NULL, run_worker<Table>, &workers[t]);
+  for (int t = 0; t < threads; t++)
+    pthread_join(tids[t], NULL);
+  double ms = now_ms() - start;
+
+  bool consistent = true;
+  long distinct = 0;
+  for (size_t k = 0; k < words.size(); k++) {
+    Symbol s = NULL;
+    for (int t = 0; t < threads; t++) {
+      Symbol seen = workers[t].seen[k];
+      if (seen == NULL)
+        continue;
+      if (seen == (Symbol) 1 || (s && s != seen))
+        consistent = false;
+      s = seen;
+    }
+    if (s)
+      distinct++;
+  }
+  consistent = consistent && table->size() == distinct;
+
+  long done = threads * (strings / threads);
+  printf("      { \"threads\": %d, \"strings\": %ld, \"wall_ms\": %.3f, "
+         "\"mstrings_per_s\": %.3f, \"distinct\": %ld, \"consistent\": %s }%s\n",
+         threads, done, ms, ms > 0 ? done / ms / 1000.0 : 0.0, distinct,
+         consistent ? "true" : "false", last ? "" : ",");
+  fflush(stdout);
+  delete table;
+}
+
+template <class Table>
+static void run_series(const char *name, int max_threads, long strings, bool last)
+{
+  printf("    { \"table\": \"%s\",\n      \"runs\": [\n", name);
+  for (int t = 1; t <= max_threads; t *= 2)
+    run<Table>(name, t, strings, 2 * t > max_threads);
+  printf("      ] }%s\n", last ? "" : ",");
+}
+
+int main(int argc, char *argv[])
+{
+  long strings = 1000000;
+  int nwords = 2000;
+  int max_threads = 64;
+  int c;
+
+  while ((c = getopt(argc, argv, "n:w:t:q")) != -1) {
+    switch (c) {
+    case 'n': strings = atol(optarg); break;
+    case 'w': nwords = atoi(optarg); break;
+    case 't': max_threads = atoi(optarg); break;
+    case 'q': strings /= 10; break;
+    default:
+      fprintf(stderr, "usage: %s [-n strings] [-w words] [-t max_threads] [-q]\n", argv[0]);
+      exit(1);
+    }
+  }
+
+  // Identifier-like names of 1 to 16 characters.
+  for (int i = 0; i < nwords; i++) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*s%d", i % 12, "identifierxx", i);
+    words.push_back(buf);
+  }
+
+  printf("{ \"words\": %d, \"cpus\": %ld,\n  \"series\": [\n",
+         nwords, sysconf(_SC_NPROCESSORS_ONLN));
+  run_series<GlobalTable>("global", max_threads, strings, false);
+  run_series<ConcurrentTable>("concurrent", max_threads, strings, true);
+  printf("  ] }\n");
+  return 0;
+}
@@ -0,0 +1,151 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  intern-table.cc
+//
+//  Implements ConcurrentStringTable (see intern-table.h).  The locks
+//  are spin locks on __sync_lock_test_and_set, since an insert holds
+//  one only long enough to allocate an Elem and link a node.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "intern-table.h"
+
+#define FNV_OFFSET 14695981039346656037UL
+#define FNV_PRIME  1099511628211UL
+
+#define INITIAL_BUCKETS 16
+
+template class ConcurrentStringTable<IdEntry>;
+template class ConcurrentStringTable<StringEntry>;
+template class ConcurrentStringTable<IntEntry>;
+
+template <class Elem>
+unsigned long ConcurrentStringTable<Elem>::hash(const char *s, int len)
+{
+  unsigned long h = FNV_OFFSET;
+  for (int i = 0; i < len; i++)
+    h = (h ^ (unsigned char) s[i]) * FNV_PRIME;
+  return h;
+}
+
+template <class Elem>
+typename ConcurrentStringTable<Elem>::Buckets *
+ConcurrentStringTable<Elem>::new_buckets(unsigned long n)
+{
+  Buckets *b = (Buckets *) calloc(1, sizeof(Buckets) + (n - 1) * sizeof(Node *));
+  b->mask = n - 1;
+  return b;
+}
+
+template <class Elem>
+ConcurrentStringTable<Elem>::ConcurrentStringTable() : index(0)
+{
+  for (int i = 0; i < INTERN_SHARDS; i++) {
+    shards[i].buckets = new_buckets(INITIAL_BUCKETS);
+    shards[i].lock = 0;
+    shards[i].count = 0;
+  }
+}
+
+// The Elems stay: Symbols handed out may outlive the table, as they
+// do the global tables.
+template <class Elem>
+ConcurrentStringTable<Elem>::~ConcurrentStringTable()
+{
+  for (int i = 0; i < INTERN_SHARDS; i++) {
+    Buckets *b = shards[i].buckets;
+    while (b) {
+      for (unsigned long k = 0; k <= b->mask; k++)
+        for (Node *n = b->heads[k], *next; n; n = next) {
+          next = n->next;
+          delete n;
+        }
+      Buckets *retired = b->retired;
+      free(b);
+      b = retired;
+    }
+  }
+}
+
+// Walks h's chain in the shard's current buckets without locking.
+template <class Elem>
+Elem *ConcurrentStringTable<Elem>::find(Shard &shard, unsigned long h,
+                                        char *s, int len)
+{
+  Buckets *b = __atomic_load_n(&shard.buckets, __ATOMIC_ACQUIRE);
+  Node *n = __atomic_load_n(&b->heads[h & b->mask], __ATOMIC_ACQUIRE);
+  for (; n; n = n->next)
+    if (n->hash == h && n->elem->equal_string(s, len))
+      return n->elem;
+  return NULL;
+}
+
+// Rehashes the shard into twice as many buckets.  The lock is held.
+template <class Elem>
+void ConcurrentStringTable<Elem>::grow(Shard &shard)
+{
+  Buckets *old = shard.buckets;
+  Buckets *b = new_buckets(2 * (old->mask + 1));
+  for (unsigned long k = 0; k <= old->mask; k++)
+    for (Node *n = old->heads[k]; n; n = n->next) {
+      Node *copy = new Node;
+      copy->hash = n->hash;
+      copy->elem = n->elem;
+      copy->next = b->heads[n->hash & b->mask];
+      b->heads[n->hash & b->mask] = copy;
+    }
+  b->retired = old;
+  __atomic_store_n(&shard.buckets, b, __ATOMIC_RELEASE);
+}
+
+template <class Elem>
+Elem *ConcurrentStringTable<Elem>::add_string(char *s, int maxchars)
+{
+  int len = (int) strlen(s);
+  if (len > maxchars)
+    len = maxchars;
+  unsigned long h = hash(s, len);
+  Shard &shard = shards[h >> (64 - INTERN_SHARD_BITS)];
+
+  Elem *e = find(shard, h, s, len);
+  if (e)
+    return e;
+
+  while (__sync_lock_test_and_set(&shard.lock, 1))
+    while (__atomic_load_n(&shard.lock, __ATOMIC_RELAXED))
+      sched_yield();
+
+  e = find(shard, h, s, len);         // added while we waited?
+  if (e == NULL) {
+    e = new Elem(s, len, __sync_fetch_and_add(&index, 1));
+    if (shard.count >= 2 * (long) (shard.buckets->mask + 1))
+      grow(shard);
+    Buckets *b = shard.buckets;
+    Node *n = new Node;
+    n->hash = h;
+    n->elem = e;
+    n->next = b->heads[h & b->mask];
+    __atomic_store_n(&b->heads[h & b->mask], n, __ATOMIC_RELEASE);
+    shard.count++;
+  }
+
+  __sync_lock_release(&shard.lock);
+  return e;
+}
+
+template <class Elem>
+Elem *ConcurrentStringTable<Elem>::add_string(char *s)
+{
+  return add_string(s, (int) strlen(s));
+}
+
+template <class Elem>
+Elem *ConcurrentStringTable<Elem>::lookup_string(char *s)
+{
+  int len = (int) strlen(s);
+  unsigned long h = hash(s, len);
+  return find(shards[h >> (64 - INTERN_SHARD_BITS)], h, s, len);
+}
@@ -0,0 +1,72 @@
+#ifndef INTERN_TABLE_H_
+#define INTERN_TABLE_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  intern-table.h
+//
+//  A string table that many threads can intern into at once, for a
+//  front end that lexes files on several threads.  It has the
+//  add_string and lookup_string of StringTable (stringtab.h) and
+//  returns the same kind of Elem, so its Symbols can go into the AST.
+//  An Elem, once returned, never moves and is never freed, and every
+//  thread that adds the same string gets the same Elem.
+//
+//  The table is split into 64 shards by the top bits of the string's
+//  hash.  A shard is a bucket array of chains of immutable nodes.
+//  Lookups take no lock: they load the bucket array and walk a chain,
+//  and each pointer they follow was published with a release store.
+//  An insert locks only its shard, looks again, and pushes a node onto
+//  the front of the chain.  A shard that grows past two nodes per
+//  bucket is rehashed into a new array of new nodes under the lock;
+//  the old array and nodes are kept until the table is destroyed, so a
+//  lookup still walking them stays safe.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "stringtab.h"
+
+#define INTERN_SHARD_BITS 6
+#define INTERN_SHARDS     (1 << INTERN_SHARD_BITS)
+
+template <class Elem>
+class ConcurrentStringTable {
+private:
+  struct Node {
+    unsigned long hash;
+    Elem *elem;
+    Node *next;
+  };
+  struct Buckets {
+    unsigned long mask;       // number of buckets - 1
+    Buckets *retired;         // the array this one replaced
+    Node *heads[1];
+  };
+  struct Shard {
+    Buckets *buckets;
+    int lock;
+    long count;
+  } __attribute__((aligned(64)));     // one cache line each
+
+  Shard shards[INTERN_SHARDS];
+  int index;                  // next Elem index, across all shards
+
+  static unsigned long hash(const char *s, int len);
+  static Buckets *new_buckets(unsigned long n);
+  Elem *find(Shard &shard, unsigned long h, char *s, int len);
+  void grow(Shard &shard);
+
+public:
+  ConcurrentStringTable();
+  ~ConcurrentStringTable();
+  Elem *add_string(char *s, int maxchars);
+  Elem *add_string(char *s);
+  Elem *lookup_string(char *s);       // NULL if s was never added
+  int size() { return __atomic_load_n(&index, __ATOMIC_RELAXED); }
+};
+
+typedef ConcurrentStringTable<IdEntry> ConcurrentIdTable;
+typedef ConcurrentStringTable<StringEntry> ConcurrentStrTable;
+typedef ConcurrentStringTable<IntEntry> ConcurrentIntTable;
+
+#endif
@@ -0,0 +1,617 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  interp-compile.cc
+//
+//  Lowers a type-checked program to bytecode (see interp.h).  The
+//  runtime classes are built from the class table left by semant:
+//  each class inherits its parent's attribute layout and adds its own
+//  attributes after it.  Every Expression node has a compile method
+//  that emits code leaving the value of the expression on the stack.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdlib.h>
+#include <string.h>
+#include "interp.h"
+#include "int-const.h"
+
+static Symbol self_sym, SELF_TYPE_sym, Object_sym, Int_sym, Bool_sym, Str_sym;
+
+//////////////////////////////////////////////////////////////////////
+//
+// Runtime classes
+//
+//////////////////////////////////////////////////////////////////////
+
+//
+// Classes are added parents first, so that a class can copy its
+// parent's attribute layout.  The basic classes get the fixed ids of
+// the CLASS_ enum.
+//
+void Interp::add_class(ClassTableP ct, Symbol name)
+{
+  if (class_ids.find(name) != class_ids.end())
+    return;
+  Class_ c = ct->lookup_class(name);
+  Symbol parent = c->get_parent();
+  if (ct->is_defined(parent))
+    add_class(ct, parent);
+
+  RuntimeClass *rc = new RuntimeClass;
+  rc->name = name;
+  rc->id = classes.size();
+  rc->parent = ct->is_defined(parent) ? class_ids[parent] : -1;
+  rc->filename = c->get_filename();
+  rc->init = NULL;
+  rc->type_name = make_static_string(name->get_string());
+  classes.push_back(rc);
+  class_ids[name] = rc->id;
+
+  if (rc->parent >= 0) {
+    rc->attr_names = classes[rc->parent]->attr_names;
+    rc->attr_types = classes[rc->parent]->attr_types;
+    rc->attr_defaults = classes[rc->parent]->attr_defaults;
+  }
+
+  bool basic = rc->id < NUM_BASIC_CLASSES;
+  Features features = c->get_features();
+  for (int i = features->first(); features->more(i); i = features->next(i)) {
+    Feature f = features->nth(i);
+    if (f->is_method()) {
+      method_class *m = (method_class *) f;
+      Formals formals = m->get_formals();
+      Method *method = new Method(m->get_name(), rc->id, formals->len());
+      for (int j = formals->first(); formals->more(j); j = formals->next(j))
+	method->formal_types.push_back(formals->nth(j)->get_type_decl());
+      method->return_type = m->get_return_type();
+      rc->methods[m->get_name()] = method;
+    } else if (!basic) {
+      // The attributes of Int, Bool and String are their values,
+      // which the runtime keeps itself.
+      attr_class *a = (attr_class *) f;
+      Symbol type = a->get_type_decl();
+      rc->attr_names.push_back(a->get_name());
+      rc->attr_types.push_back(type);
+      rc->attr_defaults.push_back(
+	  type == Int_sym  ? (unboxed ? tag_int(0) : constants[int_constant(inttable.add_string("0"))]) :
+	  type == Bool_sym ? (unboxed ? tag_int(0) : false_obj) :
+	  type == Str_sym  ? constants[string_constant(stringtable.add_string(""))] :
+	  NULL);
+    }
+  }
+}
+
+Method *Interp::lookup(int class_id, Symbol name)
+{
+  for (int c = class_id; c >= 0; c = classes[c]->parent) {
+    std::map<Symbol, Method *> &methods = classes[c]->methods;
+    std::map<Symbol, Method *>::iterator it = methods.find(name);
+    if (it != methods.end())
+      return it->second;
+  }
+  return NULL;
+}
+
+int Interp::int_constant(Symbol token)
+{
+  std::map<Symbol, int>::iterator it = int_consts.find(token);
+  if (it != int_consts.end())
+    return it->second;
+  Object *o = allocate(CLASS_INT, 0, sizeof(int), true);
+  o->int_val() = int_value(token);
+  constants.push_back(o);
+  return int_consts[token] = constants.size() - 1;
+}
+
+int Interp::string_constant(Symbol token)
+{
+  std::map<Symbol, int>::iterator it = string_consts.find(token);
+  if (it != string_consts.end())
+    return it->second;
+  int len = token->get_len();
+  Object *o = allocate(CLASS_STRING, len, len + 1, true);
+  memcpy(o->chars(), token->get_string(), len);
+  o->chars()[len] = '\0';
+  constants.push_back(o);
+  return string_consts[token] = constants.size() - 1;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Loading a program
+//
+//////////////////////////////////////////////////////////////////////
+
+void Interp::load(Program program)
+{
+  ClassTableP ct = program->get_classtable();
+
+  self_sym      = idtable.add_string("self");
+  SELF_TYPE_sym = idtable.add_string("SELF_TYPE");
+  Object_sym    = idtable.add_string("Object");
+  Int_sym       = idtable.add_string("Int");
+  Bool_sym      = idtable.add_string("Bool");
+  Str_sym       = idtable.add_string("String");
+
+  const char *basic[NUM_BASIC_CLASSES] = { "Object", "IO", "Int", "Bool", "String" };
+  for (int i = 0; i < NUM_BASIC_CLASSES; i++)
+    add_class(ct, idtable.add_string((char *) basic[i]));
+  for (int i = 0; i < ct->class_count(); i++)
+    add_class(ct, ct->class_at(i)->get_name());
+  add_natives();
+
+  // Parents come before their children in classes, so a class's
+  // parent init method exists when the class is compiled.
+  for (size_t i = NUM_BASIC_CLASSES; i < classes.size(); i++)
+    compile_class(classes[i], ct);
+
+  Symbol main_class = idtable.add_string("Main");
+  Method *main_method = lookup(class_ids[main_class], idtable.add_string("main"));
+  boot = new Method(idtable.add_string("boot"), class_ids[main_class], 0);
+  Compiler c(*this, classes[class_ids[main_class]], boot);
+  c.emit(OP_NEW, class_ids[main_class]);
+  c.emit(OP_STATIC_DISPATCH, c.call_site(main_method->name, 0, 0, main_method));
+  c.emit(OP_HALT);
+}
+
+//
+// The init method of a class runs its parent's init method and then
+// the initializers of its own attributes, in order.  A class with no
+// initializers anywhere in its chain needs no init method at all.
+//
+void Interp::compile_class(RuntimeClass *rc, ClassTableP ct)
+{
+  Class_ c = ct->lookup_class(rc->name);
+  Features features = c->get_features();
+  Method *parent_init = classes[rc->parent]->init;
+
+  Method *init = new Method(idtable.add_string("_init"), rc->id, 0);
+  Compiler ic(*this, rc, init);
+  bool needed = parent_init != NULL;
+  if (parent_init) {
+    ic.emit(OP_PUSH_SELF);
+    ic.emit(OP_STATIC_DISPATCH, ic.call_site(parent_init->name, 0, 0, parent_init));
+    ic.emit(OP_POP);
+  }
+  for (int i = features->first(); features->more(i); i = features->next(i)) {
+    Feature f = features->nth(i);
+    if (f->is_method())
+      continue;
+    attr_class *a = (attr_class *) f;
+    if (a->get_init()->is_no_expr())
+      continue;
+    a->get_init()->compile(ic);
+    ic.coerce(a->get_init()->get_type(), a->get_type_decl());
+    ic.store(a->get_name());
+    ic.emit(OP_POP);
+    needed = true;
+  }
+  ic.emit(OP_PUSH_SELF);
+  ic.emit(OP_RETURN);
+  rc->init = needed ? init : NULL;
+
+  for (int i = features->first(); features->more(i); i = features->next(i)) {
+    Feature f = features->nth(i);
+    if (!f->is_method())
+      continue;
+    method_class *m = (method_class *) f;
+    Method *method = rc->methods[m->get_name()];
+    Compiler mc(*this, rc, method);
+    Formals formals = m->get_formals();
+    int slot = 0;
+    for (int j = formals->first(); formals->more(j); j = formals->next(j))
+      mc.bind_formal(formals->nth(j)->get_name(), slot++,
+		     formals->nth(j)->get_type_decl());
+    m->get_expr()->compile(mc);
+    mc.coerce(m->get_expr()->get_type(), m->get_return_type());
+    mc.emit(OP_RETURN);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Compiler
+//
+//////////////////////////////////////////////////////////////////////
+
+int Compiler::bind(Symbol name, Symbol type)
+{
+  int slot = method->nargs + 1 + nvars++;
+  if (nvars > method->nlocals)
+    method->nlocals = nvars;
+  scope.push_back(Binding(name, slot, type));
+  return slot;
+}
+
+void Compiler::unbind()
+{
+  scope.pop_back();
+  nvars--;
+}
+
+int Compiler::call_site(Symbol name, int nargs, int line, Method *target)
+{
+  CallSite site;
+  site.name = name;
+  site.nargs = nargs;
+  site.line = line;
+  site.target = target;
+  site.filename = cls->filename;
+  site.ic_size = 0;
+  site.hits = site.misses = site.megamorphic = 0;
+  interp.call_sites.push_back(site);
+  return interp.call_sites.size() - 1;
+}
+
+//
+// Names are resolved innermost first: let and case variables and
+// formals, then the attributes of the class.
+//
+static int attr_index(RuntimeClass *c, Symbol name)
+{
+  for (int i = c->attr_names.size() - 1; i >= 0; i--)
+    if (c->attr_names[i] == name)
+      return i;
+  return -1;
+}
+
+void Compiler::load(Symbol name)
+{
+  for (int i = scope.size() - 1; i >= 0; i--)
+    if (scope[i].name == name) {
+      emit(OP_LOAD_LOCAL, scope[i].slot);
+      return;
+    }
+  emit(OP_LOAD_ATTR, attr_index(cls, name));
+}
+
+void Compiler::store(Symbol name)
+{
+  for (int i = scope.size() - 1; i >= 0; i--)
+    if (scope[i].name == name) {
+      emit(OP_STORE_LOCAL, scope[i].slot);
+      return;
+    }
+  emit(OP_STORE_ATTR, attr_index(cls, name));
+}
+
+// The declared type of a variable or attribute.
+Symbol Compiler::type_of(Symbol name)
+{
+  for (int i = scope.size() - 1; i >= 0; i--)
+    if (scope[i].name == name)
+      return scope[i].type;
+  return cls->attr_types[attr_index(cls, name)];
+}
+
+void Compiler::push_default(Symbol type)
+{
+  if (unboxed(type))
+    emit(OP_PUSH_IMM, (long) tag_int(0));
+  else if (type == Int_sym)
+    emit(OP_PUSH_CONST, interp.int_constant(inttable.add_string("0")));
+  else if (type == Bool_sym)
+    emit(OP_PUSH_CONST, interp.bool_constant(false));
+  else if (type == Str_sym)
+    emit(OP_PUSH_CONST, interp.string_constant(stringtable.add_string("")));
+  else
+    emit(OP_PUSH_VOID);
+}
+
+// Whether a value of static type type is unboxed (see interp.h).
+bool Compiler::unboxed(Symbol type)
+{
+  return interp.unboxed && (type == Int_sym || type == Bool_sym);
+}
+
+// Converts the value on top of the stack, of static type from, to the
+// representation of a place of type to.
+void Compiler::coerce(Symbol from, Symbol to)
+{
+  bool f = unboxed(from), t = unboxed(to);
+  if (f && !t)
+    emit(from == Int_sym ? OP_BOX_INT : OP_BOX_BOOL);
+  else if (t && !f)
+    emit(OP_UNBOX);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Expressions
+//
+//////////////////////////////////////////////////////////////////////
+
+// An argument has the representation of the formal's type.  m has
+// the signature of the method called, which every override shares.
+static void compile_actuals(Compiler &c, Expressions actual, Method *m)
+{
+  for (int i = actual->first(); actual->more(i); i = actual->next(i)) {
+    actual->nth(i)->compile(c);
+    c.coerce(actual->nth(i)->get_type(), m->formal_types[i]);
+  }
+}
+
+void assign_class::compile(Compiler &c)
+{
+  Symbol decl = c.type_of(name);
+  expr->compile(c);
+  c.coerce(expr->get_type(), decl);
+  c.store(name);
+  c.coerce(decl, type);
+}
+
+// Cool evaluates the arguments before the receiver.  The receiver is
+// always boxed; the result has the representation of the method's
+// return type.
+void static_dispatch_class::compile(Compiler &c)
+{
+  Method *m = c.interp.lookup(c.interp.class_ids[type_name], name);
+  compile_actuals(c, actual, m);
+  expr->compile(c);
+  c.coerce(expr->get_type(), Object_sym);
+  c.emit(OP_STATIC_DISPATCH, c.call_site(name, actual->len(), get_line_number(), m));
+  c.coerce(m->return_type, type);
+}
+
+//
+// new T of a let or dispatch that -O found does not escape (see
+// escape.cc) is allocated on the heap's local stack, which is cut back
+// to where it was when the let or dispatch ends.  The mark is kept in
+// a variable without a name.
+//
+static int compile_local_new(Compiler &c, Expression init)
+{
+  Symbol t;
+  init->is_new(t);
+  int mark = c.bind(NULL, NULL);
+  c.emit(OP_MARK_LOCALS, mark);
+  c.emit(OP_NEW_LOCAL, c.interp.class_ids[t]);
+  return mark;
+}
+
+static void release_locals(Compiler &c, int mark)
+{
+  c.emit(OP_RELEASE_LOCALS, mark);
+  c.unbind();
+}
+
+// A dispatch that -O bound to one method (see optimize.h) calls it
+// without looking it up.
+void dispatch_class::compile(Compiler &c)
+{
+  Symbol t = expr->get_type() == SELF_TYPE_sym ? c.cls->name : expr->get_type();
+  Method *sig = c.interp.lookup(c.interp.class_ids[t], name);
+  compile_actuals(c, actual, sig);
+  int mark = 0;
+  if (local_receiver) {
+    mark = compile_local_new(c, expr);
+  } else {
+    expr->compile(c);
+    c.coerce(expr->get_type(), Object_sym);
+  }
+  if (target_class) {
+    Method *m = c.interp.lookup(c.interp.class_ids[target_class], name);
+    c.emit(OP_DIRECT_DISPATCH, c.call_site(name, actual->len(), get_line_number(), m));
+  } else {
+    c.emit(OP_DISPATCH, c.call_site(name, actual->len(), get_line_number(), NULL));
+  }
+  if (local_receiver)
+    release_locals(c, mark);
+  c.coerce(sig->return_type, type);
+}
+
+static void jump_if_false(Compiler &c, Expression pred)
+{
+  pred->compile(c);
+  c.emit(c.unboxed(pred->get_type()) ? OP_IJUMP_IF_FALSE : OP_JUMP_IF_FALSE, 0);
+}
+
+void cond_class::compile(Compiler &c)
+{
+  jump_if_false(c, pred);
+  int to_else = c.here() - 1;
+  then_exp->compile(c);
+  c.coerce(then_exp->get_type(), type);
+  c.emit(OP_JUMP, 0);
+  int to_end = c.here() - 1;
+  c.patch(to_else, c.here());
+  else_exp->compile(c);
+  c.coerce(else_exp->get_type(), type);
+  c.patch(to_end, c.here());
+}
+
+void loop_class::compile(Compiler &c)
+{
+  int top = c.here();
+  jump_if_false(c, pred);
+  int to_end = c.here() - 1;
+  body->compile(c);
+  c.emit(OP_POP);
+  c.emit(OP_JUMP, top);
+  c.patch(to_end, c.here());
+  c.emit(OP_PUSH_VOID);
+}
+
+//
+// CASE pops the value, stores it in the variable of the branch it
+// selects and jumps to the branch.  The value is boxed, so a branch
+// that binds an Int or Bool unboxes it first.
+//
+void typcase_class::compile(Compiler &c)
+{
+  expr->compile(c);
+  c.coerce(expr->get_type(), Object_sym);
+  CaseSite site;
+  site.line = get_line_number();
+  site.filename = c.cls->filename;
+  c.interp.case_sites.push_back(site);
+  int index = c.interp.case_sites.size() - 1;
+  c.emit(OP_CASE, index);
+
+  std::vector<int> to_end;
+  for (int i = cases->first(); cases->more(i); i = cases->next(i)) {
+    branch_class *b = (branch_class *) cases->nth(i);
+    CaseBranch cb;
+    cb.class_id = c.interp.class_ids[b->get_type_decl()];
+    cb.slot = c.bind(b->get_name(), b->get_type_decl());
+    cb.target = c.here();
+    c.interp.case_sites[index].branches.push_back(cb);
+    if (c.unboxed(b->get_type_decl())) {
+      c.emit(OP_LOAD_LOCAL, cb.slot);
+      c.emit(OP_UNBOX);
+      c.emit(OP_STORE_LOCAL, cb.slot);
+      c.emit(OP_POP);
+    }
+    b->get_expr()->compile(c);
+    c.coerce(b->get_expr()->get_type(), type);
+    c.unbind();
+    c.emit(OP_JUMP, 0);
+    to_end.push_back(c.here() - 1);
+  }
+  for (size_t i = 0; i < to_end.size(); i++)
+    c.patch(to_end[i], c.here());
+}
+
+// -O can leave a block, or a let below, whose value has a narrower
+// static type than the node itself, such as an Int where a
+// conditional of type Object was folded away, so the value is
+// converted to the node's representation at the end.
+void block_class::compile(Compiler &c)
+{
+  Expression last = NULL;
+  for (int i = body->first(); body->more(i); i = body->next(i)) {
+    if (last)
+      c.emit(OP_POP);
+    last = body->nth(i);
+    last->compile(c);
+  }
+  c.coerce(last->get_type(), type);
+}
+
+void let_class::compile(Compiler &c)
+{
+  int mark = 0;
+  if (local_init)
+    mark = compile_local_new(c, init);
+  else if (init->is_no_expr())
+    c.push_default(type_decl);
+  else {
+    init->compile(c);
+    c.coerce(init->get_type(), type_decl);
+  }
+  c.emit(OP_STORE_LOCAL, c.bind(identifier, type_decl));
+  c.emit(OP_POP);
+  body->compile(c);
+  c.coerce(body->get_type(), type);
+  c.unbind();
+  if (local_init)
+    release_locals(c, mark);
+}
+
+// The operands of the arithmetic and comparison operators are Int,
+// so they are unboxed exactly when the result is.
+static void compile_binary(Compiler &c, Expression e1, Expression e2,
+			   Opcode op, Opcode unboxed_op)
+{
+  e1->compile(c);
+  e2->compile(c);
+  c.emit(c.unboxed(e1->get_type()) ? unboxed_op : op);
+}
+
+void plus_class::compile(Compiler &c)  { compile_binary(c, e1, e2, OP_ADD, OP_IADD); }
+void sub_class::compile(Compiler &c)   { compile_binary(c, e1, e2, OP_SUB, OP_ISUB); }
+void mul_class::compile(Compiler &c)   { compile_binary(c, e1, e2, OP_MUL, OP_IMUL); }
+void lt_class::compile(Compiler &c)    { compile_binary(c, e1, e2, OP_LT, OP_ILT); }
+void leq_class::compile(Compiler &c)   { compile_binary(c, e1, e2, OP_LEQ, OP_ILEQ); }
+
+// An unboxed value equals another when its word does.  One side can
+// be an Int or a Bool while the other has type Object, so IEQ is only
+// used when both are unboxed; otherwise both are boxed and compared
+// by EQ, which leaves a boxed Bool.
+void eq_class::compile(Compiler &c)
+{
+  bool words = c.unboxed(e1->get_type()) && c.unboxed(e2->get_type());
+  e1->compile(c);
+  if (!words)
+    c.coerce(e1->get_type(), Object_sym);
+  e2->compile(c);
+  if (!words)
+    c.coerce(e2->get_type(), Object_sym);
+  if (words) {
+    c.emit(OP_IEQ);
+  } else {
+    c.emit(OP_EQ);
+    c.coerce(Object_sym, type);
+  }
+}
+
+void divide_class::compile(Compiler &c)
+{
+  e1->compile(c);
+  e2->compile(c);
+  c.emit(c.unboxed(type) ? OP_IDIV : OP_DIV, get_line_number());
+}
+
+void neg_class::compile(Compiler &c)
+{
+  e1->compile(c);
+  c.emit(c.unboxed(type) ? OP_INEG : OP_NEG);
+}
+
+void comp_class::compile(Compiler &c)
+{
+  e1->compile(c);
+  c.emit(c.unboxed(type) ? OP_INOT : OP_NOT);
+}
+
+void isvoid_class::compile(Compiler &c)
+{
+  e1->compile(c);
+  c.coerce(e1->get_type(), Object_sym);
+  c.emit(OP_ISVOID);
+  c.coerce(Object_sym, type);
+}
+
+void int_const_class::compile(Compiler &c)
+{
+  if (c.unboxed(type))
+    c.emit(OP_PUSH_IMM, (long) tag_int(int_value(token)));
+  else
+    c.emit(OP_PUSH_CONST, c.interp.int_constant(token));
+}
+
+void bool_const_class::compile(Compiler &c)
+{
+  if (c.unboxed(type))
+    c.emit(OP_PUSH_IMM, (long) tag_int(val));
+  else
+    c.emit(OP_PUSH_CONST, c.interp.bool_constant(val));
+}
+
+void string_const_class::compile(Compiler &c)
+{
+  c.emit(OP_PUSH_CONST, c.interp.string_constant(token));
+}
+
+void new__class::compile(Compiler &c)
+{
+  if (c.unboxed(type_name))
+    c.push_default(type_name);
+  else if (type_name == SELF_TYPE_sym)
+    c.emit(OP_NEW_SELF_TYPE);
+  else
+    c.emit(OP_NEW, c.interp.class_ids[type_name]);
+}
+
+void no_expr_class::compile(Compiler &c)
+{
+  c.emit(OP_PUSH_VOID);
+}
+
+void object_class::compile(Compiler &c)
+{
+  if (name == self_sym)
+    c.emit(OP_PUSH_SELF);
+  else
+    c.load(name);
+}
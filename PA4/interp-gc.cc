@@ -0,0 +1,363 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  interp-gc.cc
+//
+//  The heap of the interpreter (see Heap in interp.h).  cgen_Memmgr
+//  chooses the collector:
+//
+//    GC_NOGC   objects are bumped out of large chunks and never freed.
+//    GC_GENGC  (-g) new objects are bumped out of a fixed nursery.  When
+//              it is full, a minor collection copies its live objects
+//              into the old generation; the roots are the value stack
+//              and the old objects that the write barrier saw being
+//              given a pointer into the nursery.  When the old
+//              generation has no room for what the nursery could
+//              promote, a major collection copies everything live into
+//              a new old space.
+//
+//  Objects too large for the nursery go straight to the old generation.
+//  Objects that do not escape (NEW_LOCAL) are bumped out of a separate
+//  local stack, which is cut back in LIFO order and never collected;
+//  the fields of the objects on it are roots of every collection.  An
+//  object that does not fit on it is allocated in the heap.
+//  With -t (GC_TEST) the heap is collected on every allocation, and
+//  with -T (GC_DEBUG) it is checked after every collection and the
+//  space given up is overwritten, so that stale pointers show.  -P
+//  appends a "gc" record with the number and length of the pauses,
+//  the bytes promoted and the survival rates.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "interp.h"
+#include "cgen_gc.h"
+#include "phase-stats.h"
+
+#define HEAP_CHUNK     (1 << 20)      // without a collector
+#define NURSERY_SIZE   (1 << 20)
+#define OLD_MIN        (4 << 20)
+#define LOCALS_SIZE    (256 << 10)
+#define FORWARDED      -1             // class id of an object that was copied
+#define POISON         0xdb
+
+static void *xmalloc(size_t size)
+{
+  void *p = malloc(size);
+  if (p == NULL) {
+    fprintf(stderr, "Out of memory.\n");
+    exit(1);
+  }
+  return p;
+}
+
+static double now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool has_fields(int class_id)
+{
+  return class_id != CLASS_INT && class_id != CLASS_BOOL && class_id != CLASS_STRING;
+}
+
+Heap::Heap()
+  : stack(NULL), stack_top(NULL), class_count(0),
+    nursery_base(NULL), nursery_next(NULL), nursery_size(0),
+    old_base(NULL), old_next(NULL), old_size(0),
+    locals_base(NULL), locals_next(NULL), locals_size(LOCALS_SIZE),
+    from_base(NULL), from_size(0), scan(NULL),
+    minor_count(0), major_count(0), pause_total(0), pause_max(0),
+    bytes_allocated(0), bytes_promoted(0), bytes_local(0),
+    nursery_collected(0), old_collected(0), old_survived(0)
+{
+  locals_base = locals_next = (char *) xmalloc(locals_size);
+  if (cgen_Memmgr == GC_NOGC)
+    return;
+  if (cgen_Memmgr == GC_GENGC) {
+    nursery_size = NURSERY_SIZE;
+    nursery_base = nursery_next = (char *) xmalloc(nursery_size);
+  }
+  old_size = OLD_MIN;
+  old_base = old_next = (char *) xmalloc(old_size);
+  remembered_bits.assign(old_size / 8 / (8 * sizeof(unsigned long)) + 1, 0);
+}
+
+Object *Heap::allocate(int class_id, int length)
+{
+  size_t size = object_size(class_id, length);
+  bytes_allocated += size;
+  if (nursery_size == 0 || size > nursery_size / 4)
+    return allocate_old(class_id, size);
+
+  if (nursery_next + size > nursery_base + nursery_size ||
+      (cgen_Memmgr_Test == GC_TEST && nursery_next > nursery_base)) {
+    if ((size_t) (old_base + old_size - old_next) < (size_t) (nursery_next - nursery_base))
+      major_collection(0);
+    else
+      minor_collection();
+  }
+  Object *o = (Object *) nursery_next;
+  nursery_next += size;
+  memset(o, 0, size);
+  return o;
+}
+
+Object *Heap::allocate_old(int class_id, size_t size)
+{
+  if (old_next + size > old_base + old_size ||
+      (cgen_Memmgr_Test == GC_TEST && cgen_Memmgr != GC_NOGC)) {
+    if (cgen_Memmgr == GC_NOGC) {
+      old_size = size > HEAP_CHUNK ? size : HEAP_CHUNK;
+      old_base = old_next = (char *) xmalloc(old_size);
+    } else {
+      major_collection(size);
+    }
+  }
+  Object *o = (Object *) old_next;
+  old_next += size;
+  memset(o, 0, size);
+
+  // Its fields are about to be filled in without a write barrier.
+  if (nursery_size && has_fields(class_id))
+    remember(o);
+  return o;
+}
+
+Object *Heap::allocate_local(int class_id, int length)
+{
+  size_t size = object_size(class_id, length);
+  if (locals_next + size > locals_base + locals_size)
+    return allocate(class_id, length);
+  bytes_local += size;
+  Object *o = (Object *) locals_next;
+  locals_next += size;
+  memset(o, 0, size);
+  return o;
+}
+
+void Heap::release_locals(char *mark)
+{
+  if (cgen_Memmgr_Debug == GC_DEBUG)
+    memset(mark, POISON, locals_next - mark);
+  locals_next = mark;
+}
+
+void Heap::remember(Object *o)
+{
+  size_t bit = ((char *) o - old_base) / 8;
+  unsigned long mask = 1UL << (bit % (8 * sizeof(unsigned long)));
+  unsigned long &word = remembered_bits[bit / (8 * sizeof(unsigned long))];
+  if (word & mask)
+    return;
+  word |= mask;
+  remembered.push_back(o);
+}
+
+//
+// Copies the object *slot points to into the old space, unless it is
+// not being collected or has been copied already, and makes *slot point
+// to the copy.  A copied object keeps a pointer to its copy in its
+// first word after the header.  An unboxed Int or Bool is left alone.
+//
+void Heap::forward(Object **slot, bool major)
+{
+  Object *p = *slot;
+  if (is_tagged(p))
+    return;
+  if ((size_t) ((char *) p - nursery_base) >= nursery_size &&
+      !(major && (size_t) ((char *) p - from_base) < from_size))
+    return;
+  if (p->class_id == FORWARDED) {
+    *slot = p->fields()[0];
+    return;
+  }
+  size_t size = object_size(p->class_id, p->length);
+  Object *copy = (Object *) old_next;
+  old_next += size;
+  memcpy(copy, p, size);
+  p->class_id = FORWARDED;
+  p->fields()[0] = copy;
+  *slot = copy;
+}
+
+void Heap::scan_object(Object *o, bool major)
+{
+  if (!has_fields(o->class_id))
+    return;
+  for (int i = 0; i < o->length; i++)
+    forward(&o->fields()[i], major);
+}
+
+void Heap::scan_locals(bool major)
+{
+  for (char *p = locals_base; p < locals_next; ) {
+    Object *o = (Object *) p;
+    p += object_size(o->class_id, o->length);
+    scan_object(o, major);
+  }
+}
+
+void Heap::minor_collection()
+{
+  double start = now_ms();
+  size_t used = nursery_next - nursery_base;
+  char *promoted = old_next;
+
+  scan = old_next;
+  for (Object **p = stack; p < stack_top; p++)
+    forward(p, false);
+  scan_locals(false);
+  for (size_t i = 0; i < remembered.size(); i++) {
+    Object *o = remembered[i];
+    scan_object(o, false);
+    size_t bit = ((char *) o - old_base) / 8;
+    remembered_bits[bit / (8 * sizeof(unsigned long))] &=
+      ~(1UL << (bit % (8 * sizeof(unsigned long))));
+  }
+  remembered.clear();
+  while (scan < old_next) {
+    Object *o = (Object *) scan;
+    scan += object_size(o->class_id, o->length);
+    scan_object(o, false);
+  }
+
+  nursery_next = nursery_base;
+  if (cgen_Memmgr_Debug == GC_DEBUG) {
+    memset(nursery_base, POISON, nursery_size);
+    verify("minor");
+  }
+
+  minor_count++;
+  nursery_collected += used;
+  bytes_promoted += old_next - promoted;
+  double pause = now_ms() - start;
+  pause_total += pause;
+  if (pause > pause_max)
+    pause_max = pause;
+}
+
+//
+// The new old space is twice as large as everything that could
+// survive, so that the collections after it have room to promote into.
+//
+void Heap::major_collection(size_t need)
+{
+  double start = now_ms();
+  size_t occupied = (old_next - old_base) + (nursery_next - nursery_base);
+  size_t size = 2 * occupied + need;
+  if (size < OLD_MIN)
+    size = OLD_MIN;
+
+  from_base = old_base;
+  from_size = old_size;
+  old_base = old_next = (char *) xmalloc(size);
+  old_size = size;
+
+  scan = old_next;
+  for (Object **p = stack; p < stack_top; p++)
+    forward(p, true);
+  scan_locals(true);
+  while (scan < old_next) {
+    Object *o = (Object *) scan;
+    scan += object_size(o->class_id, o->length);
+    scan_object(o, true);
+  }
+
+  remembered.clear();
+  remembered_bits.assign(old_size / 8 / (8 * sizeof(unsigned long)) + 1, 0);
+  nursery_next = nursery_base;
+  if (cgen_Memmgr_Debug == GC_DEBUG) {
+    memset(from_base, POISON, from_size);
+    memset(nursery_base, POISON, nursery_size);
+    verify("major");
+  }
+  free(from_base);
+  from_base = NULL;
+  from_size = 0;
+
+  major_count++;
+  old_collected += occupied;
+  old_survived += old_next - old_base;
+  double pause = now_ms() - start;
+  pause_total += pause;
+  if (pause > pause_max)
+    pause_max = pause;
+}
+
+//
+// For -T: after a collection every root and every field of an old or
+// local object must be void, an unboxed value, an object outside the heap (a constant or a
+// class name), or the start of an object in the old space.
+//
+void Heap::verify(const char *when)
+{
+  std::vector<bool> starts((old_next - old_base) / 8 + 1);
+  for (char *p = old_base; p < old_next; ) {
+    Object *o = (Object *) p;
+    if (o->class_id < 0 || o->class_id >= class_count) {
+      fprintf(stderr, "gc: bad class id %d at old+%ld after %s collection\n",
+	      o->class_id, (long) (p - old_base), when);
+      abort();
+    }
+    starts[(p - old_base) / 8] = true;
+    p += object_size(o->class_id, o->length);
+  }
+
+  std::vector<Object **> slots;
+  for (Object **p = stack; p < stack_top; p++)
+    slots.push_back(p);
+  for (char *p = old_base; p < old_next; ) {
+    Object *o = (Object *) p;
+    if (has_fields(o->class_id))
+      for (int i = 0; i < o->length; i++)
+	slots.push_back(&o->fields()[i]);
+    p += object_size(o->class_id, o->length);
+  }
+  for (char *p = locals_base; p < locals_next; ) {
+    Object *o = (Object *) p;
+    if (has_fields(o->class_id))
+      for (int i = 0; i < o->length; i++)
+	slots.push_back(&o->fields()[i]);
+    p += object_size(o->class_id, o->length);
+  }
+  for (size_t i = 0; i < slots.size(); i++) {
+    char *p = (char *) *slots[i];
+    bool ok;
+    if (is_tagged(*slots[i]))
+      ok = true;
+    else if ((size_t) (p - old_base) < old_size)
+      ok = p < old_next && starts[(p - old_base) / 8];
+    else
+      ok = (size_t) (p - nursery_base) >= nursery_size &&
+	   (size_t) (p - from_base) >= from_size;
+    if (!ok) {
+      fprintf(stderr, "gc: stale pointer %p after %s collection\n", p, when);
+      abort();
+    }
+  }
+}
+
+void Heap::report()
+{
+  const char *collector = cgen_Memmgr == GC_GENGC ? "generational" : "none";
+  char line[768];
+  snprintf(line, sizeof(line),
+      "{\"pid\": %d, \"phase\": \"gc\", \"collector\": \"%s\", "
+      "\"minor_collections\": %ld, \"major_collections\": %ld, "
+      "\"pause_ms_total\": %.3f, \"pause_ms_max\": %.3f, "
+      "\"bytes_allocated\": %ld, \"bytes_promoted\": %ld, "
+      "\"nursery_survival\": %.4f, \"major_survival\": %.4f, "
+      "\"bytes_local\": %ld, \"old_bytes\": %ld}\n",
+      (int) getpid(), collector, minor_count, major_count,
+      pause_total, pause_max, bytes_allocated, bytes_promoted,
+      nursery_collected ? (double) bytes_promoted / nursery_collected : 0.0,
+      old_collected ? (double) old_survived / old_collected : 0.0,
+      bytes_local, (long) (old_next - old_base));
+  write_phase_record(line);
+}
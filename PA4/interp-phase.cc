@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  interp-phase.cc
+//
+//  Runs a Cool program without cgen and SPIM.  Reads the AST written
+//  by the parser, checks it with program_class::semant(), compiles it
+//  to bytecode and runs it (see interp.h):
+//
+//      lexer prog.cl | parser | interp
+//      lexer prog.cl | parser > prog.ast; interp prog.ast < input
+//
+//  The second form leaves standard input to the program.  With -c the
+//  bytecode is listed on stderr before it runs.  -g, -t and -T choose
+//  and test the garbage collector (see interp-gc.cc).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <unistd.h>
+#include "cool-tree.h"
+#include "interp.h"
+#include "optimize.h"
+#include "phase-stats.h"
+#include "trace.h"
+
+extern Program ast_root;      // root of the abstract syntax tree
+FILE *ast_file = stdin;       // we read the AST from standard input
+extern int ast_yyparse(void); // entry point to the AST parser
+
+int cool_yydebug;     // not used, but needed to link with handle_flags
+char *curr_filename;
+
+extern int cgen_debug;
+extern int cgen_optimize;
+extern char *spans_path;      // -X: the parser's spans of the nodes
+void handle_flags(int argc, char *argv[]);
+
+int main(int argc, char *argv[]) {
+  handle_flags(argc,argv);
+  if (optind < argc) {
+    ast_file = fopen(argv[optind], "r");
+    if (ast_file == NULL) {
+      perror(argv[optind]);
+      exit(1);
+    }
+  }
+
+  PhaseTimer parse_timer("parse-ast");
+  {
+    TRACE_SCOPE("parse-ast", "parse-ast");
+    if (spans_path)
+      span_read_open(spans_path);
+    ast_yyparse();
+    if (spans_path)
+      span_read_close();
+  }
+  parse_timer.stop();
+
+  PhaseTimer semant_timer("semant");
+  {
+    TRACE_SCOPE("semant", "semant");
+    ast_root->semant();
+  }
+  semant_timer.stop();
+
+  if (cgen_optimize) {
+    PhaseTimer optimize_timer("optimize");
+    Optimizer optimizer(ast_root->get_classtable());
+    {
+      TRACE_SCOPE("optimize", "optimize");
+      optimizer.optimize(ast_root);
+    }
+    optimizer.count(optimize_timer);
+    optimize_timer.stop();
+  }
+
+  Interp interp;
+  PhaseTimer compile_timer("compile");
+  {
+    TRACE_SCOPE("compile", "compile");
+    interp.load(ast_root);
+  }
+  compile_timer.stop();
+  if (cgen_debug)
+    interp.disassemble(cerr);
+
+  PhaseTimer run_timer("run");
+  int status;
+  {
+    TRACE_SCOPE("run", "run");
+    status = interp.run();
+  }
+  run_timer.stop();
+  interp.report_inline_caches();
+  interp.heap.report();
+  return status;
+}
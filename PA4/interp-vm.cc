@@ -0,0 +1,723 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  interp-vm.cc
+//
+//  Runs the bytecode built by interp-compile.cc (see interp.h), and
+//  implements the methods of the basic classes.  Constants and class
+//  names are allocated once, outside the heap; everything the program
+//  creates comes from the heap (interp-gc.cc).  Anything that can
+//  allocate may move objects, so the interpreter stores its stack
+//  pointer in heap.stack_top first, and afterwards reads objects from
+//  the stack again.
+//
+//  Runtime errors are reported on stderr as file:line: message and end
+//  the program with exit status 1.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "interp.h"
+#include "phase-stats.h"
+
+#define STACK_SLOTS  (8 << 20)
+
+extern int cgen_optimize;
+
+const char *opcode_names[NUM_OPCODES] = {
+#define OPCODE_NAME(op, n) #op,
+  OPCODES(OPCODE_NAME)
+#undef OPCODE_NAME
+};
+
+const int opcode_operands[NUM_OPCODES] = {
+#define OPCODE_OPERANDS(op, n) n,
+  OPCODES(OPCODE_OPERANDS)
+#undef OPCODE_OPERANDS
+};
+
+static void **threaded_labels;     // label of each opcode, from execute()
+
+struct Frame {
+  long *pc;
+  Object **fp;
+  Method *method;
+};
+
+//////////////////////////////////////////////////////////////////////
+//
+// Objects
+//
+//////////////////////////////////////////////////////////////////////
+
+Interp::Interp()
+  : unboxed(cgen_optimize), boot(NULL), stack(NULL), stack_limit(NULL)
+{
+  false_obj = allocate(CLASS_BOOL, 0, sizeof(int), true);
+  false_obj->int_val() = 0;
+  true_obj = allocate(CLASS_BOOL, 0, sizeof(int), true);
+  true_obj->int_val() = 1;
+  constants.push_back(false_obj);      // bool_constant(false)
+  constants.push_back(true_obj);       // bool_constant(true)
+}
+
+//
+// Static objects (constants and class names) live as long as the
+// program and are allocated with calloc.
+//
+Object *Interp::allocate(int class_id, int length, size_t bytes, bool is_static)
+{
+  Object *o;
+  if (is_static) {
+    size_t size = (sizeof(Object) + bytes + 7) & ~(size_t) 7;
+    o = (Object *) calloc(1, size);
+  } else {
+    o = heap.allocate(class_id, length);
+  }
+  o->class_id = class_id;
+  o->length = length;
+  return o;
+}
+
+Object *Interp::make_int(int val)
+{
+  Object *o = allocate(CLASS_INT, 0, sizeof(int), false);
+  o->int_val() = val;
+  return o;
+}
+
+Object *Interp::make_string(const char *s, int len)
+{
+  Object *o = allocate(CLASS_STRING, len, len + 1, false);
+  if (s)
+    memcpy(o->chars(), s, len);
+  o->chars()[len] = '\0';
+  return o;
+}
+
+Object *Interp::make_static_string(const char *s)
+{
+  int len = strlen(s);
+  Object *o = allocate(CLASS_STRING, len, len + 1, true);
+  memcpy(o->chars(), s, len + 1);
+  return o;
+}
+
+//
+// A new object of a basic class is its default value; the others
+// start with their attributes' defaults and are then initialized by
+// their init method.  A local object goes on the heap's local stack.
+//
+Object *Interp::make_object(int class_id, bool local)
+{
+  switch (class_id) {
+  case CLASS_INT:    return make_int(0);
+  case CLASS_BOOL:   return false_obj;
+  case CLASS_STRING: return make_string("", 0);
+  }
+  RuntimeClass *c = classes[class_id];
+  int n = c->attr_names.size();
+  Object *o;
+  if (local) {
+    o = heap.allocate_local(class_id, n);
+    o->class_id = class_id;
+    o->length = n;
+  } else {
+    o = allocate(class_id, n, n * sizeof(Object *), false);
+  }
+  for (int i = 0; i < n; i++)
+    o->fields()[i] = c->attr_defaults[i];
+  return o;
+}
+
+// The object is passed by the slot that holds it, since allocating the
+// copy can move it.
+Object *Interp::copy_object(Object **slot)
+{
+  Object *o = *slot;
+  Object *copy = allocate(o->class_id, o->length, 0, false);
+  o = *slot;
+  memcpy(copy + 1, o + 1, object_size(o->class_id, o->length) - sizeof(Object));
+  return copy;
+}
+
+void Interp::runtime_error(Symbol filename, int line, const char *msg)
+{
+  fflush(stdout);
+  if (filename)
+    fprintf(stderr, "%s:%d: %s\n", filename->get_string(), line, msg);
+  else
+    fprintf(stderr, "%s\n", msg);
+  exit(1);
+}
+
+static bool equal_objects(Object *a, Object *b)
+{
+  if (a == b)
+    return true;
+  if (a == NULL || b == NULL || a->class_id != b->class_id)
+    return false;
+  switch (a->class_id) {
+  case CLASS_INT:
+  case CLASS_BOOL:
+    return a->int_val() == b->int_val();
+  case CLASS_STRING:
+    return a->length == b->length && memcmp(a->chars(), b->chars(), a->length) == 0;
+  }
+  return false;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Methods of the basic classes
+//
+// A native method gets a pointer to its frame: the arguments, then
+// self.  It must read its arguments from the frame again after
+// allocating.  Int arguments and results go through int_arg and
+// int_result, since they are unboxed under -O.
+//
+//////////////////////////////////////////////////////////////////////
+
+static Object *object_abort(Interp &in, Object **args)
+{
+  fflush(stdout);
+  fprintf(stderr, "Abort called from class %s\n",
+	  in.classes[args[0]->class_id]->name->get_string());
+  exit(1);
+}
+
+static Object *object_type_name(Interp &in, Object **args)
+{
+  return in.classes[args[0]->class_id]->type_name;
+}
+
+static Object *object_copy(Interp &in, Object **args)
+{
+  return in.copy_object(&args[0]);
+}
+
+static Object *io_out_string(Interp &in, Object **args)
+{
+  fwrite(args[0]->chars(), 1, args[0]->length, stdout);
+  return args[1];
+}
+
+static Object *io_out_int(Interp &in, Object **args)
+{
+  printf("%d", in.int_arg(args[0]));
+  return args[1];
+}
+
+// Reads one line of input without its newline.
+static int read_line(char *&buf, size_t &cap)
+{
+  fflush(stdout);
+  int len = 0;
+  int c;
+  while ((c = getchar()) != EOF && c != '\n') {
+    if ((size_t) len + 1 >= cap) {
+      cap = cap ? 2 * cap : 128;
+      buf = (char *) realloc(buf, cap);
+    }
+    buf[len++] = c;
+  }
+  if (buf == NULL)
+    buf = (char *) malloc(cap = 128);
+  buf[len] = '\0';
+  return len;
+}
+
+static char *line_buf;
+static size_t line_cap;
+
+static Object *io_in_string(Interp &in, Object **args)
+{
+  int len = read_line(line_buf, line_cap);
+  return in.make_string(line_buf, len);
+}
+
+static Object *io_in_int(Interp &in, Object **args)
+{
+  read_line(line_buf, line_cap);
+  return in.int_result((int) strtol(line_buf, NULL, 10));
+}
+
+static Object *string_length(Interp &in, Object **args)
+{
+  return in.int_result(args[0]->length);
+}
+
+static Object *string_concat(Interp &in, Object **args)
+{
+  int n1 = args[1]->length, n2 = args[0]->length;
+  Object *r = in.make_string(NULL, n1 + n2);
+  memcpy(r->chars(), args[1]->chars(), n1);
+  memcpy(r->chars() + n1, args[0]->chars(), n2);
+  return r;
+}
+
+static Object *string_substr(Interp &in, Object **args)
+{
+  int i = in.int_arg(args[0]), l = in.int_arg(args[1]);
+  if (i < 0 || l < 0 || i > args[2]->length - l)
+    in.runtime_error(NULL, 0, "Index to substr is out of range.");
+  Object *r = in.make_string(NULL, l);
+  memcpy(r->chars(), args[2]->chars() + i, l);
+  return r;
+}
+
+void Interp::add_natives()
+{
+  static const struct {
+    int class_id;
+    const char *name;
+    NativeFn fn;
+  } natives[] = {
+    { CLASS_OBJECT, "abort",      object_abort },
+    { CLASS_OBJECT, "type_name",  object_type_name },
+    { CLASS_OBJECT, "copy",       object_copy },
+    { CLASS_IO,     "out_string", io_out_string },
+    { CLASS_IO,     "out_int",    io_out_int },
+    { CLASS_IO,     "in_string",  io_in_string },
+    { CLASS_IO,     "in_int",     io_in_int },
+    { CLASS_STRING, "length",     string_length },
+    { CLASS_STRING, "concat",     string_concat },
+    { CLASS_STRING, "substr",     string_substr },
+  };
+  for (size_t i = 0; i < sizeof(natives) / sizeof(natives[0]); i++) {
+    Symbol name = idtable.add_string((char *) natives[i].name);
+    classes[natives[i].class_id]->methods[name]->native = natives[i].fn;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// The interpreter
+//
+//////////////////////////////////////////////////////////////////////
+
+//
+// Replaces the opcode words of a method by the addresses of their
+// labels in execute(), and jump targets by code addresses.
+//
+void Interp::thread_code(Method *m)
+{
+  long *code = m->code.data();
+  for (size_t pc = 0; pc < m->code.size(); ) {
+    int op = code[pc];
+    code[pc] = (long) threaded_labels[op];
+    if (op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_IJUMP_IF_FALSE)
+      code[pc + 1] = (long) (code + code[pc + 1]);
+    pc += 1 + opcode_operands[op];
+  }
+}
+
+int Interp::run()
+{
+  execute(NULL, true);
+  for (size_t i = 0; i < classes.size(); i++) {
+    RuntimeClass *c = classes[i];
+    if (c->init)
+      thread_code(c->init);
+    for (std::map<Symbol, Method *>::iterator it = c->methods.begin();
+	 it != c->methods.end(); ++it)
+      if (!it->second->native)
+	thread_code(it->second);
+  }
+  thread_code(boot);
+
+  stack = (Object **) malloc(STACK_SLOTS * sizeof(Object *));
+  stack_limit = stack + STACK_SLOTS;
+  heap.stack = heap.stack_top = stack;
+  heap.class_count = classes.size();
+  execute(boot, false);
+  fflush(stdout);
+  return 0;
+}
+
+Object *Interp::execute(Method *entry, bool get_labels)
+{
+  static void *labels[NUM_OPCODES] = {
+#define OPCODE_LABEL(op, n) &&L_##op,
+    OPCODES(OPCODE_LABEL)
+#undef OPCODE_LABEL
+  };
+  if (get_labels) {
+    threaded_labels = labels;
+    return NULL;
+  }
+
+  std::vector<Frame> frames;
+  Method *method = entry;
+  long *pc = method->code.data();
+  Object **fp = stack;
+  Object **sp = stack;
+  Object **consts = constants.data();
+  Method *callee;
+  Object *a, *b;
+
+#define NEXT goto *(void *) *pc++
+#define SELF (fp[method->nargs])
+#define BOOL(x) ((x) ? true_obj : false_obj)
+
+  NEXT;
+
+ L_PUSH_CONST:
+  *sp++ = consts[*pc++];
+  NEXT;
+ L_PUSH_VOID:
+  *sp++ = NULL;
+  NEXT;
+ L_PUSH_SELF:
+  *sp++ = SELF;
+  NEXT;
+ L_LOAD_LOCAL:
+  *sp++ = fp[*pc++];
+  NEXT;
+ L_STORE_LOCAL:
+  fp[*pc++] = sp[-1];
+  NEXT;
+ L_LOAD_ATTR:
+  *sp++ = SELF->fields()[*pc++];
+  NEXT;
+ L_STORE_ATTR:
+  a = SELF;
+  a->fields()[*pc++] = sp[-1];
+  heap.write_barrier(a, sp[-1]);
+  NEXT;
+ L_POP:
+  sp--;
+  NEXT;
+ L_MARK_LOCALS:
+  fp[*pc++] = (Object *) heap.locals_mark();
+  NEXT;
+ L_RELEASE_LOCALS:
+  heap.release_locals((char *) fp[*pc++]);
+  NEXT;
+
+  // Int arithmetic wraps around, as it does in the MIPS runtime.
+ L_ADD:
+  sp--;
+  heap.stack_top = sp;
+  sp[-1] = make_int((int) ((unsigned) sp[-1]->int_val() + (unsigned) sp[0]->int_val()));
+  NEXT;
+ L_SUB:
+  sp--;
+  heap.stack_top = sp;
+  sp[-1] = make_int((int) ((unsigned) sp[-1]->int_val() - (unsigned) sp[0]->int_val()));
+  NEXT;
+ L_MUL:
+  sp--;
+  heap.stack_top = sp;
+  sp[-1] = make_int((int) ((unsigned) sp[-1]->int_val() * (unsigned) sp[0]->int_val()));
+  NEXT;
+ L_DIV:
+  sp--;
+  if (sp[0]->int_val() == 0)
+    runtime_error(classes[method->class_id]->filename, *pc, "Division by zero.");
+  pc++;
+  heap.stack_top = sp;
+  sp[-1] = make_int((int) ((long long) sp[-1]->int_val() / sp[0]->int_val()));
+  NEXT;
+ L_NEG:
+  heap.stack_top = sp;
+  sp[-1] = make_int((int) -(unsigned) sp[-1]->int_val());
+  NEXT;
+ L_LT:
+  sp--;
+  sp[-1] = BOOL(sp[-1]->int_val() < sp[0]->int_val());
+  NEXT;
+ L_LEQ:
+  sp--;
+  sp[-1] = BOOL(sp[-1]->int_val() <= sp[0]->int_val());
+  NEXT;
+ L_EQ:
+  sp--;
+  sp[-1] = BOOL(equal_objects(sp[-1], sp[0]));
+  NEXT;
+ L_NOT:
+  sp[-1] = BOOL(!sp[-1]->int_val());
+  NEXT;
+ L_ISVOID:
+  sp[-1] = BOOL(sp[-1] == NULL);
+  NEXT;
+
+ L_JUMP:
+  pc = (long *) *pc;
+  NEXT;
+ L_JUMP_IF_FALSE:
+  if ((*--sp)->int_val())
+    pc++;
+  else
+    pc = (long *) *pc;
+  NEXT;
+
+ L_NEW:
+  heap.stack_top = sp;
+  a = make_object(*pc++);
+  goto new_object;
+ L_NEW_SELF_TYPE:
+  heap.stack_top = sp;
+  a = make_object(SELF->class_id);
+  goto new_object;
+ L_NEW_LOCAL:
+  heap.stack_top = sp;
+  a = make_object(*pc++, true);
+ new_object:
+  *sp++ = a;
+  callee = classes[a->class_id]->init;
+  if (callee == NULL)
+    NEXT;
+  goto call;
+
+ L_DISPATCH: {
+  CallSite &site = call_sites[*pc++];
+  a = sp[-1];
+  if (a == NULL)
+    runtime_error(site.filename, site.line, "Dispatch to void.");
+  int cid = a->class_id;
+  if (site.ic_size > 0 && site.ic_class[0] == cid) {
+    site.hits++;
+    callee = site.ic_method[0];
+    goto call;
+  }
+  for (int i = 1; i < site.ic_size; i++)
+    if (site.ic_class[i] == cid) {
+      site.hits++;
+      callee = site.ic_method[i];
+      goto call;
+    }
+  callee = dispatch_miss(site, cid);
+  goto call;
+ }
+ L_DIRECT_DISPATCH: {
+  CallSite &site = call_sites[*pc++];
+  if (sp[-1] == NULL)
+    runtime_error(site.filename, site.line, "Dispatch to void.");
+  callee = site.target;
+  goto call;
+ }
+ L_STATIC_DISPATCH: {
+  CallSite &site = call_sites[*pc++];
+  if (sp[-1] == NULL)
+    runtime_error(site.filename, site.line, "Static dispatch to void.");
+  callee = site.target;
+  goto call;
+ }
+
+  // The receiver and arguments are on top of the stack and become
+  // the bottom of the callee's frame.
+ call:
+  if (callee->native) {
+    Object **args = sp - (callee->nargs + 1);
+    heap.stack_top = sp;
+    a = callee->native(*this, args);
+    sp = args;
+    *sp++ = a;
+    NEXT;
+  }
+  if (sp + callee->nlocals + callee->code.size() >= stack_limit)
+    runtime_error(NULL, 0, "Stack overflow.");
+  {
+    Frame f = { pc, fp, method };
+    frames.push_back(f);
+  }
+  fp = sp - (callee->nargs + 1);
+  for (int i = 0; i < callee->nlocals; i++)
+    *sp++ = NULL;
+  method = callee;
+  pc = method->code.data();
+  NEXT;
+
+ L_RETURN:
+  a = sp[-1];
+  sp = fp;
+  *sp++ = a;
+  pc = frames.back().pc;
+  fp = frames.back().fp;
+  method = frames.back().method;
+  frames.pop_back();
+  NEXT;
+
+ L_CASE: {
+  CaseSite &site = case_sites[*pc++];
+  a = *--sp;
+  if (a == NULL)
+    runtime_error(site.filename, site.line, "Match on void in case statement.");
+  for (int c = a->class_id; c >= 0; c = classes[c]->parent)
+    for (size_t i = 0; i < site.branches.size(); i++)
+      if (site.branches[i].class_id == c) {
+	fp[site.branches[i].slot] = a;
+	pc = method->code.data() + site.branches[i].target;
+	NEXT;
+      }
+  char msg[256];
+  snprintf(msg, sizeof(msg), "No match in case statement for Class %s.",
+	   classes[a->class_id]->name->get_string());
+  runtime_error(site.filename, site.line, msg);
+ }
+
+ L_HALT:
+  return sp[-1];
+
+  // Unboxed Int and Bool.  Tagging keeps the order of values, so the
+  // words can be compared as they are.
+ L_PUSH_IMM:
+  *sp++ = (Object *) *pc++;
+  NEXT;
+ L_IADD:
+  sp--;
+  sp[-1] = tag_int((int) ((unsigned) untag_int(sp[-1]) + (unsigned) untag_int(sp[0])));
+  NEXT;
+ L_ISUB:
+  sp--;
+  sp[-1] = tag_int((int) ((unsigned) untag_int(sp[-1]) - (unsigned) untag_int(sp[0])));
+  NEXT;
+ L_IMUL:
+  sp--;
+  sp[-1] = tag_int((int) ((unsigned) untag_int(sp[-1]) * (unsigned) untag_int(sp[0])));
+  NEXT;
+ L_IDIV:
+  sp--;
+  if (untag_int(sp[0]) == 0)
+    runtime_error(classes[method->class_id]->filename, *pc, "Division by zero.");
+  pc++;
+  sp[-1] = tag_int((int) ((long long) untag_int(sp[-1]) / untag_int(sp[0])));
+  NEXT;
+ L_INEG:
+  sp[-1] = tag_int((int) -(unsigned) untag_int(sp[-1]));
+  NEXT;
+ L_ILT:
+  sp--;
+  sp[-1] = tag_int((intptr_t) sp[-1] < (intptr_t) sp[0]);
+  NEXT;
+ L_ILEQ:
+  sp--;
+  sp[-1] = tag_int((intptr_t) sp[-1] <= (intptr_t) sp[0]);
+  NEXT;
+ L_IEQ:
+  sp--;
+  sp[-1] = tag_int(sp[-1] == sp[0]);
+  NEXT;
+ L_INOT:
+  sp[-1] = tag_int(sp[-1] == tag_int(0));
+  NEXT;
+ L_IJUMP_IF_FALSE:
+  if (*--sp != tag_int(0))
+    pc++;
+  else
+    pc = (long *) *pc;
+  NEXT;
+ L_BOX_INT:
+  heap.stack_top = sp;
+  sp[-1] = make_int(untag_int(sp[-1]));
+  NEXT;
+ L_BOX_BOOL:
+  sp[-1] = BOOL(sp[-1] != tag_int(0));
+  NEXT;
+ L_UNBOX:
+  sp[-1] = tag_int(sp[-1]->int_val());
+  NEXT;
+
+#undef NEXT
+#undef SELF
+#undef BOOL
+}
+
+//
+// Looks up a method that the inline cache of the site did not have,
+// and adds it to the cache unless the cache is full, in which case the
+// site becomes megamorphic.
+//
+Method *Interp::dispatch_miss(CallSite &site, int class_id)
+{
+  Method *m = lookup(class_id, site.name);
+  if (site.ic_size == IC_MEGAMORPHIC) {
+    site.megamorphic++;
+  } else if (site.ic_size == IC_ENTRIES) {
+    site.ic_size = IC_MEGAMORPHIC;
+    site.megamorphic++;
+  } else {
+    site.ic_class[site.ic_size] = class_id;
+    site.ic_method[site.ic_size] = m;
+    site.ic_size++;
+    site.misses++;
+  }
+  return m;
+}
+
+//
+// Appends the inline cache counters to the -P file: how many dynamic
+// dispatch sites ended up in each state, and the calls made through
+// them.
+//
+void Interp::report_inline_caches()
+{
+  long unused = 0, mono = 0, poly = 0, mega = 0;
+  long hits = 0, misses = 0, megamorphic = 0;
+  for (size_t i = 0; i < call_sites.size(); i++) {
+    CallSite &s = call_sites[i];
+    if (s.target)
+      continue;
+    if (s.ic_size == 0)
+      unused++;
+    else if (s.ic_size == 1)
+      mono++;
+    else if (s.ic_size == IC_MEGAMORPHIC)
+      mega++;
+    else
+      poly++;
+    hits += s.hits;
+    misses += s.misses;
+    megamorphic += s.megamorphic;
+  }
+
+  char line[512];
+  snprintf(line, sizeof(line),
+      "{\"pid\": %d, \"phase\": \"inline-caches\", \"sites_unused\": %ld, "
+      "\"sites_monomorphic\": %ld, \"sites_polymorphic\": %ld, "
+      "\"sites_megamorphic\": %ld, \"hits\": %ld, \"misses\": %ld, "
+      "\"megamorphic_calls\": %ld}\n",
+      (int) getpid(), unused, mono, poly, mega, hits, misses, megamorphic);
+  write_phase_record(line);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Listing, for -c
+//
+//////////////////////////////////////////////////////////////////////
+
+static void disassemble_method(Interp &in, ostream &out, const char *cls, Method *m)
+{
+  out << cls << "." << m->name << " (" << m->nargs << " args, "
+      << m->nlocals << " locals)" << endl;
+  for (size_t pc = 0; pc < m->code.size(); ) {
+    int op = m->code[pc];
+    out << "  " << pc << "\t" << opcode_names[op];
+    for (int i = 1; i <= opcode_operands[op]; i++)
+      out << " " << m->code[pc + i];
+    if (op == OP_DISPATCH || op == OP_STATIC_DISPATCH || op == OP_DIRECT_DISPATCH)
+      out << "\t; " << in.call_sites[m->code[pc + 1]].name;
+    if (op == OP_NEW || op == OP_NEW_LOCAL)
+      out << "\t; " << in.classes[m->code[pc + 1]]->name;
+    if (op == OP_PUSH_IMM)
+      out << "\t; " << untag_int((Object *) m->code[pc + 1]);
+    out << endl;
+    pc += 1 + opcode_operands[op];
+  }
+}
+
+void Interp::disassemble(ostream &out)
+{
+  for (size_t i = NUM_BASIC_CLASSES; i < classes.size(); i++) {
+    RuntimeClass *c = classes[i];
+    if (c->init)
+      disassemble_method(*this, out, c->name->get_string(), c->init);
+    for (std::map<Symbol, Method *>::iterator it = c->methods.begin();
+	 it != c->methods.end(); ++it)
+      disassemble_method(*this, out, c->name->get_string(), it->second);
+  }
+}
@@ -0,0 +1,362 @@
+#ifndef INTERP_H_
+#define INTERP_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  interp.h
+//
+//  A bytecode compiler and interpreter for type-checked Cool programs.
+//
+//  interp-compile.cc lowers each method of the program checked by
+//  program_class::semant() to code for a stack machine, and
+//  interp-vm.cc runs it.  Each instruction is an opcode word followed
+//  by its operands.  Before the program runs, the opcode words are
+//  replaced by the addresses of the labels that implement them
+//  (direct threading), so every instruction ends with one indirect
+//  jump to the next one.
+//
+//  A method's frame lives on the value stack.  The caller pushes the
+//  arguments and then the receiver, which is the order in which Cool
+//  evaluates them, so in the callee argument i is slot i, self is slot
+//  nargs, and the let and case variables follow.  The operand stack
+//  grows above the variables.
+//
+//  Objects are boxed, Int and Bool included.  Bool values are the two
+//  objects true_obj and false_obj.  Objects are allocated from a heap
+//  that may move them (see Heap).
+//
+//  With -O a value whose static type is Int or Bool is not boxed: the
+//  word that would point to it holds the value shifted left one bit,
+//  with the low bit set (tag_int), which no pointer to an object has.
+//  Variables, attributes, formals and method results declared Int or
+//  Bool hold such words, and arithmetic on them allocates nothing.
+//  The compiler boxes a value where it flows into a place of another
+//  type (Object, or the receiver of a dispatch) and unboxes it where a
+//  boxed one flows into an Int or Bool place (a case branch, or copy
+//  returning SELF_TYPE), so the representation of every word follows
+//  from the static type of what it holds.
+//
+//  Dynamic dispatch goes through an inline cache in the call site: the
+//  methods found for the last few receiver classes, keyed by class id.
+//  A site that has seen one class is monomorphic and is checked with
+//  one comparison; one that has seen up to IC_ENTRIES classes is
+//  polymorphic.  A site that sees more is megamorphic: its cache is
+//  dropped and every call looks the method up through the classes'
+//  method tables, starting at the class of the receiver.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include "cool-tree.h"
+#include "semant.h"
+
+// Ids of the basic classes; user classes follow.
+enum {
+  CLASS_OBJECT, CLASS_IO, CLASS_INT, CLASS_BOOL, CLASS_STRING, NUM_BASIC_CLASSES
+};
+
+// Every object starts with this header.  An ordinary object is
+// followed by its attributes, an Int or Bool by its value, and a String
+// by its characters and a terminating NUL.
+struct Object {
+  int class_id;
+  int length;           // attributes, or characters of a String
+
+  Object **fields()  { return (Object **) (this + 1); }
+  int &int_val()     { return *(int *) (this + 1); }
+  char *chars()      { return (char *) (this + 1); }
+};
+
+// Bytes taken by an object, rounded up to 8.  An object is at least 16
+// bytes, so that a collector can put a forwarding pointer in it.
+inline size_t object_size(int class_id, int length)
+{
+  size_t bytes;
+  if (class_id == CLASS_STRING)
+    bytes = length + 1;
+  else if (class_id == CLASS_INT || class_id == CLASS_BOOL)
+    bytes = sizeof(int);
+  else
+    bytes = length * sizeof(Object *);
+  size_t size = (sizeof(Object) + bytes + 7) & ~(size_t) 7;
+  return size < 16 ? 16 : size;
+}
+
+// Unboxed Int and Bool values (-O).  Bool false and true are 0 and 1.
+inline Object *tag_int(int v)   { return (Object *) (((uintptr_t) (intptr_t) v << 1) | 1); }
+inline int untag_int(Object *o) { return (int) ((intptr_t) o >> 1); }
+inline bool is_tagged(Object *o) { return (uintptr_t) o & 1; }
+
+// The opcodes and the number of operand words each one takes.
+#define OPCODES(X)                                                      \
+  X(PUSH_CONST, 1)      /* constant index */                            \
+  X(PUSH_VOID, 0)                                                       \
+  X(PUSH_SELF, 0)                                                       \
+  X(LOAD_LOCAL, 1)      /* slot */                                      \
+  X(STORE_LOCAL, 1)     /* slot; leaves the value on the stack */       \
+  X(LOAD_ATTR, 1)       /* attribute index in self */                   \
+  X(STORE_ATTR, 1)      /* attribute index; leaves the value */         \
+  X(POP, 0)                                                             \
+  X(ADD, 0)                                                             \
+  X(SUB, 0)                                                             \
+  X(MUL, 0)                                                             \
+  X(DIV, 1)             /* line */                                      \
+  X(NEG, 0)                                                             \
+  X(LT, 0)                                                              \
+  X(LEQ, 0)                                                             \
+  X(EQ, 0)                                                              \
+  X(NOT, 0)                                                             \
+  X(ISVOID, 0)                                                          \
+  X(JUMP, 1)            /* target */                                    \
+  X(JUMP_IF_FALSE, 1)   /* target */                                    \
+  X(NEW, 1)             /* class id */                                  \
+  X(NEW_SELF_TYPE, 0)                                                   \
+  X(NEW_LOCAL, 1)       /* class id; on the heap's local stack */       \
+  X(MARK_LOCALS, 1)     /* slot to save the local stack's top in */     \
+  X(RELEASE_LOCALS, 1)  /* slot it was saved in */                      \
+  X(DISPATCH, 1)        /* call site */                                 \
+  X(STATIC_DISPATCH, 1) /* call site */                                 \
+  X(DIRECT_DISPATCH, 1) /* call site bound by -O */                      \
+  X(CASE, 1)            /* case site */                                 \
+  X(RETURN, 0)                                                          \
+  X(HALT, 0)                                                            \
+  /* The same operations on unboxed Int and Bool values (-O). */        \
+  X(PUSH_IMM, 1)        /* tagged value */                              \
+  X(IADD, 0)                                                            \
+  X(ISUB, 0)                                                            \
+  X(IMUL, 0)                                                            \
+  X(IDIV, 1)            /* line */                                      \
+  X(INEG, 0)                                                            \
+  X(ILT, 0)                                                             \
+  X(ILEQ, 0)                                                            \
+  X(IEQ, 0)                                                             \
+  X(INOT, 0)                                                            \
+  X(IJUMP_IF_FALSE, 1)  /* target */                                    \
+  X(BOX_INT, 0)                                                         \
+  X(BOX_BOOL, 0)                                                        \
+  X(UNBOX, 0)           /* an Int or Bool object */
+
+enum Opcode {
+#define OPCODE_ENUM(op, n) OP_##op,
+  OPCODES(OPCODE_ENUM)
+#undef OPCODE_ENUM
+  NUM_OPCODES
+};
+
+extern const char *opcode_names[NUM_OPCODES];
+extern const int opcode_operands[NUM_OPCODES];
+
+class Interp;
+struct Method;
+typedef Object *(*NativeFn)(Interp &, Object **args);
+
+struct Method {
+  Symbol name;
+  int class_id;             // class that defines it
+  int nargs;
+  std::vector<Symbol> formal_types;
+  Symbol return_type;
+  int nlocals;              // let and case variables
+  NativeFn native;          // for the methods of the basic classes
+  std::vector<long> code;
+
+  Method(Symbol n, int c, int a)
+    : name(n), class_id(c), nargs(a), return_type(NULL), nlocals(0),
+      native(NULL) { }
+};
+
+struct RuntimeClass {
+  Symbol name;
+  int id;
+  int parent;                           // -1 for Object
+  Symbol filename;
+  std::vector<Symbol> attr_names;       // inherited attributes first
+  std::vector<Symbol> attr_types;
+  std::vector<Object *> attr_defaults;  // 0, false, "" or void
+  std::map<Symbol, Method *> methods;   // methods defined in this class
+  Method *init;                         // NULL when there is nothing to do
+  Object *type_name;                    // the class name as a String
+};
+
+#define IC_ENTRIES 4
+#define IC_MEGAMORPHIC -1
+
+// A dispatch.  Static dispatches are bound when they are compiled.
+struct CallSite {
+  Symbol name;
+  int nargs;
+  int line;
+  Method *target;           // static and direct dispatch only
+  Symbol filename;
+
+  // Inline cache of a dynamic dispatch.
+  int ic_size;              // entries in use, or IC_MEGAMORPHIC
+  int ic_class[IC_ENTRIES];
+  Method *ic_method[IC_ENTRIES];
+  long hits;                // calls that found the receiver class cached
+  long misses;              // calls that had to add it
+  long megamorphic;         // calls after the cache overflowed
+};
+
+// The heap of the running program (interp-gc.cc).  Which collector it
+// uses is chosen by cgen_Memmgr: none, or a generational collector
+// with a bump-allocated nursery and a copying old generation (-g).
+// The roots are the value stack from stack to stack_top, which the
+// interpreter brings up to date before anything that can allocate, so
+// an object pointer held anywhere else is stale after an allocation.
+// Constants and class names are allocated outside the heap and hold
+// no pointers.
+//
+// Objects that -O found do not escape (see escape.cc) are allocated
+// by allocate_local on a stack of their own, which the interpreter
+// cuts back when the let or dispatch that made them ends.  They are
+// never moved, and their fields are roots.
+class Heap {
+public:
+  Object **stack, **stack_top;
+  int class_count;                  // for checking the heap
+
+  Heap();
+  Object *allocate(int class_id, int length);
+  Object *allocate_local(int class_id, int length);
+  char *locals_mark() { return locals_next; }
+  void release_locals(char *mark);
+  void report();
+
+  // Must follow every store of v into a field of o, so that the old
+  // objects that point into the nursery are roots of a minor collection.
+  void write_barrier(Object *o, Object *v) {
+    if ((size_t) ((char *) o - old_base) < old_size &&
+        (size_t) ((char *) v - nursery_base) < nursery_size)
+      remember(o);
+  }
+
+private:
+  char *nursery_base, *nursery_next;
+  size_t nursery_size;
+  char *old_base, *old_next;
+  size_t old_size;
+  std::vector<unsigned long> remembered_bits;  // one bit per 8 old bytes
+  std::vector<Object *> remembered;
+  char *locals_base, *locals_next;
+  size_t locals_size;
+  char *from_base;                  // the old space being evacuated
+  size_t from_size;
+  char *scan;
+
+  // Statistics for report().
+  long minor_count, major_count;
+  double pause_total, pause_max;    // milliseconds
+  long bytes_allocated, bytes_promoted, bytes_local;
+  long nursery_collected, old_collected, old_survived;
+
+  Object *allocate_old(int class_id, size_t size);
+  void remember(Object *o);
+  void minor_collection();
+  void major_collection(size_t need);
+  void forward(Object **slot, bool major);
+  void scan_object(Object *o, bool major);
+  void scan_locals(bool major);
+  void verify(const char *when);
+};
+
+struct CaseBranch {
+  int class_id;
+  int slot;
+  int target;
+};
+
+struct CaseSite {
+  int line;
+  Symbol filename;
+  std::vector<CaseBranch> branches;
+};
+
+class Interp {
+public:
+  std::vector<RuntimeClass *> classes;
+  std::map<Symbol, int> class_ids;
+  std::vector<Object *> constants;
+  std::vector<CallSite> call_sites;
+  std::vector<CaseSite> case_sites;
+  std::map<Symbol, int> int_consts, string_consts;
+  Object *true_obj, *false_obj;
+  bool unboxed;                 // Int and Bool are unboxed (-O)
+
+  Interp();
+  void load(Program program);
+  int run();
+  void disassemble(ostream &out);
+  void report_inline_caches();
+
+  // Helpers for the compiler and the native methods.
+  Method *lookup(int class_id, Symbol name);
+  int int_constant(Symbol token);
+  int string_constant(Symbol token);
+  int bool_constant(bool b) { return b ? 1 : 0; }
+  Object *make_int(int val);
+  int int_arg(Object *o) { return unboxed ? untag_int(o) : o->int_val(); }
+  Object *int_result(int val) { return unboxed ? tag_int(val) : make_int(val); }
+  Object *make_string(const char *s, int len);
+  Object *make_object(int class_id, bool local = false);
+  Object *make_static_string(const char *s);
+  Object *copy_object(Object **slot);
+  void runtime_error(Symbol filename, int line, const char *msg)
+    __attribute__((noreturn));
+
+  Heap heap;
+
+private:
+  Method *boot;
+  Object **stack, **stack_limit;
+
+  void add_class(ClassTableP ct, Symbol name);
+  void add_natives();
+  void compile_class(RuntimeClass *c, ClassTableP ct);
+  void thread_code(Method *m);
+  Object *allocate(int class_id, int length, size_t bytes, bool is_static);
+  Object *execute(Method *entry, bool get_labels);
+  Method *dispatch_miss(CallSite &site, int class_id);
+};
+
+// Compilation state of one method.
+class Compiler {
+public:
+  Interp &interp;
+  RuntimeClass *cls;
+  Method *method;
+
+  Compiler(Interp &i, RuntimeClass *c, Method *m)
+    : interp(i), cls(c), method(m), nvars(0) { }
+
+  void emit(Opcode op) { method->code.push_back(op); }
+  void emit(Opcode op, long arg) { emit(op); method->code.push_back(arg); }
+  int here() { return method->code.size(); }
+  void patch(int at, int target) { method->code[at] = target; }
+
+  int call_site(Symbol name, int nargs, int line, Method *target);
+  void bind_formal(Symbol name, int slot, Symbol type)
+    { scope.push_back(Binding(name, slot, type)); }
+  int bind(Symbol name, Symbol type);   // a new let or case variable
+  void unbind();
+  void load(Symbol name);
+  void store(Symbol name);
+  Symbol type_of(Symbol name);
+  void push_default(Symbol type);
+  bool unboxed(Symbol type);
+  void coerce(Symbol from, Symbol to);
+
+private:
+  struct Binding {
+    Symbol name;
+    int slot;
+    Symbol type;
+    Binding(Symbol n, int s, Symbol t) : name(n), slot(s), type(t) { }
+  };
+  std::vector<Binding> scope;
+  int nvars;
+};
+
+#endif
@@ -0,0 +1,731 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  optimize.cc
+//
+//  The -O optimizations of the typed AST (see optimize.h).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <limits.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "optimize.h"
+#include "int-const.h"
+#include "hashcons.h"
+
+#define INLINE_DEPTH 8        // methods inlined into each other at most
+
+extern int node_lineno;       // line of the nodes being built
+
+static Symbol Int_sym, Bool_sym, SELF_TYPE_sym, Object_sym, self_sym;
+
+Optimizer::Optimizer(ClassTableP ct)
+  : classtable(ct), folded(0), simplified(0), branches_removed(0),
+    exprs_removed(0), dispatches(0), devirtualized(0), inlined(0),
+    stack_allocated(0), curr_class(NULL)
+{
+  Int_sym       = idtable.add_string("Int");
+  Bool_sym      = idtable.add_string("Bool");
+  SELF_TYPE_sym = idtable.add_string("SELF_TYPE");
+  Object_sym    = idtable.add_string("Object");
+  self_sym      = idtable.add_string("self");
+  for (int i = idtable.first(); idtable.more(i); i = idtable.next(i))
+    identifiers.insert(idtable.lookup(i)->get_string());
+}
+
+void Optimizer::optimize(Program program)
+{
+  analyze_hierarchy();
+  for (int i = 0; i < classtable->class_count(); i++) {
+    Class_ c = classtable->class_at(i);
+    curr_class = c->get_name();
+    Features fs = c->get_features();
+    for (int j = fs->first(); fs->more(j); j = fs->next(j))
+      fs->nth(j)->optimize(*this);
+  }
+}
+
+void Optimizer::count(PhaseTimer &timer)
+{
+  timer.count("folded", folded);
+  timer.count("simplified", simplified);
+  timer.count("branches_removed", branches_removed);
+  timer.count("exprs_removed", exprs_removed);
+  timer.count("dispatches", dispatches);
+  timer.count("devirtualized", devirtualized);
+  timer.count("inlined", inlined);
+  timer.count("stack_allocated", stack_allocated);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Class hierarchy analysis
+//
+//////////////////////////////////////////////////////////////////////
+
+//
+// Each method a class defines is overridden in every ancestor of the
+// class that has it too; marking it in all the ancestors is simpler
+// and no slower than checking which ones have it.
+//
+void Optimizer::analyze_hierarchy()
+{
+  for (int i = 0; i < classtable->class_count(); i++) {
+    Class_ c = classtable->class_at(i);
+    Features fs = c->get_features();
+    for (int j = fs->first(); fs->more(j); j = fs->next(j))
+      if (fs->nth(j)->is_method())
+	defined[c->get_name()].insert(fs->nth(j)->get_name());
+  }
+  for (int i = 0; i < classtable->class_count(); i++) {
+    Symbol name = classtable->class_at(i)->get_name();
+    std::set<Symbol> &ms = defined[name];
+    if (ms.empty() || name == Object_sym)
+      continue;
+    for (Symbol a = classtable->parent_of(name); ; a = classtable->parent_of(a)) {
+      overridden[a].insert(ms.begin(), ms.end());
+      if (a == Object_sym)
+	break;
+    }
+  }
+}
+
+//
+// The class whose method name a dispatch on an object of static type
+// type always calls, or NULL if a subclass of type redefines it.
+//
+Symbol Optimizer::bind_method(Symbol type, Symbol name)
+{
+  if (type == SELF_TYPE_sym)
+    type = curr_class;
+  if (overridden[type].count(name))
+    return NULL;
+  for (; ; type = classtable->parent_of(type))
+    if (defined[type].count(name))
+      return type;
+}
+
+//
+// A name that is not used anywhere in the program, for a copy of a
+// formal.
+//
+Symbol Optimizer::fresh_name(Symbol base)
+{
+  char suffix[16];
+  for (int i = 1; ; i++) {
+    snprintf(suffix, sizeof(suffix), "_%d", i);
+    std::string name = std::string(base->get_string()) + suffix;
+    if (identifiers.insert(name).second)
+      return idtable.add_string((char *) name.c_str());
+  }
+}
+
+//
+// A constant with the line and span of the node it replaces.  There
+// is no negative integer token, so a negative value is the negation
+// of a positive one; INT_MIN cannot be written that way and is not
+// folded.
+//
+Expression Optimizer::make_int(int val, Expression at)
+{
+  if (val == INT_MIN)
+    return NULL;
+  node_lineno = at->get_line_number();
+  node_span = at->get_span();
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%d", val < 0 ? -val : val);
+  Expression e = int_const(inttable.add_string(buf))->set_type(Int_sym);
+  if (val < 0)
+    e = neg(e)->set_type(Int_sym);
+  return e;
+}
+
+Expression Optimizer::make_bool(bool val, Expression at)
+{
+  node_lineno = at->get_line_number();
+  node_span = at->get_span();
+  return bool_const(val)->set_type(Bool_sym);
+}
+
+//
+// e, to replace a node of static type type, which can be a proper
+// supertype of e's own.  e takes on the type when that does not change
+// how its value is represented.  An Int or Bool, which the interpreter
+// may keep unboxed, and under -H a closed node, which can stand for
+// other occurrences too, are wrapped instead in a block that carries
+// the type; the block is built directly so -H does not share it.
+//
+Expression Optimizer::retype(Expression e, Symbol type)
+{
+  Symbol t = e->get_type();
+  if (t == type)
+    return e;
+  if (t != Int_sym && t != Bool_sym && !(e->hc_flags & HC_CLOSED))
+    return e->set_type(type);
+  node_lineno = e->get_line_number();
+  node_span = e->get_span();
+  return (new block_class(single_Expressions(e)))->set_type(type);
+}
+
+// Lists cannot be changed in place, so a new one is built if any
+// element changed.
+Expressions Optimizer::optimize_list(Expressions l)
+{
+  std::vector<Expression> es;
+  bool changed = false;
+  for (int i = l->first(); l->more(i); i = l->next(i)) {
+    Expression e = l->nth(i);
+    es.push_back(e->optimize(*this));
+    changed |= es.back() != e;
+  }
+  if (!changed)
+    return l;
+  Expressions r = nil_Expressions();
+  for (size_t i = 0; i < es.size(); i++)
+    r = append_Expressions(r, single_Expressions(es[i]));
+  return r;
+}
+
+bool int_const_class::is_int_const(int &v)
+{
+  v = int_value(token);
+  return true;
+}
+
+bool neg_class::is_int_const(int &v)
+{
+  int c;
+  if (!e1->is_int_const(c))
+    return false;
+  v = (int) -(unsigned) c;
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Features
+//
+//////////////////////////////////////////////////////////////////////
+
+void method_class::optimize(Optimizer &o)
+{
+  o.inlining.push_back(this);
+  for (int i = formals->first(); formals->more(i); i = formals->next(i))
+    o.scope.push_back(formals->nth(i)->get_name());
+  expr = expr->optimize(o);
+  o.scope.resize(o.scope.size() - formals->len());
+  o.inlining.pop_back();
+}
+
+void attr_class::optimize(Optimizer &o)
+{
+  init = init->optimize(o);
+}
+
+void branch_class::optimize(Optimizer &o)
+{
+  o.scope.push_back(name);
+  expr = expr->optimize(o);
+  o.scope.pop_back();
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Expressions
+//
+//////////////////////////////////////////////////////////////////////
+
+Expression assign_class::optimize(Optimizer &o)
+{
+  expr = expr->optimize(o);
+  return this;
+}
+
+Expression static_dispatch_class::optimize(Optimizer &o)
+{
+  expr = expr->optimize(o);
+  actual = o.optimize_list(actual);
+  return this;
+}
+
+Expression dispatch_class::optimize(Optimizer &o)
+{
+  expr = expr->optimize(o);
+  actual = o.optimize_list(actual);
+  o.dispatches++;
+  Symbol local = o.local_class(expr);
+  local_receiver = local && !o.init_leaks(local) &&
+    !o.method_leaks(local, o.classtable->lookup_method(local, name), true);
+  if (local_receiver)
+    o.stack_allocated++;
+  target_class = o.bind_method(expr->get_type(), name);
+  if (!target_class)
+    return this;
+  o.devirtualized++;
+  Expression e = NULL;
+  if (expr->is_self())
+    e = o.inline_call(this, target_class, name, actual);
+  return e ? e : this;
+}
+
+Expression cond_class::optimize(Optimizer &o)
+{
+  pred = pred->optimize(o);
+  then_exp = then_exp->optimize(o);
+  else_exp = else_exp->optimize(o);
+  bool b;
+  if (!pred->is_bool_const(b))
+    return this;
+  o.branches_removed++;
+  return o.retype(b ? then_exp : else_exp, type);
+}
+
+Expression loop_class::optimize(Optimizer &o)
+{
+  pred = pred->optimize(o);
+  body = body->optimize(o);
+  return this;
+}
+
+Expression typcase_class::optimize(Optimizer &o)
+{
+  expr = expr->optimize(o);
+  for (int i = cases->first(); cases->more(i); i = cases->next(i))
+    cases->nth(i)->optimize(o);
+  return this;
+}
+
+Expression block_class::optimize(Optimizer &o)
+{
+  body = o.optimize_list(body);
+  std::vector<Expression> kept;
+  int n = body->len();
+  for (int i = body->first(); body->more(i); i = body->next(i)) {
+    Expression e = body->nth(i);
+    if (i < n - 1 && e->pure())
+      o.exprs_removed++;
+    else
+      kept.push_back(e);
+  }
+  if (kept.size() == 1)
+    return kept[0];
+  if ((int) kept.size() < n) {
+    body = nil_Expressions();
+    for (size_t i = 0; i < kept.size(); i++)
+      body = append_Expressions(body, single_Expressions(kept[i]));
+  }
+  return this;
+}
+
+Expression let_class::optimize(Optimizer &o)
+{
+  init = init->optimize(o);
+  o.scope.push_back(identifier);
+  body = body->optimize(o);
+  o.scope.pop_back();
+  Symbol local = o.local_class(init);
+  Escape e(o, local);
+  local_init = local && !o.init_leaks(local) && !body->leaks(identifier, e, true);
+  if (local_init)
+    o.stack_allocated++;
+  return this;
+}
+
+//
+// The arithmetic operators.  The identities are only used when the
+// operand that is dropped has no side effects.
+//
+Expression plus_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  e2 = e2->optimize(o);
+  int a, b;
+  bool c1 = e1->is_int_const(a), c2 = e2->is_int_const(b);
+  if (c1 && c2) {
+    Expression r = o.make_int((int) ((unsigned) a + (unsigned) b), this);
+    if (r) {
+      o.folded++;
+      return r;
+    }
+  }
+  if (c2 && b == 0) {
+    o.simplified++;
+    return e1;
+  }
+  if (c1 && a == 0) {
+    o.simplified++;
+    return e2;
+  }
+  return this;
+}
+
+Expression sub_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  e2 = e2->optimize(o);
+  int a, b;
+  bool c1 = e1->is_int_const(a), c2 = e2->is_int_const(b);
+  if (c1 && c2) {
+    Expression r = o.make_int((int) ((unsigned) a - (unsigned) b), this);
+    if (r) {
+      o.folded++;
+      return r;
+    }
+  }
+  if (c2 && b == 0) {
+    o.simplified++;
+    return e1;
+  }
+  return this;
+}
+
+Expression mul_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  e2 = e2->optimize(o);
+  int a, b;
+  bool c1 = e1->is_int_const(a), c2 = e2->is_int_const(b);
+  if (c1 && c2) {
+    Expression r = o.make_int((int) ((unsigned) a * (unsigned) b), this);
+    if (r) {
+      o.folded++;
+      return r;
+    }
+  }
+  if ((c2 && b == 1) || (c1 && a == 0 && e2->pure())) {
+    o.simplified++;
+    return e1;
+  }
+  if ((c1 && a == 1) || (c2 && b == 0 && e1->pure())) {
+    o.simplified++;
+    return e2;
+  }
+  return this;
+}
+
+Expression divide_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  e2 = e2->optimize(o);
+  int a, b;
+  bool c1 = e1->is_int_const(a), c2 = e2->is_int_const(b);
+  if (c1 && c2 && b != 0 && !(a == INT_MIN && b == -1)) {
+    Expression r = o.make_int(a / b, this);
+    if (r) {
+      o.folded++;
+      return r;
+    }
+  }
+  if (c2 && b == 1) {
+    o.simplified++;
+    return e1;
+  }
+  return this;
+}
+
+// neg of a positive constant is how a negative constant is written,
+// so it is left alone.
+Expression neg_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  int a;
+  if (e1->is_int_const(a) && a < 0) {
+    Expression r = o.make_int((int) -(unsigned) a, this);
+    if (r) {
+      o.folded++;
+      return r;
+    }
+  }
+  return this;
+}
+
+Expression lt_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  e2 = e2->optimize(o);
+  int a, b;
+  if (e1->is_int_const(a) && e2->is_int_const(b)) {
+    o.folded++;
+    return o.make_bool(a < b, this);
+  }
+  return this;
+}
+
+Expression leq_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  e2 = e2->optimize(o);
+  int a, b;
+  if (e1->is_int_const(a) && e2->is_int_const(b)) {
+    o.folded++;
+    return o.make_bool(a <= b, this);
+  }
+  return this;
+}
+
+Expression eq_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  e2 = e2->optimize(o);
+  int a, b;
+  bool p, q;
+  if (e1->is_int_const(a) && e2->is_int_const(b)) {
+    o.folded++;
+    return o.make_bool(a == b, this);
+  }
+  if (e1->is_bool_const(p) && e2->is_bool_const(q)) {
+    o.folded++;
+    return o.make_bool(p == q, this);
+  }
+  return this;
+}
+
+Expression comp_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  bool b;
+  if (e1->is_bool_const(b)) {
+    o.folded++;
+    return o.make_bool(!b, this);
+  }
+  return this;
+}
+
+Expression isvoid_class::optimize(Optimizer &o)
+{
+  e1 = e1->optimize(o);
+  return this;
+}
+
+Expression int_const_class::optimize(Optimizer &o)    { return this; }
+Expression bool_const_class::optimize(Optimizer &o)   { return this; }
+Expression string_const_class::optimize(Optimizer &o) { return this; }
+Expression new__class::optimize(Optimizer &o)         { return this; }
+Expression no_expr_class::optimize(Optimizer &o)      { return this; }
+Expression object_class::optimize(Optimizer &o)       { return this; }
+
+//////////////////////////////////////////////////////////////////////
+//
+// Inlining
+//
+//////////////////////////////////////////////////////////////////////
+
+bool object_class::is_self()
+{
+  return name == self_sym;
+}
+
+//
+// The body of method name of target_class, to replace the dispatch
+// site on self with the arguments actual, or NULL if it cannot or
+// should not be inlined (see optimize.h).  Cool evaluates the
+// arguments in order before the receiver, which is self and has no
+// side effects, so binding them with lets keeps the order.
+//
+Expression Optimizer::inline_call(Expression site, Symbol target_class,
+                                  Symbol name, Expressions actual)
+{
+  method_class *m = classtable->lookup_method(target_class, name);
+  Expression body = m->get_expr();
+  if (body->is_no_expr() || inlining.size() >= INLINE_DEPTH ||
+      std::find(inlining.begin(), inlining.end(), m) != inlining.end())
+    return NULL;
+
+  Renaming uses;
+  body->rename(uses);
+  if (uses.nodes > inline_budget)
+    return NULL;
+  Formals formals = m->get_formals();
+  for (int i = formals->first(); formals->more(i); i = formals->next(i))
+    uses.free.erase(formals->nth(i)->get_name());
+  for (std::set<Symbol>::iterator it = uses.free.begin(); it != uses.free.end(); ++it)
+    if (std::find(scope.begin(), scope.end(), *it) != scope.end())
+      return NULL;
+
+  Renaming r;
+  std::vector<Symbol> fresh;
+  for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+    fresh.push_back(fresh_name(formals->nth(i)->get_name()));
+    r.names[formals->nth(i)->get_name()] = fresh.back();
+  }
+  Expression copy = body->copy_Expression();
+  copy->rename(r);
+
+  inlining.push_back(m);
+  scope.insert(scope.end(), fresh.begin(), fresh.end());
+  copy = copy->optimize(*this);
+  scope.resize(scope.size() - fresh.size());
+  inlining.pop_back();
+
+  // The outermost node takes the type of the dispatch, which can be
+  // wider than the type of the body, as the return type can.
+  node_lineno = site->get_line_number();
+  node_span = site->get_span();
+  Expression e = copy;
+  for (int i = formals->len() - 1; i >= 0; i--)
+    e = let(fresh[i], formals->nth(i)->get_type_decl(), actual->nth(i), e)
+          ->set_type(i == 0 ? site->get_type() : copy->get_type());
+  inlined++;
+  return retype(e, site->get_type());
+}
+
+Symbol Renaming::use(Symbol name)
+{
+  if (std::find(bound.begin(), bound.end(), name) != bound.end())
+    return name;
+  std::map<Symbol, Symbol>::iterator it = names.find(name);
+  if (it != names.end())
+    return it->second;
+  free.insert(name);
+  return name;
+}
+
+static void rename_list(Expressions l, Renaming &r)
+{
+  for (int i = l->first(); l->more(i); i = l->next(i))
+    l->nth(i)->rename(r);
+}
+
+void assign_class::rename(Renaming &r)
+{
+  r.nodes++;
+  name = r.use(name);
+  expr->rename(r);
+}
+
+void static_dispatch_class::rename(Renaming &r)
+{
+  r.nodes++;
+  expr->rename(r);
+  rename_list(actual, r);
+}
+
+void dispatch_class::rename(Renaming &r)
+{
+  r.nodes++;
+  expr->rename(r);
+  rename_list(actual, r);
+}
+
+void cond_class::rename(Renaming &r)
+{
+  r.nodes++;
+  pred->rename(r);
+  then_exp->rename(r);
+  else_exp->rename(r);
+}
+
+void loop_class::rename(Renaming &r)
+{
+  r.nodes++;
+  pred->rename(r);
+  body->rename(r);
+}
+
+void typcase_class::rename(Renaming &r)
+{
+  r.nodes++;
+  expr->rename(r);
+  for (int i = cases->first(); cases->more(i); i = cases->next(i))
+    cases->nth(i)->rename(r);
+}
+
+void branch_class::rename(Renaming &r)
+{
+  r.nodes++;
+  r.bound.push_back(name);
+  expr->rename(r);
+  r.bound.pop_back();
+}
+
+void block_class::rename(Renaming &r)
+{
+  r.nodes++;
+  rename_list(body, r);
+}
+
+void let_class::rename(Renaming &r)
+{
+  r.nodes++;
+  init->rename(r);
+  r.bound.push_back(identifier);
+  body->rename(r);
+  r.bound.pop_back();
+}
+
+void plus_class::rename(Renaming &r)   { r.nodes++; e1->rename(r); e2->rename(r); }
+void sub_class::rename(Renaming &r)    { r.nodes++; e1->rename(r); e2->rename(r); }
+void mul_class::rename(Renaming &r)    { r.nodes++; e1->rename(r); e2->rename(r); }
+void divide_class::rename(Renaming &r) { r.nodes++; e1->rename(r); e2->rename(r); }
+void lt_class::rename(Renaming &r)     { r.nodes++; e1->rename(r); e2->rename(r); }
+void eq_class::rename(Renaming &r)     { r.nodes++; e1->rename(r); e2->rename(r); }
+void leq_class::rename(Renaming &r)    { r.nodes++; e1->rename(r); e2->rename(r); }
+void neg_class::rename(Renaming &r)    { r.nodes++; e1->rename(r); }
+void comp_class::rename(Renaming &r)   { r.nodes++; e1->rename(r); }
+void isvoid_class::rename(Renaming &r) { r.nodes++; e1->rename(r); }
+
+void int_const_class::rename(Renaming &r)    { r.nodes++; }
+void bool_const_class::rename(Renaming &r)   { r.nodes++; }
+void string_const_class::rename(Renaming &r) { r.nodes++; }
+void new__class::rename(Renaming &r)         { r.nodes++; }
+void no_expr_class::rename(Renaming &r)      { }
+
+void object_class::rename(Renaming &r)
+{
+  r.nodes++;
+  name = r.use(name);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Side effects
+//
+// An expression is pure if evaluating it can have no effect other
+// than its value: no assignment, no call, no object initialization,
+// no input or output and no runtime error.
+//
+//////////////////////////////////////////////////////////////////////
+
+bool assign_class::pure()          { return false; }
+bool static_dispatch_class::pure() { return false; }
+bool dispatch_class::pure()        { return false; }
+bool loop_class::pure()            { return false; }
+bool typcase_class::pure()         { return false; }
+bool new__class::pure()            { return false; }
+
+bool cond_class::pure()
+{
+  return pred->pure() && then_exp->pure() && else_exp->pure();
+}
+
+bool block_class::pure()
+{
+  for (int i = body->first(); body->more(i); i = body->next(i))
+    if (!body->nth(i)->pure())
+      return false;
+  return true;
+}
+
+bool let_class::pure()     { return init->pure() && body->pure(); }
+bool plus_class::pure()    { return e1->pure() && e2->pure(); }
+bool sub_class::pure()     { return e1->pure() && e2->pure(); }
+bool mul_class::pure()     { return e1->pure() && e2->pure(); }
+bool lt_class::pure()      { return e1->pure() && e2->pure(); }
+bool leq_class::pure()     { return e1->pure() && e2->pure(); }
+bool eq_class::pure()      { return e1->pure() && e2->pure(); }
+bool neg_class::pure()     { return e1->pure(); }
+bool comp_class::pure()    { return e1->pure(); }
+bool isvoid_class::pure()  { return e1->pure(); }
+
+// Only a division by a constant other than 0 cannot fail.
+bool divide_class::pure()
+{
+  int b;
+  return e1->pure() && e2->pure() && e2->is_int_const(b) && b != 0;
+}
+
+bool int_const_class::pure()    { return true; }
+bool bool_const_class::pure()   { return true; }
+bool string_const_class::pure() { return true; }
+bool no_expr_class::pure()      { return true; }
+bool object_class::pure()       { return true; }
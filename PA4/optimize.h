@@ -0,0 +1,130 @@
+#ifndef OPTIMIZE_H_
+#define OPTIMIZE_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  optimize.h
+//
+//  AST-to-AST optimizations of a program that program_class::semant()
+//  has checked, run when -O (cgen_optimize) is given.  Each expression
+//  node's optimize() optimizes its children, stores the results back
+//  into itself and returns the expression that replaces it, which has
+//  a type that conforms to its own.
+//
+//  Constant folding: +, -, *, /, ~, <, <=, = and not over Int and Bool
+//  constants are computed with the wrap-around arithmetic of the
+//  runtime.  A negative result is neg of a positive constant, since an
+//  integer token has no sign.  Divisions by zero are left to fail at
+//  run time.  x + 0, x - 0, x * 1, x / 1 and 0 + x become x, and x * 0
+//  becomes 0 when x has no side effects.
+//
+//  Conditionals with a constant predicate are replaced by the branch
+//  taken, and the expressions of a block that have no side effects are
+//  dropped, except for the last.
+//
+//  Devirtualization: class hierarchy analysis finds, for every class,
+//  the methods that one of its subclasses redefines.  A dispatch whose
+//  receiver's static type T has no subclass redefining the method can
+//  only call the method T inherits, so it is bound to that method: its
+//  target_class is set to the class that defines it, and code
+//  generators may call it directly.
+//
+//  Inlining: a bound dispatch to self whose method is not native, not
+//  being inlined or optimized already, and no larger than
+//  inline_budget nodes (-I, 40 by default) is replaced by a copy of
+//  the method's body (copy_Expression) in lets that bind each formal,
+//  under a fresh name, to its argument.  Getters and setters become an
+//  attribute access.  The copy is optimized again where it lands, so
+//  what it calls can be inlined in turn.  A body that uses an
+//  attribute hidden at the call site by a let, case or formal of the
+//  same name is not inlined.
+//
+//  Escape analysis: the object that new T creates does not escape when
+//  the only place it can be reached from is the let variable it
+//  initializes, or the receiver of the dispatch it is the receiver of,
+//  and only until the let or dispatch ends.  Such a let or dispatch
+//  is marked (local_init, local_receiver) so that a code generator can
+//  allocate the object on a stack (see escape.cc).
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "cool-tree.h"
+#include "semant.h"
+
+extern int inline_budget;
+
+// Walks an expression for the inliner: counts its nodes, renames the
+// variables in names where they are not hidden by a let or case
+// inside it, and collects the names it uses without binding them.
+class Renaming {
+public:
+  std::map<Symbol, Symbol> names;
+  std::set<Symbol> free;
+  std::vector<Symbol> bound;      // lets and cases around the node
+  long nodes;
+
+  Renaming() : nodes(0) { }
+  Symbol use(Symbol name);
+};
+
+// Follows an object whose class is cls through an expression for the
+// escape analysis: leaks(var, e, used) says whether the object, held
+// in var, can be stored, passed, bound to another variable or, when
+// used, be the value of the expression.
+class Escape {
+public:
+  Optimizer &opt;
+  Symbol cls;
+
+  Escape(Optimizer &o, Symbol c) : opt(o), cls(c) { }
+  bool call_leaks(Symbol type, Symbol name, bool used);
+};
+
+class Optimizer {
+public:
+  ClassTableP classtable;
+
+  // What was done, for -P.
+  long folded;             // operators over constants
+  long simplified;         // operators with an identity operand
+  long branches_removed;   // conditionals with a constant predicate
+  long exprs_removed;      // block expressions without side effects
+  long dispatches;         // dynamic dispatches seen
+  long devirtualized;      // dynamic dispatches bound to one method
+  long inlined;            // dispatches replaced by the method's body
+  long stack_allocated;    // news that do not escape
+
+  Symbol curr_class;       // class whose features are being optimized
+  std::vector<Symbol> scope;                // variables at this point
+  std::vector<method_class *> inlining;     // method, then what is inlined
+
+  Optimizer(ClassTableP ct);
+  void optimize(Program program);
+  void count(PhaseTimer &timer);
+
+  Expression make_int(int val, Expression at);
+  Expression make_bool(bool val, Expression at);
+  Expression retype(Expression e, Symbol type);
+  Expressions optimize_list(Expressions l);
+  Symbol bind_method(Symbol type, Symbol name);
+  Expression inline_call(Expression site, Symbol target_class, Symbol name,
+                         Expressions actual);
+  Symbol local_class(Expression init);
+  bool init_leaks(Symbol cls);
+  bool method_leaks(Symbol cls, method_class *m, bool used);
+
+private:
+  std::map<Symbol, std::set<Symbol> > defined;      // methods of each class
+  std::map<Symbol, std::set<Symbol> > overridden;   // redefined in a subclass
+  void analyze_hierarchy();
+  std::set<std::string> identifiers;               // to make fresh names
+  Symbol fresh_name(Symbol base);
+  std::map<Symbol, int> init_summaries;                    // by class
+  std::map<std::pair<Symbol, method_class *>, int> method_summaries[2];
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PHASE_STATS_H_
+#define PHASE_STATS_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  phase-stats.h
+//
+//  Per-phase instrumentation.  A PhaseTimer measures wall time, CPU
+//  time, peak RSS and heap allocations between its construction and
+//  stop().  When -P is given (see handle_flags.cc) stop() also appends
+//  one JSON line per phase to the named file, or to stderr for "-",
+//  together with the sizes of the symbol tables and any counts the
+//  caller added.  Every phase of the csh pipeline appends to the same
+//  file, so the lines carry the pid of the process that wrote them.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#define MAX_PHASE_COUNTS 8
+
+extern char *phase_stats_file;     // set by -P; NULL when disabled
+extern long tree_node_count;       // AST nodes built so far (tree.cc)
+
+struct PhaseStat {
+  double wall_ms;         // elapsed wall clock time
+  double cpu_ms;          // user + system time
+  long   maxrss_kb;       // peak resident set size at the end of the phase
+  long   allocs;          // calls to operator new during the phase
+  long   alloc_bytes;     // bytes requested by those calls
+};
+
+class PhaseTimer {
+private:
+  const char *name;
+  double wall_start, cpu_start;
+  long allocs_start, bytes_start;
+  int ncounts;
+  const char *count_names[MAX_PHASE_COUNTS];
+  long count_values[MAX_PHASE_COUNTS];
+
+public:
+  PhaseTimer(const char *name);
+  void count(const char *what, long n);
+  PhaseStat stop();
+};
+
+void write_phase_record(const char *line);
+
+#endif
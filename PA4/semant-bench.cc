@@ -0,0 +1,414 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  semant-bench.cc
+//
+//  Scaling benchmark for the semantic checker.
+//
+//  Generates type-correct Cool programs directly as ASTs and times
+//  each phase of program_class::semant() on them (see SemantPhase in
+//  semant.h).  Four series are run, each varying one parameter of the
+//  generated program while holding the others fixed:
+//
+//      classes     number of classes
+//      depth       length of each inheritance chain
+//      methods     methods per class
+//      expr_size   nodes per method body
+//
+//  Every run is done in a forked child so that peak RSS belongs to
+//  that run alone.  The results are written to stdout as JSON.  For
+//  each series and phase a growth exponent is fitted (the slope of
+//  log time against log parameter), and any phase whose exponent
+//  exceeds the threshold is flagged as superlinear.
+//
+//  usage: semant-bench [-r repeats] [-t threshold] [-q] [-H]
+//         -q runs a quick, smaller version of every series
+//         -H builds the programs with hash-consing (see hashcons.h)
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vector>
+#include "cool-tree.h"
+#include "semant.h"
+#include "hashcons.h"
+
+//
+// These globals are normally defined by semant-phase.cc, which the
+// benchmark replaces.
+//
+FILE *ast_file = stdin;
+int cool_yydebug;
+char *curr_filename = "<bench>";
+
+extern int optind;
+extern char *optarg;
+
+// Phases faster than this are too noisy to fit a growth exponent to.
+static const double MIN_FIT_MS = 0.5;
+
+struct BenchConfig {
+  int classes;
+  int depth;
+  int methods;
+  int expr_size;
+};
+
+struct BenchResult {
+  BenchConfig config;
+  long nodes;
+  long ast_bytes;         // pool bytes used by the generated AST
+  PhaseStat stats[NUM_SEMANT_PHASES];
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Program generator
+//
+//  Class C<i> inherits from C<i-1> unless i is a multiple of the
+//  depth, in which case it starts a new chain under Object.  Every
+//  class has one Int attribute a<i> and defines the same methods
+//  m<k>(x : Int) : Int, so each method overrides its parent's.  Method
+//  bodies mix arithmetic, conditionals, lets, blocks and dispatches
+//  on self, and always have type Int.  Lists are built the way the
+//  parser builds them, appending one element at a time.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class ProgramGenerator {
+private:
+  BenchConfig config;
+  long nodes;
+  int counter;
+  Symbol Int, Object, self, x;
+  std::vector<Symbol> class_names, attr_names, method_names, let_names, consts;
+
+  Symbol make_symbol(const char *prefix, int n)
+  {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s%d", prefix, n);
+    return idtable.add_string(buf);
+  }
+
+  Expression leaf(int cls)
+  {
+    nodes++;
+    switch (counter++ % 4) {
+    case 0:  return object(x);
+    case 1:  return object(attr_names[cls]);
+    case 2:  return object(attr_names[cls - cls % config.depth]);
+    default: return int_const(consts[counter % consts.size()]);
+    }
+  }
+
+  // An Int-typed expression of roughly size nodes, with let-bound
+  // names drawn from the first `lets' entries of let_names in scope.
+  Expression gen(int size, int cls, int meth, int lets)
+  {
+    if (size <= 1)
+      return leaf(cls);
+
+    nodes++;
+    int rest = size - 1;
+    switch (counter++ % 6) {
+    case 0:
+      return plus(gen(rest / 2, cls, meth, lets), gen(rest - rest / 2, cls, meth, lets));
+    case 1:
+      return mul(gen(rest / 2, cls, meth, lets), gen(rest - rest / 2, cls, meth, lets));
+    case 2: {
+      nodes++;
+      int part = rest / 4 + 1;
+      return cond(lt(gen(part, cls, meth, lets), gen(part, cls, meth, lets)),
+		  gen(part, cls, meth, lets), gen(rest - 3 * part, cls, meth, lets));
+    }
+    case 3: {
+      if (lets == (int) let_names.size())
+	return plus(gen(rest / 2, cls, meth, lets), gen(rest - rest / 2, cls, meth, lets));
+      nodes++;
+      Expression init = gen(rest / 2, cls, meth, lets);
+      return let(let_names[lets], Int, init,
+		 plus(object(let_names[lets]), gen(rest - rest / 2, cls, meth, lets + 1)));
+    }
+    case 4: {
+      Expressions body = nil_Expressions();
+      int parts = rest < 3 ? 1 : 3;
+      for (int i = 0; i < parts; i++)
+	body = append_Expressions(body, single_Expressions(gen(rest / parts, cls, meth, lets)));
+      return block(body);
+    }
+    default: {
+      Symbol callee = method_names[(meth + 1) % config.methods];
+      Expressions args = single_Expressions(gen(rest, cls, meth, lets));
+      if (cls % config.depth != 0 && counter % 2)
+	return static_dispatch(object(self), class_names[cls - 1], callee, args);
+      return dispatch(object(self), callee, args);
+    }
+    }
+  }
+
+  Class_ gen_class(int cls)
+  {
+    Symbol parent = cls % config.depth == 0 ? Object : class_names[cls - 1];
+    Features features =
+      single_Features(attr(attr_names[cls], Int, int_const(consts[cls % consts.size()])));
+
+    for (int m = 0; m < config.methods; m++) {
+      Expression body = gen(config.expr_size, cls, m, 0);
+      features = append_Features(features,
+	single_Features(method(method_names[m],
+			       single_Formals(formal(x, Int)), Int, body)));
+    }
+    return class_(class_names[cls], parent, features, stringtable.add_string("<bench>"));
+  }
+
+public:
+  ProgramGenerator(BenchConfig c) : config(c), nodes(0), counter(0)
+  {
+    Int = idtable.add_string("Int");
+    Object = idtable.add_string("Object");
+    self = idtable.add_string("self");
+    x = idtable.add_string("x");
+
+    for (int i = 0; i < config.classes; i++) {
+      class_names.push_back(make_symbol("C", i));
+      attr_names.push_back(make_symbol("a", i));
+    }
+    for (int m = 0; m < config.methods; m++)
+      method_names.push_back(make_symbol("m", m));
+    for (int i = 0; i < 8; i++)
+      let_names.push_back(make_symbol("y", i));
+    for (int i = 0; i < 10; i++) {
+      char buf[4];
+      snprintf(buf, sizeof(buf), "%d", i);
+      consts.push_back(inttable.add_string(buf));
+    }
+  }
+
+  Program generate()
+  {
+    Classes classes = nil_Classes();
+    for (int i = 0; i < config.classes; i++)
+      classes = append_Classes(classes, single_Classes(gen_class(i)));
+
+    Symbol main_sym = idtable.add_string("main");
+    Class_ main_class =
+      class_(idtable.add_string("Main"), Object,
+	     single_Features(method(main_sym, nil_Formals(), Object, int_const(consts[0]))),
+	     stringtable.add_string("<bench>"));
+    classes = append_Classes(classes, single_Classes(main_class));
+    return program(classes);
+  }
+
+  long node_count() { return nodes; }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Running and reporting
+//
+//////////////////////////////////////////////////////////////////////////////
+
+//
+// run_once generates and checks one program in a child process, which
+// sends its node count and phase statistics back through a pipe.
+//
+static bool run_once(BenchConfig config, BenchResult &result)
+{
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    ProgramGenerator generator(config);
+    Program prog = generator.generate();
+    prog->semant();
+    result.config = config;
+    result.nodes = generator.node_count();
+    result.ast_bytes = ast_pool_used();
+    for (int p = 0; p < NUM_SEMANT_PHASES; p++)
+      result.stats[p] = semant_phase_stats[p];
+    if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+      _exit(1);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  bool ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+  close(fds[0]);
+
+  int status;
+  waitpid(pid, &status, 0);
+  return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+//
+// run_config keeps the fastest of several runs to filter out noise.
+//
+static BenchResult run_config(BenchConfig config, int repeats)
+{
+  BenchResult best;
+
+  for (int r = 0; r < repeats; r++) {
+    BenchResult result;
+    if (!run_once(config, result)) {
+      cerr << "semant-bench: run failed for classes=" << config.classes
+	   << " depth=" << config.depth << " methods=" << config.methods
+	   << " expr_size=" << config.expr_size << endl;
+      exit(1);
+    }
+    if (r == 0) {
+      best = result;
+      continue;
+    }
+    for (int p = 0; p < NUM_SEMANT_PHASES; p++)
+      if (result.stats[p].wall_ms < best.stats[p].wall_ms)
+	best.stats[p] = result.stats[p];
+  }
+  return best;
+}
+
+static int series_param(BenchConfig &c, const char *series)
+{
+  switch (series[0]) {
+  case 'c': return c.classes;
+  case 'd': return c.depth;
+  case 'm': return c.methods;
+  default:  return c.expr_size;
+  }
+}
+
+//
+// growth_exponent is the least-squares slope of log(wall time) against
+// log(parameter), over the points slow enough to measure reliably.
+// It returns a negative value when there are too few such points.
+//
+static double growth_exponent(std::vector<BenchResult> &runs, const char *series, int phase)
+{
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  int n = 0;
+
+  for (size_t i = 0; i < runs.size(); i++) {
+    double t = runs[i].stats[phase].wall_ms;
+    if (t < MIN_FIT_MS)
+      continue;
+    double lx = log((double) series_param(runs[i].config, series));
+    double ly = log(t);
+    sx += lx; sy += ly; sxx += lx * lx; sxy += lx * ly;
+    n++;
+  }
+  if (n < 3 || n * sxx - sx * sx == 0)
+    return -1;
+  return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+static void print_run(BenchResult &r)
+{
+  printf("        { \"classes\": %d, \"depth\": %d, \"methods\": %d, \"expr_size\": %d, "
+	 "\"nodes\": %ld, \"ast_bytes\": %ld,\n          \"phases\": {",
+	 r.config.classes, r.config.depth, r.config.methods, r.config.expr_size, r.nodes,
+	 r.ast_bytes);
+  for (int p = 0; p < NUM_SEMANT_PHASES; p++)
+    printf("%s\n            \"%s\": { \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"maxrss_kb\": %ld, "
+	   "\"allocs\": %ld, \"alloc_bytes\": %ld }",
+	   p ? "," : "", semant_phase_names[p],
+	   r.stats[p].wall_ms, r.stats[p].cpu_ms, r.stats[p].maxrss_kb,
+	   r.stats[p].allocs, r.stats[p].alloc_bytes);
+  printf(" } }");
+}
+
+//
+// run_series runs one series and prints it as a JSON object.  It
+// returns the number of phases flagged as superlinear.
+//
+static int run_series(const char *name, std::vector<BenchConfig> &configs,
+		      int repeats, double threshold, bool last)
+{
+  std::vector<BenchResult> runs;
+  int flagged = 0;
+
+  for (size_t i = 0; i < configs.size(); i++)
+    runs.push_back(run_config(configs[i], repeats));
+
+  printf("    { \"name\": \"%s\",\n      \"runs\": [\n", name);
+  for (size_t i = 0; i < runs.size(); i++) {
+    print_run(runs[i]);
+    printf("%s\n", i + 1 < runs.size() ? "," : "");
+  }
+  printf("      ],\n      \"growth\": {");
+  for (int p = 0; p < NUM_SEMANT_PHASES; p++) {
+    double e = growth_exponent(runs, name, p);
+    bool superlinear = e > threshold;
+    printf("%s\n        \"%s\": ", p ? "," : "", semant_phase_names[p]);
+    if (e < 0)
+      printf("{ \"exponent\": null, \"superlinear\": false }");
+    else
+      printf("{ \"exponent\": %.3f, \"superlinear\": %s }", e, superlinear ? "true" : "false");
+    if (superlinear) {
+      cerr << "semant-bench: " << semant_phase_names[p] << " grows as " << name
+	   << "^" << e << endl;
+      flagged++;
+    }
+  }
+  printf(" } }%s\n", last ? "" : ",");
+  fflush(stdout);
+  return flagged;
+}
+
+int main(int argc, char *argv[])
+{
+  int repeats = 3;
+  double threshold = 1.25;
+  int scale = 4;
+  int c;
+
+  while ((c = getopt(argc, argv, "r:t:qH")) != -1) {
+    switch (c) {
+    case 'r': repeats = atoi(optarg); break;
+    case 't': threshold = atof(optarg); break;
+    case 'q': scale = 1; break;
+    case 'H': ast_hashcons = 1; break;
+    default:
+      cerr << "usage: " << argv[0] << " [-r repeats] [-t threshold] [-q] [-H]" << endl;
+      exit(1);
+    }
+  }
+
+  std::vector<BenchConfig> classes, depth, methods, expr_size;
+  for (int n = 64; n <= 1024; n *= 2) {
+    BenchConfig cfg = { n * scale, 4, 4, 16 };
+    classes.push_back(cfg);
+  }
+  for (int d = 1; d <= 256; d *= 4) {
+    BenchConfig cfg = { 256 * scale, d, 4, 16 };
+    depth.push_back(cfg);
+  }
+  for (int m = 2; m <= 32; m *= 2) {
+    BenchConfig cfg = { 32 * scale, 4, m, 16 };
+    methods.push_back(cfg);
+  }
+  for (int e = 16; e <= 1024; e *= 4) {
+    BenchConfig cfg = { 16 * scale, 4, 4, e };
+    expr_size.push_back(cfg);
+  }
+
+  printf("{ \"threshold\": %.3f,\n  \"series\": [\n", threshold);
+  int flagged = 0;
+  flagged += run_series("classes", classes, repeats, threshold, false);
+  flagged += run_series("depth", depth, repeats, threshold, false);
+  flagged += run_series("methods", methods, repeats, threshold, false);
+  flagged += run_series("expr_size", expr_size, repeats, threshold, true);
+  printf("  ] }\n");
+
+  return flagged ? 2 : 0;
+}
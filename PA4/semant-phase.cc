@@ -1,5 +1,9 @@
 #include <stdio.h>
 #include "cool-tree.h"
+#include "phase-stats.h"
+#include "trace.h"
+#include "hashcons.h"
+#include "optimize.h"
 
 extern Program ast_root;      // root of the abstract syntax tree
 FILE *ast_file = stdin;       // we read the AST from standard input
@@ -8,12 +12,52 @@ extern int ast_yyparse(void); // entry point to the AST parser
 int cool_yydebug;     // not used, but needed to link with handle_flags
 char *curr_filename;
 
+extern int cgen_optimize;
+extern char *spans_path;      // -X: the parser's spans of the nodes
 void handle_flags(int argc, char *argv[]);
 
 int main(int argc, char *argv[]) {
   handle_flags(argc,argv);
-  ast_yyparse();
-  ast_root->semant();
-  ast_root->dump_with_types(cout,0);
+
+  PhaseTimer parse_timer("parse-ast");
+  {
+    TRACE_SCOPE("parse-ast", "parse-ast");
+    if (spans_path)
+      span_read_open(spans_path);
+    ast_yyparse();
+    if (spans_path)
+      span_read_close();
+  }
+  parse_timer.count("ast_nodes", tree_node_count);
+  parse_timer.count("ast_bytes", ast_pool_used());
+  if (ast_hashcons)
+    parse_timer.count("ast_shared", hashcons_hits());
+  parse_timer.stop();
+  ast_pool_report("ast-nodes");
+
+  PhaseTimer semant_timer("semant");
+  {
+    TRACE_SCOPE("semant", "semant");
+    ast_root->semant();
+  }
+  semant_timer.stop();
+
+  if (cgen_optimize) {
+    PhaseTimer optimize_timer("optimize");
+    Optimizer optimizer(ast_root->get_classtable());
+    {
+      TRACE_SCOPE("optimize", "optimize");
+      optimizer.optimize(ast_root);
+    }
+    optimizer.count(optimize_timer);
+    optimize_timer.stop();
+  }
+
+  PhaseTimer dump_timer("dump");
+  {
+    TRACE_SCOPE("dump", "dump");
+    ast_root->dump_with_types(cout,0);
+  }
+  dump_timer.stop();
 }
 
@@ -0,0 +1,833 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  semant-server.cc
+//
+//  A compile server for the semantic checker.
+//
+//  mycoolc starts a lexer, a parser and a checker for every compile,
+//  and the checker interns the basic class names and builds the basic
+//  classes each time before it looks at the program.  semant-server
+//  stays running instead, listening on a Unix socket, and keeps the
+//  string tables, the basic classes and the parse of every file it has
+//  recently seen (see collect_asts).  A request names the files of a
+//  program; in a file whose bytes have changed since it was parsed only
+//  the classes an edit touched are lexed and parsed again (see
+//  class-chunks.h).  Files never parsed before are looked up in the
+//  parse cache on disk (see ast-cache.h) and, failing that, run through
+//  the lexer and parser, several files at once.  The class lists of all
+//  of them are checked together, in the order the files were given, and
+//  the reply carries the diagnostics and the typed AST that mysemant
+//  would print.
+//
+//  usage: semant-server [-s socket] [-L lexer] [-R parser] [-P file]
+//                       [-C dir] [-M megabytes] [-G megabytes] [-j jobs]
+//         semant-server -c [-s socket] file.cl ...
+//         semant-server -k [-s socket]
+//
+//         The first form runs the server.  -L and -R name the lexer and
+//         parser to run (./lexer and ./parser by default), and -P
+//         appends "server.pool", "server.front_end" and
+//         "server.compile" records per request.  -C names the parse
+//         cache directory (.cool-cache by default) and -M the size it
+//         is kept under (64MB); -M 0 turns it off.  The cache key covers
+//         the lexer and parser executables as they were when the server
+//         started.  -G is the size of the ASTs kept in memory past which
+//         they are dropped and rebuilt (64MB; see collect_asts).  -j is
+//         the number of files parsed at once (one per CPU by
+//         default).  -c sends the files to the server, writes the
+//         diagnostics to stderr and the typed AST to stdout, and exits
+//         with 1 if there were errors.  -k stops the server.  The socket
+//         is /tmp/semant-server-<uid>.sock unless -s is given.
+//
+//  Protocol: the client sends "compile" or "shutdown" on a line, then
+//  one absolute path per line, and shuts down its side of the socket.
+//  The server answers
+//
+//      status <n>
+//      diagnostics <bytes>
+//      <bytes of diagnostics>
+//      ast <bytes>
+//      <bytes of the typed AST>
+//
+//  and closes the connection.  Requests are handled one at a time.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include "cool-tree.h"
+#include "semant.h"
+#include "phase-stats.h"
+#include "ast-pool.h"
+#include "ast-cache.h"
+#include "class-chunks.h"
+
+//
+// These globals are normally defined by semant-phase.cc, which the
+// server replaces.
+//
+FILE *ast_file = stdin;
+int cool_yydebug;
+char *curr_filename = "<server>";
+
+extern Program ast_root;
+extern int ast_yyparse(void);
+extern void yyrestart(FILE *);
+
+extern int yy_flex_debug;
+extern int node_lineno;
+extern int optind;
+extern char *optarg;
+
+static const char *lexer_path = "./lexer";
+static const char *parser_path = "./parser";
+
+static const char *cache_dir = ".cool-cache";
+static double cache_megabytes = 64;
+static long max_jobs;                   // front end workers at once
+static AstCache *ast_cache;
+
+static double pool_megabytes = 64;
+static size_t pool_mark;                // the AST pool with the basic classes
+static unsigned long generation;        // AST pool resets so far
+
+// The parse of one file, kept until its bytes change.
+struct ParsedFile {
+  unsigned long key;        // AstCache::key of its bytes
+  bool ok;                  // the parser accepted it
+  Classes classes;          // its classes, when ok
+  std::string diagnostics;  // what the lexer and parser reported
+  std::string source;       // its bytes, to find the next edit in
+  std::vector<ClassChunk> chunks;   // source split at its classes
+  unsigned long generation; // the last generation that asked for it
+};
+
+static std::map<std::string, ParsedFile> parse_cache;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Socket helpers
+//
+//////////////////////////////////////////////////////////////////////////////
+
+static std::string default_socket()
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "/tmp/semant-server-%d.sock", (int) getuid());
+  return buf;
+}
+
+static bool socket_address(const std::string &path, sockaddr_un &addr)
+{
+  if (path.size() >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "semant-server: socket path too long: %s\n", path.c_str());
+    return false;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path.c_str());
+  return true;
+}
+
+static bool write_all(int fd, const char *p, size_t n)
+{
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w <= 0)
+      return false;
+    p += w;
+    n -= w;
+  }
+  return true;
+}
+
+static bool write_all(int fd, const std::string &s)
+{
+  return write_all(fd, s.data(), s.size());
+}
+
+static std::string read_all(int fd)
+{
+  std::string s;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    s.append(buf, n);
+  return s;
+}
+
+static std::string read_file(FILE *f)
+{
+  fflush(f);
+  rewind(f);
+  std::string s;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    s.append(buf, n);
+  return s;
+}
+
+static bool read_file(const std::string &path, std::string &s)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == NULL)
+    return false;
+  s = read_file(f);
+  fclose(f);
+  return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Server
+//
+//////////////////////////////////////////////////////////////////////////////
+
+//
+// Runs "lexer path | parser" with the parser's output going to ast and
+// its errors to errs, and returns whether both succeeded.
+//
+static bool run_front_end(const std::string &path, FILE *ast, FILE *errs)
+{
+  int pipefd[2];
+  if (pipe(pipefd) < 0)
+    return false;
+
+  pid_t lexer = fork();
+  if (lexer == 0) {
+    dup2(pipefd[1], 1);
+    dup2(fileno(errs), 2);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    execl(lexer_path, lexer_path, path.c_str(), (char *) NULL);
+    fprintf(stderr, "semant-server: cannot run %s\n", lexer_path);
+    _exit(127);
+  }
+  pid_t parser = fork();
+  if (parser == 0) {
+    dup2(pipefd[0], 0);
+    dup2(fileno(ast), 1);
+    dup2(fileno(errs), 2);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    execl(parser_path, parser_path, (char *) NULL);
+    fprintf(stderr, "semant-server: cannot run %s\n", parser_path);
+    _exit(127);
+  }
+  close(pipefd[0]);
+  close(pipefd[1]);
+
+  int lexer_status = 1, parser_status = 1;
+  if (lexer > 0)
+    waitpid(lexer, &lexer_status, 0);
+  if (parser > 0)
+    waitpid(parser, &parser_status, 0);
+  return lexer > 0 && parser > 0 &&
+         WIFEXITED(lexer_status) && WEXITSTATUS(lexer_status) == 0 &&
+         WIFEXITED(parser_status) && WEXITSTATUS(parser_status) == 0;
+}
+
+//
+// Gives chunks [first, last) of pf the classes of l, one each, and
+// saves each for when its chunk moves.  Returns false if l does not
+// have one class per chunk.
+//
+static bool split_classes(ParsedFile &pf, size_t first, size_t last, Classes l)
+{
+  if (l->len() != (int) (last - first))
+    return false;
+  size_t k = first;
+  for (int i = l->first(); l->more(i); i = l->next(i), k++) {
+    ClassChunk &c = pf.chunks[k];
+    c.classes = single_Classes(l->nth(i));
+    c.classes_line = c.line;
+    c.ast.clear();
+    AstWriter writer(c.ast);
+    writer.classes(c.classes);
+    writer.symbol_list(c.symbols);
+    c.ast_line = c.line;
+  }
+  return true;
+}
+
+static void forget_chunks(ParsedFile &pf)
+{
+  for (size_t k = 0; k < pf.chunks.size(); k++) {
+    pf.chunks[k].ast.clear();
+    pf.chunks[k].symbols.clear();
+    pf.chunks[k].classes = NULL;
+  }
+}
+
+//
+// Joins the classes of pf's chunks into pf.classes.  A chunk that has
+// moved to another line since its classes were read is read again
+// from its ast with the difference added to every line.  Returns
+// false if a chunk has not been parsed.
+//
+static bool join_chunks(ParsedFile &pf, Symbol filename)
+{
+  Classes l = nil_Classes();
+  for (size_t k = 0; k < pf.chunks.size(); k++) {
+    ClassChunk &c = pf.chunks[k];
+    if (c.ast.empty())
+      return false;
+    if (c.classes == NULL || c.classes_line != c.line) {
+      AstReader reader(c.ast.data(), c.ast.size(), filename,
+                       c.line - c.ast_line, &c.symbols);
+      c.classes = reader.classes();
+      c.classes_line = c.line;
+      if (c.classes == NULL)
+        return false;
+    }
+    l = append_Classes(l, c.classes);
+  }
+  pf.classes = l;
+  return true;
+}
+
+//
+// The parse of path, whose bytes are source, if it is known: from
+// memory if they have not changed since the last request, else from
+// the parse cache.  Otherwise the entry is left for front end jobs to
+// fill in: for the chunks the edit touched, if some of the others were
+// parsed before (FROM_CHUNKS), else for the whole file (FROM_PARSER).
+// The classes of an unchanged file that collect_asts() dropped are
+// read back from its chunks.
+//
+enum ParseSource { FROM_MEMORY, FROM_DISK, FROM_CHUNKS, FROM_PARSER };
+
+static ParsedFile &lookup_file(const std::string &path, const std::string &source,
+                               ParseSource &how)
+{
+  unsigned long key = ast_cache->key(source);
+  Symbol filename = stringtable.add_string((char *) path.c_str());
+  std::map<std::string, ParsedFile>::iterator it = parse_cache.find(path);
+  if (it != parse_cache.end() && it->second.key == key &&
+      (it->second.classes || !it->second.ok || join_chunks(it->second, filename))) {
+    how = FROM_MEMORY;
+    it->second.generation = generation;
+    return it->second;
+  }
+
+  ParsedFile &pf = parse_cache[path];
+  pf.generation = generation;
+  update_chunks(pf.chunks, pf.source, source);
+  pf.source = source;
+  pf.key = key;
+  pf.diagnostics.clear();
+  pf.ok = false;
+  pf.classes = NULL;
+  for (size_t k = 0; k < pf.chunks.size(); k++)
+    if (!pf.chunks[k].ast.empty()) {
+      how = FROM_CHUNKS;
+      return pf;
+    }
+
+  if (cache_megabytes > 0 && (pf.classes = ast_cache->lookup(key, filename))) {
+    how = FROM_DISK;
+    pf.ok = true;
+    if (!split_classes(pf, 0, pf.chunks.size(), pf.classes))
+      forget_chunks(pf);
+    return pf;
+  }
+  how = FROM_PARSER;
+  return pf;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Parallel front end
+//
+//  The files that have to be parsed are parsed by up to -j workers at
+//  once.  A worker is a child of the server: it runs the lexer and
+//  parser on one file, reads their AST into its own copy of the
+//  string tables and AST pool, and writes the classes back in the
+//  parse cache's binary form (AstWriter), which spells out every
+//  symbol.  The server reads the results back in the order of the
+//  files on the command line, adding the symbols to its own tables.
+//
+//  A job can also parse a run of a file's chunks, written to a file of
+//  their own; their lines are then counted from the start of the run.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+struct FrontEndJob {
+  std::string path;         // what the lexer reads
+  std::string file;         // the file the classes belong to
+  ParsedFile *pf;
+  size_t first, last;       // the chunks parsed, or first == last
+  int line_offset;          // added to the lines the parser gives
+  FILE *errs;               // the lexer's and parser's diagnostics
+  FILE *result;             // the classes, as AstWriter wrote them
+  pid_t pid;
+  int status;
+};
+
+static void front_end_worker(FrontEndJob &job)
+{
+  FILE *ast = tmpfile();
+  if (ast == NULL || !run_front_end(job.path, ast, job.errs))
+    _exit(1);
+  rewind(ast);
+  ast_file = ast;
+  yyrestart(ast);
+  ast_yyparse();
+  std::string data;
+  AstWriter writer(data);
+  writer.classes(ast_root->get_classes());
+  bool ok = fwrite(data.data(), 1, data.size(), job.result) == data.size();
+  _exit(fflush(job.result) == 0 && ok ? 0 : 1);
+}
+
+static void start_job(FrontEndJob &job)
+{
+  job.errs = tmpfile();
+  job.result = tmpfile();
+  job.status = 1;
+  job.pid = job.errs && job.result && !job.path.empty() ? fork() : -1;
+  if (job.pid == 0)
+    front_end_worker(job);
+}
+
+static FrontEndJob file_job(const std::string &path, ParsedFile *pf)
+{
+  FrontEndJob job;
+  job.path = job.file = path;
+  job.pf = pf;
+  job.first = job.last = 0;
+  job.line_offset = 0;
+  return job;
+}
+
+// A job for chunks [first, last) of pf, or a job with an empty path if
+// they cannot be written out.
+static FrontEndJob chunk_job(const std::string &file, ParsedFile *pf,
+                             size_t first, size_t last)
+{
+  FrontEndJob job = file_job("", pf);
+  job.file = file;
+  job.first = first;
+  job.last = last;
+  job.line_offset = pf->chunks[first].line - 1;
+
+  char path[] = "/tmp/semant-server-chunk-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return job;
+  size_t start = pf->chunks[first].start;
+  size_t end = pf->chunks[last - 1].start + pf->chunks[last - 1].len;
+  if (write_all(fd, pf->source.data() + start, end - start))
+    job.path = path;
+  else
+    unlink(path);
+  close(fd);
+  return job;
+}
+
+static void finish_job(FrontEndJob &job)
+{
+  ParsedFile &pf = *job.pf;
+  bool ok = job.pid > 0 && WIFEXITED(job.status) && WEXITSTATUS(job.status) == 0;
+  Classes classes = NULL;
+  if (ok) {
+    std::string data = read_file(job.result);
+    Symbol filename = stringtable.add_string((char *) job.file.c_str());
+    AstReader reader(data.data(), data.size(), filename, job.line_offset);
+    classes = reader.classes();
+  }
+
+  if (job.first < job.last) {
+    // A run of chunks; if it fails the caller parses the whole file,
+    // for the diagnostics.
+    if (!job.path.empty())
+      unlink(job.path.c_str());
+    if (classes == NULL || !split_classes(pf, job.first, job.last, classes))
+      pf.ok = false;
+  } else {
+    pf.ok = classes != NULL;
+    pf.classes = classes;
+    if (job.errs)
+      pf.diagnostics = read_file(job.errs);
+    if (pf.ok && cache_megabytes > 0)
+      ast_cache->store(pf.key, pf.classes);
+    if (pf.ok && !split_classes(pf, 0, pf.chunks.size(), pf.classes))
+      forget_chunks(pf);
+    if (job.pid <= 0 || !WIFEXITED(job.status))
+      pf.key = 0;           // the worker failed; parse it again next time
+  }
+  if (job.errs)
+    fclose(job.errs);
+  if (job.result)
+    fclose(job.result);
+}
+
+static void run_jobs(std::vector<FrontEndJob> &jobs)
+{
+  size_t next = 0, running = 0;
+  std::map<pid_t, size_t> job_of;
+
+  while (next < jobs.size() || running > 0) {
+    while (next < jobs.size() && (long) running < max_jobs) {
+      start_job(jobs[next]);
+      if (jobs[next].pid > 0) {
+        job_of[jobs[next].pid] = next;
+        running++;
+      }
+      next++;
+    }
+    if (running == 0)
+      continue;
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0)
+      break;
+    std::map<pid_t, size_t>::iterator it = job_of.find(pid);
+    if (it == job_of.end())
+      continue;
+    jobs[it->second].status = status;
+    running--;
+  }
+  for (size_t i = 0; i < jobs.size(); i++)
+    finish_job(jobs[i]);
+}
+
+//
+// Nodes are never freed one at a time, so every reparse, every chunk
+// read back and every program checked leaves its nodes in the AST
+// pool.  Once the pool holds more than -G megabytes above the basic
+// classes, it is reset to them before the next request, and the files
+// no request has asked for since the last reset are forgotten.  The
+// others keep their source and the binary ASTs of their chunks, from
+// which lookup_file() reads their classes back; one whose classes
+// could not be split into chunks is looked up in the parse cache or
+// parsed again.  Returns the number of files forgotten, or -1 if the
+// pool was not reset.
+//
+static long collect_asts()
+{
+  if (ast_pool_mark() - pool_mark <= pool_megabytes * 1048576)
+    return -1;
+  long forgotten = 0;
+  std::map<std::string, ParsedFile>::iterator it = parse_cache.begin();
+  while (it != parse_cache.end()) {
+    ParsedFile &pf = it->second;
+    if (pf.generation != generation) {
+      parse_cache.erase(it++);
+      forgotten++;
+      continue;
+    }
+    pf.classes = NULL;
+    for (size_t k = 0; k < pf.chunks.size(); k++)
+      pf.chunks[k].classes = NULL;
+    ++it;
+  }
+  ast_pool_reset(pool_mark);
+  generation++;
+  return forgotten;
+}
+
+//
+// Checks the program made of the classes of files and fills in the
+// reply.  Returns the exit status the client should give.
+//
+static int compile(const std::vector<std::string> &files,
+                   std::string &diagnostics, std::string &typed_ast)
+{
+  PhaseTimer timer("server.compile");
+  PhaseTimer pool_timer("server.pool");
+  size_t pool_bytes = ast_pool_mark() - pool_mark;
+  long forgotten = collect_asts();
+  pool_timer.count("pool_bytes", pool_bytes);
+  pool_timer.count("reset", forgotten >= 0);
+  pool_timer.count("files_forgotten", forgotten >= 0 ? forgotten : 0);
+  pool_timer.stop();
+  PhaseTimer front_end_timer("server.front_end");
+  long cached = 0, disk_hits = 0, parsed = 0;
+  long chunks_parsed = 0, chunks_reused = 0;
+  long evicted = ast_cache->evicted;
+  bool ok = true;
+  std::vector<ParsedFile *> parses(files.size(), (ParsedFile *) NULL);
+  std::vector<ParseSource> sources(files.size(), FROM_MEMORY);
+  std::vector<FrontEndJob> jobs;
+
+  for (size_t i = 0; i < files.size(); i++) {
+    std::string source;
+    if (!read_file(files[i], source))
+      continue;
+    ParseSource how;
+    ParsedFile *pf = parses[i] = &lookup_file(files[i], source, how);
+    sources[i] = how;
+    if (how == FROM_MEMORY)
+      cached++;
+    else if (how == FROM_DISK)
+      disk_hits++;
+    else if (how == FROM_PARSER) {
+      jobs.push_back(file_job(files[i], pf));
+      parsed++;
+    }
+    else {
+      // One job for each run of chunks that has no parse.
+      pf->ok = true;
+      for (size_t k = 0; k < pf->chunks.size(); ) {
+        if (!pf->chunks[k].ast.empty()) {
+          chunks_reused++;
+          k++;
+          continue;
+        }
+        size_t first = k;
+        while (k < pf->chunks.size() && pf->chunks[k].ast.empty())
+          k++;
+        jobs.push_back(chunk_job(files[i], pf, first, k));
+        chunks_parsed += k - first;
+      }
+    }
+  }
+  run_jobs(jobs);
+
+  // Files whose chunks did not all parse are parsed whole, so that
+  // their diagnostics are those of the whole file.
+  std::vector<FrontEndJob> retries;
+  for (size_t i = 0; i < files.size(); i++)
+    if (sources[i] == FROM_CHUNKS) {
+      Symbol filename = stringtable.add_string((char *) files[i].c_str());
+      if (!parses[i]->ok || !join_chunks(*parses[i], filename))
+        retries.push_back(file_job(files[i], parses[i]));
+    }
+  run_jobs(retries);
+  parsed += retries.size();
+  front_end_timer.stop();
+
+  Classes classes = nil_Classes();
+  for (size_t i = 0; i < files.size(); i++) {
+    if (parses[i] == NULL) {
+      diagnostics += "semant-server: cannot open " + files[i] + "\n";
+      ok = false;
+      continue;
+    }
+    diagnostics += parses[i]->diagnostics;
+    if (parses[i]->ok)
+      classes = append_Classes(classes, parses[i]->classes);
+    else
+      ok = false;
+  }
+
+  int errors = 0;
+  if (ok) {
+    // The parser gives the program the line of its first class.
+    node_lineno = classes->len() ? classes->nth(classes->first())->get_line_number() : 1;
+    Program program = ::program(classes);
+    std::ostringstream errs;
+    errors = program->check(errs);
+    diagnostics += errs.str();
+    if (errors)
+      diagnostics += "Compilation halted due to static semantic errors.\n";
+    else {
+      std::ostringstream out;
+      program->dump_with_types(out, 0);
+      typed_ast = out.str();
+    }
+    delete program->get_classtable();
+  }
+
+  timer.count("files", files.size());
+  timer.count("parsed", parsed);
+  timer.count("cached", cached);
+  timer.count("disk_hits", disk_hits);
+  timer.count("evicted", ast_cache->evicted - evicted);
+  timer.count("chunks_parsed", chunks_parsed);
+  timer.count("chunks_reused", chunks_reused);
+  timer.count("semant_errors", errors);
+  timer.stop();
+  return ok && !errors ? 0 : 1;
+}
+
+// Handles one connection; returns false when the server should stop.
+static bool serve_request(int conn)
+{
+  std::istringstream in(read_all(conn));
+  std::string command, line;
+  std::vector<std::string> files;
+  std::getline(in, command);
+  while (std::getline(in, line))
+    if (!line.empty())
+      files.push_back(line);
+
+  if (command == "shutdown") {
+    write_all(conn, "status 0\ndiagnostics 0\nast 0\n");
+    return false;
+  }
+
+  std::string diagnostics, typed_ast;
+  int status;
+  if (command == "compile")
+    status = compile(files, diagnostics, typed_ast);
+  else {
+    diagnostics = "semant-server: unknown command " + command + "\n";
+    status = 1;
+  }
+
+  std::ostringstream reply;
+  reply << "status " << status << "\n"
+        << "diagnostics " << diagnostics.size() << "\n" << diagnostics
+        << "ast " << typed_ast.size() << "\n" << typed_ast;
+  write_all(conn, reply.str());
+  return true;
+}
+
+static int serve(const std::string &socket_path)
+{
+  sockaddr_un addr;
+  if (!socket_address(socket_path, addr))
+    return 1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path.c_str());
+  if (fd < 0 || bind(fd, (sockaddr *) &addr, sizeof(addr)) < 0 ||
+      listen(fd, 16) < 0) {
+    perror("semant-server");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  unsigned long version = file_hash(lexer_path, 0);
+  version = file_hash(parser_path, version);
+  ast_cache = new AstCache(cache_dir, (long) (cache_megabytes * 1048576), version);
+
+  // The basic classes are built by the first check and kept; checking
+  // an empty program builds them below the mark the pool is reset to.
+  Program empty = ::program(nil_Classes());
+  std::ostringstream ignored;
+  empty->check(ignored);
+  delete empty->get_classtable();
+  pool_mark = ast_pool_mark();
+
+  bool running = true;
+  while (running) {
+    int conn = accept(fd, NULL, NULL);
+    if (conn < 0)
+      continue;
+    running = serve_request(conn);
+    close(conn);
+  }
+  close(fd);
+  unlink(socket_path.c_str());
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  Client
+//
+//////////////////////////////////////////////////////////////////////////////
+
+// Reads "<name> <n>\n" and then n bytes from reply at pos.
+static bool reply_field(const std::string &reply, size_t &pos,
+                        const char *name, std::string &value)
+{
+  size_t eol = reply.find('\n', pos);
+  if (eol == std::string::npos)
+    return false;
+  std::string header = reply.substr(pos, eol - pos);
+  size_t len = strlen(name);
+  if (header.compare(0, len, name) != 0 || header.size() <= len)
+    return false;
+  size_t n = strtoul(header.c_str() + len + 1, NULL, 10);
+  pos = eol + 1;
+  if (strcmp(name, "status") == 0) {
+    value = header.substr(len + 1);
+    return true;
+  }
+  if (pos + n > reply.size())
+    return false;
+  value = reply.substr(pos, n);
+  pos += n;
+  return true;
+}
+
+static int request(const std::string &socket_path, const std::string &command,
+                   int nfiles, char **files)
+{
+  sockaddr_un addr;
+  if (!socket_address(socket_path, addr))
+    return 1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+    fprintf(stderr, "semant-server: no server on %s\n", socket_path.c_str());
+    return 1;
+  }
+
+  std::string req = command + "\n";
+  for (int i = 0; i < nfiles; i++) {
+    char path[PATH_MAX];
+    req += realpath(files[i], path) ? path : files[i];
+    req += "\n";
+  }
+  write_all(fd, req);
+  shutdown(fd, SHUT_WR);
+  std::string reply = read_all(fd);
+  close(fd);
+
+  size_t pos = 0;
+  std::string status, diagnostics, typed_ast;
+  if (!reply_field(reply, pos, "status", status) ||
+      !reply_field(reply, pos, "diagnostics", diagnostics) ||
+      !reply_field(reply, pos, "ast", typed_ast)) {
+    fprintf(stderr, "semant-server: malformed reply\n");
+    return 1;
+  }
+  fputs(diagnostics.c_str(), stderr);
+  fwrite(typed_ast.data(), 1, typed_ast.size(), stdout);
+  return atoi(status.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+  std::string socket_path = default_socket();
+  bool client = false, stop = false;
+  int c;
+
+  yy_flex_debug = 0;
+  max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+  while ((c = getopt(argc, argv, "cks:j:L:R:P:C:M:G:")) != -1) {
+    switch (c) {
+    case 'c': client = true; break;
+    case 'k': stop = true; break;
+    case 's': socket_path = optarg; break;
+    case 'L': lexer_path = optarg; break;
+    case 'R': parser_path = optarg; break;
+    case 'P': phase_stats_file = optarg; break;
+    case 'C': cache_dir = optarg; break;
+    case 'M': cache_megabytes = atof(optarg); break;
+    case 'G': pool_megabytes = atof(optarg); break;
+    case 'j': max_jobs = atol(optarg); break;
+    default:
+      fprintf(stderr, "usage: semant-server [-s socket] [-L lexer] [-R parser] [-P file]\n"
+                      "                     [-C dir] [-M megabytes] [-G megabytes] [-j jobs]\n"
+                      "       semant-server -c [-s socket] file.cl ...\n"
+                      "       semant-server -k [-s socket]\n");
+      exit(1);
+    }
+  }
+
+  if (max_jobs < 1)
+    max_jobs = 1;
+  if (stop)
+    return request(socket_path, "shutdown", 0, NULL);
+  if (client)
+    return request(socket_path, "compile", argc - optind, argv + optind);
+  return serve(socket_path);
+}
@@ -3,8 +3,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <set>
 #include "semant.h"
 #include "utilities.h"
+#include "trace.h"
+#include "hashcons.h"
 
 
 extern int semant_debug;
@@ -83,14 +86,53 @@ static void initialize_constants(void)
 
 
 
-ClassTable::ClassTable(Classes classes) : semant_errors(0) , error_stream(cerr) {
+static bool is_basic_class(Symbol name)
+{
+    return name == Object || name == IO || name == Int || name == Bool || name == Str;
+}
+
+ClassTable::ClassTable(Classes classes, ostream &errors) : semant_errors(0) , error_stream(errors) {
+
+    install_basic_classes();
+    for(int i = classes->first(); classes->more(i); i = classes->next(i))
+	install_class(classes->nth(i), false);
 
-    /* Fill this in */
+    if (!is_defined(Main))
+	semant_error() << "Class Main is not defined." << endl;
+}
+
+//
+// install_class records a class under its name.  Basic classes may
+// not be redefined, and no class may be defined twice; in both cases
+// the offending definition is dropped so later phases see only one.
+//
+void ClassTable::install_class(Class_ c, bool basic)
+{
+    Symbol name = c->get_name();
 
+    if (!basic && (is_basic_class(name) || name == SELF_TYPE)) {
+	semant_error(c) << "Redefinition of basic class " << name << "." << endl;
+	return;
+    }
+    if (class_map.find(name) != class_map.end()) {
+	semant_error(c) << "Class " << name << " was previously defined." << endl;
+	return;
+    }
+    class_map[name] = c;
+    class_list.push_back(c);
 }
 
 void ClassTable::install_basic_classes() {
 
+    // The basic classes are built once per process and shared by every
+    // ClassTable, so a long-running semant-server does not rebuild them.
+    static Class_ basic[5];
+    if (basic[0]) {
+	for (int i = 0; i < 5; i++)
+	    install_class(basic[i], true);
+	return;
+    }
+
     // The tree package uses these globals to annotate the classes built below.
    // curr_lineno  = 0;
     Symbol filename = stringtable.add_string("<basic class>");
@@ -188,6 +230,14 @@ void ClassTable::install_basic_classes() {
 						      Str, 
 						      no_expr()))),
 	       filename);
+
+    basic[0] = Object_class;
+    basic[1] = IO_class;
+    basic[2] = Int_class;
+    basic[3] = Bool_class;
+    basic[4] = Str_class;
+    for (int i = 0; i < 5; i++)
+	install_class(basic[i], true);
 }
 
 ////////////////////////////////////////////////////////////////////
@@ -224,6 +274,714 @@ ostream& ClassTable::semant_error()
 
 
 
+////////////////////////////////////////////////////////////////////
+//
+// Queries on the class table.  These assume check_inheritance has
+// succeeded, so every parent is defined and every class has a depth.
+//
+///////////////////////////////////////////////////////////////////
+
+bool ClassTable::is_defined(Symbol type)
+{
+    return class_map.find(type) != class_map.end();
+}
+
+Class_ ClassTable::lookup_class(Symbol type)
+{
+    std::map<Symbol, Class_>::iterator it = class_map.find(type);
+    return it == class_map.end() ? NULL : it->second;
+}
+
+Symbol ClassTable::parent_of(Symbol type)
+{
+    return class_map[type]->get_parent();
+}
+
+//
+// conforms implements T1 <= T2.  SELF_TYPE_C conforms to anything C
+// conforms to, but only SELF_TYPE conforms to SELF_TYPE.  Undefined
+// types have already been reported, so they conform silently.
+//
+bool ClassTable::conforms(Symbol child, Symbol parent, Symbol self_class)
+{
+    if (child == No_type)
+	return true;
+    if (parent == SELF_TYPE)
+	return child == SELF_TYPE;
+    if (child == SELF_TYPE)
+	child = self_class;
+    if (!is_defined(child) || !is_defined(parent))
+	return true;
+
+    for (int d = depth_map[child] - depth_map[parent]; d > 0; d--)
+	child = parent_of(child);
+    return child == parent;
+}
+
+//
+// lub finds the least upper bound by bringing the deeper class up to
+// the depth of the other and then walking both chains in step.
+//
+Symbol ClassTable::lub(Symbol t1, Symbol t2, Symbol self_class)
+{
+    if (t1 == No_type)
+	return t2;
+    if (t2 == No_type)
+	return t1;
+    if (t1 == SELF_TYPE && t2 == SELF_TYPE)
+	return SELF_TYPE;
+    if (t1 == SELF_TYPE)
+	t1 = self_class;
+    if (t2 == SELF_TYPE)
+	t2 = self_class;
+    if (!is_defined(t1) || !is_defined(t2))
+	return Object;
+
+    int d1 = depth_map[t1], d2 = depth_map[t2];
+    for (; d1 > d2; d1--)
+	t1 = parent_of(t1);
+    for (; d2 > d1; d2--)
+	t2 = parent_of(t2);
+    while (t1 != t2) {
+	t1 = parent_of(t1);
+	t2 = parent_of(t2);
+    }
+    return t1;
+}
+
+method_class *ClassTable::lookup_method(Symbol type, Symbol name)
+{
+    for (; is_defined(type); type = parent_of(type)) {
+	MethodTable &mt = methods[type];
+	MethodTable::iterator it = mt.find(name);
+	if (it != mt.end())
+	    return it->second;
+    }
+    return NULL;
+}
+
+attr_class *ClassTable::lookup_attr(Symbol type, Symbol name)
+{
+    for (; is_defined(type); type = parent_of(type)) {
+	AttrTable &at = attrs[type];
+	AttrTable::iterator it = at.find(name);
+	if (it != at.end())
+	    return it->second;
+    }
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////
+//
+// Inheritance graph
+//
+// check_inheritance verifies that every parent is defined and may be
+// inherited from, and that the graph is a tree rooted at Object.  It
+// also records the depth of each class, which conforms and lub use to
+// avoid searching the chain.
+//
+///////////////////////////////////////////////////////////////////
+
+void ClassTable::check_inheritance()
+{
+    for (size_t i = 0; i < class_list.size(); i++) {
+	Class_ c = class_list[i];
+	Symbol parent = c->get_parent();
+
+	if (c->get_name() == Object)
+	    continue;
+	if (parent == Int || parent == Bool || parent == Str || parent == SELF_TYPE)
+	    semant_error(c) << "Class " << c->get_name() << " cannot inherit class "
+			    << parent << "." << endl;
+	else if (!is_defined(parent))
+	    semant_error(c) << "Class " << c->get_name()
+			    << " inherits from an undefined class " << parent << "." << endl;
+    }
+    if (errors())
+	return;
+
+    //
+    // Walk up from each class until we reach a class whose status is
+    // known.  Everything on the path then gets that class's status;
+    // reaching a class already on the path means the path is a cycle.
+    // Each class is walked over once, so this is linear overall.
+    //
+    enum { UNSEEN, ON_PATH, ACYCLIC, CYCLIC };
+    std::map<Symbol, int> state;
+    state[Object] = ACYCLIC;
+    depth_map[Object] = 0;
+
+    for (size_t i = 0; i < class_list.size(); i++) {
+	std::vector<Symbol> path;
+	Symbol x = class_list[i]->get_name();
+
+	while (state[x] == UNSEEN) {
+	    state[x] = ON_PATH;
+	    path.push_back(x);
+	    x = parent_of(x);
+	}
+
+	bool cyclic = state[x] != ACYCLIC;
+	int depth = cyclic ? 0 : depth_map[x];
+	for (int j = (int) path.size() - 1; j >= 0; j--) {
+	    state[path[j]] = cyclic ? CYCLIC : ACYCLIC;
+	    depth_map[path[j]] = ++depth;
+	}
+    }
+
+    for (size_t i = 0; i < class_list.size(); i++) {
+	Class_ c = class_list[i];
+	if (state[c->get_name()] == CYCLIC)
+	    semant_error(c) << "Class " << c->get_name() << ", or an ancestor of "
+			    << c->get_name() << ", is involved in an inheritance cycle."
+			    << endl;
+    }
+}
+
+////////////////////////////////////////////////////////////////////
+//
+// Method and attribute signatures
+//
+// collect_features builds the table of features each class defines
+// itself, then checks each class against its ancestors: a redefined
+// method must keep its signature, and attributes cannot be redefined.
+//
+///////////////////////////////////////////////////////////////////
+
+void ClassTable::collect_class_features(Class_ c)
+{
+    MethodTable &mt = methods[c->get_name()];
+    AttrTable &at = attrs[c->get_name()];
+    Features features = c->get_features();
+
+    for (int i = features->first(); features->more(i); i = features->next(i)) {
+	Feature f = features->nth(i);
+	Symbol name = f->get_name();
+
+	if (f->is_method()) {
+	    if (mt.find(name) != mt.end())
+		semant_error(c->get_filename(), f) << "Method " << name
+						   << " is multiply defined." << endl;
+	    else
+		mt[name] = (method_class *) f;
+	} else {
+	    if (name == self)
+		semant_error(c->get_filename(), f)
+		    << "'self' cannot be the name of an attribute." << endl;
+	    else if (at.find(name) != at.end())
+		semant_error(c->get_filename(), f) << "Attribute " << name
+						   << " is multiply defined in class." << endl;
+	    else
+		at[name] = (attr_class *) f;
+	}
+    }
+}
+
+void ClassTable::collect_features()
+{
+    for (size_t i = 0; i < class_list.size(); i++)
+	collect_class_features(class_list[i]);
+
+    for (size_t i = 0; i < class_list.size(); i++) {
+	Class_ c = class_list[i];
+	Symbol parent = c->get_parent();
+
+	MethodTable &mt = methods[c->get_name()];
+	for (MethodTable::iterator it = mt.begin(); it != mt.end(); ++it) {
+	    method_class *m = it->second;
+	    method_class *orig = lookup_method(parent, m->get_name());
+	    if (orig == NULL)
+		continue;
+
+	    Formals formals = m->get_formals();
+	    Formals orig_formals = orig->get_formals();
+	    if (m->get_return_type() != orig->get_return_type()) {
+		semant_error(c->get_filename(), m)
+		    << "In redefined method " << m->get_name() << ", return type "
+		    << m->get_return_type() << " is different from original return type "
+		    << orig->get_return_type() << "." << endl;
+	    } else if (formals->len() != orig_formals->len()) {
+		semant_error(c->get_filename(), m)
+		    << "Incompatible number of formal parameters in redefined method "
+		    << m->get_name() << "." << endl;
+	    } else {
+		for (int j = formals->first(); formals->more(j); j = formals->next(j)) {
+		    Symbol t = formals->nth(j)->get_type_decl();
+		    Symbol orig_t = orig_formals->nth(j)->get_type_decl();
+		    if (t != orig_t) {
+			semant_error(c->get_filename(), m)
+			    << "In redefined method " << m->get_name() << ", parameter type "
+			    << t << " is different from original type " << orig_t << endl;
+			break;
+		    }
+		}
+	    }
+	}
+
+	AttrTable &at = attrs[c->get_name()];
+	for (AttrTable::iterator it = at.begin(); it != at.end(); ++it)
+	    if (lookup_attr(parent, it->first) != NULL)
+		semant_error(c->get_filename(), it->second)
+		    << "Attribute " << it->first
+		    << " is an attribute of an inherited class." << endl;
+    }
+
+    if (!is_defined(Main))
+	return;
+    method_class *main = lookup_method(Main, main_meth);
+    if (main == NULL)
+	semant_error(lookup_class(Main)) << "No 'main' method in class Main." << endl;
+    else if (main->get_formals()->len() != 0)
+	semant_error(lookup_class(Main))
+	    << "'main' method in class Main should have no arguments." << endl;
+}
+
+////////////////////////////////////////////////////////////////////
+//
+// Type checking
+//
+// check_types checks every feature of every user-defined class in an
+// environment holding self and all attributes visible in the class.
+// Each Expression's check_node method implements its typing rule,
+// records the type in the node and returns it.  After an error the
+// checker carries on with type Object so that one mistake is reported
+// once.  Expressions are checked through Expression_class::check, which
+// reuses the type of a node shared by hash-consing once the node has
+// been checked without errors.
+//
+///////////////////////////////////////////////////////////////////
+
+void ClassTable::check_types()
+{
+    for (size_t i = 0; i < class_list.size(); i++) {
+	Class_ c = class_list[i];
+	if (is_basic_class(c->get_name()))
+	    continue;
+
+	TRACE_SCOPE("semant", c->get_name());
+	TypeEnv env(this, c);
+	env.objects.enterscope();
+	env.objects.addid(self, SELF_TYPE);
+
+	// Ancestors' attributes first, so that the order of the
+	// scope matches the layout of the object.
+	std::vector<Symbol> chain;
+	for (Symbol t = c->get_name(); is_defined(t); t = parent_of(t))
+	    chain.push_back(t);
+	for (int j = (int) chain.size() - 1; j >= 0; j--) {
+	    AttrTable &at = attrs[chain[j]];
+	    for (AttrTable::iterator it = at.begin(); it != at.end(); ++it)
+		env.objects.addid(it->first, it->second->get_type_decl());
+	}
+
+	Features features = c->get_features();
+	for (int j = features->first(); features->more(j); j = features->next(j))
+	    features->nth(j)->check(env);
+	env.objects.exitscope();
+    }
+}
+
+Symbol Expression_class::check(TypeEnv &env)
+{
+    if (hc_flags & HC_TYPED)
+	return type;
+
+    int errors = env.classtable->errors();
+    Symbol t = check_node(env);
+    if ((hc_flags & HC_SHARED) && env.classtable->errors() == errors)
+	hc_flags |= HC_TYPED;
+    return t;
+}
+
+void attr_class::check(TypeEnv &env)
+{
+    ClassTableP ct = env.classtable;
+
+    if (type_decl != SELF_TYPE && !ct->is_defined(type_decl))
+	env.semant_error(this) << "Class " << type_decl << " of attribute " << name
+			       << " is undefined." << endl;
+
+    Symbol init_type = init->check(env);
+    if (!ct->conforms(init_type, type_decl, env.class_name()))
+	env.semant_error(this) << "Inferred type " << init_type
+			       << " of initialization of attribute " << name
+			       << " does not conform to declared type " << type_decl
+			       << "." << endl;
+}
+
+void method_class::check(TypeEnv &env)
+{
+    TRACE_SCOPE("typecheck", env.class_name(), name);
+    ClassTableP ct = env.classtable;
+
+    env.objects.enterscope();
+    for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+	Formal f = formals->nth(i);
+	Symbol fname = f->get_name();
+	Symbol ftype = f->get_type_decl();
+
+	if (fname == self) {
+	    env.semant_error(f) << "'self' cannot be the name of a formal parameter."
+				<< endl;
+	    continue;
+	}
+	if (env.objects.probe(fname) != NULL) {
+	    env.semant_error(f) << "Formal parameter " << fname
+				<< " is multiply defined." << endl;
+	    continue;
+	}
+	if (ftype == SELF_TYPE) {
+	    env.semant_error(f) << "Formal parameter " << fname
+				<< " cannot have type SELF_TYPE." << endl;
+	    ftype = Object;
+	} else if (!ct->is_defined(ftype)) {
+	    env.semant_error(f) << "Class " << ftype << " of formal parameter " << fname
+				<< " is undefined." << endl;
+	    ftype = Object;
+	}
+	env.objects.addid(fname, ftype);
+    }
+
+    Symbol body_type = expr->check(env);
+    if (return_type != SELF_TYPE && !ct->is_defined(return_type))
+	env.semant_error(this) << "Undefined return type " << return_type
+			       << " in method " << name << "." << endl;
+    else if (!ct->conforms(body_type, return_type, env.class_name()))
+	env.semant_error(this) << "Inferred return type " << body_type << " of method "
+			       << name << " does not conform to declared return type "
+			       << return_type << "." << endl;
+    env.objects.exitscope();
+}
+
+Symbol assign_class::check_node(TypeEnv &env)
+{
+    type = expr->check(env);
+
+    if (name == self) {
+	env.semant_error(this) << "Cannot assign to 'self'." << endl;
+	return type;
+    }
+    Symbol decl = env.objects.lookup(name);
+    if (decl == NULL)
+	env.semant_error(this) << "Assignment to undeclared variable " << name
+			       << "." << endl;
+    else if (!env.classtable->conforms(type, decl, env.class_name()))
+	env.semant_error(this) << "Type " << type
+			       << " of assigned expression does not conform to declared type "
+			       << decl << " of identifier " << name << "." << endl;
+    return type;
+}
+
+//
+// check_call checks the actuals of a dispatch against the formals of
+// the method found for it, and returns the type of the call:
+// a method returning SELF_TYPE returns the type of its receiver.
+//
+static void check_actuals(TypeEnv &env, Expressions actual,
+			  std::vector<Symbol> &actual_types)
+{
+    for (int i = actual->first(); actual->more(i); i = actual->next(i))
+	actual_types.push_back(actual->nth(i)->check(env));
+}
+
+static Symbol check_call(TypeEnv &env, tree_node *site, Symbol name,
+			 method_class *m, Symbol receiver, Expressions actual)
+{
+    std::vector<Symbol> actual_types;
+    check_actuals(env, actual, actual_types);
+
+    if (m == NULL) {
+	env.semant_error(site) << "Dispatch to undefined method " << name << "." << endl;
+	return Object;
+    }
+
+    Formals formals = m->get_formals();
+    if (formals->len() != (int) actual_types.size()) {
+	env.semant_error(site) << "Method " << name
+			       << " called with wrong number of arguments." << endl;
+    } else {
+	for (int i = formals->first(); formals->more(i); i = formals->next(i)) {
+	    Formal f = formals->nth(i);
+	    if (!env.classtable->conforms(actual_types[i], f->get_type_decl(),
+					  env.class_name()))
+		env.semant_error(site) << "In call of method " << name << ", type "
+				       << actual_types[i] << " of parameter "
+				       << f->get_name() << " does not conform to declared type "
+				       << f->get_type_decl() << "." << endl;
+	}
+    }
+
+    Symbol ret = m->get_return_type();
+    return ret == SELF_TYPE ? receiver : ret;
+}
+
+Symbol static_dispatch_class::check_node(TypeEnv &env)
+{
+    ClassTableP ct = env.classtable;
+    Symbol receiver = expr->check(env);
+    std::vector<Symbol> actual_types;
+
+    if (type_name == SELF_TYPE) {
+	env.semant_error(this) << "Static dispatch to SELF_TYPE." << endl;
+	check_actuals(env, actual, actual_types);
+	return type = Object;
+    }
+    if (!ct->is_defined(type_name)) {
+	env.semant_error(this) << "Static dispatch to undefined class " << type_name
+			       << "." << endl;
+	check_actuals(env, actual, actual_types);
+	return type = Object;
+    }
+    if (!ct->conforms(receiver, type_name, env.class_name()))
+	env.semant_error(this) << "Expression type " << receiver
+			       << " does not conform to declared static dispatch type "
+			       << type_name << "." << endl;
+
+    type = check_call(env, this, name, ct->lookup_method(type_name, name),
+		      receiver, actual);
+    return type;
+}
+
+Symbol dispatch_class::check_node(TypeEnv &env)
+{
+    Symbol receiver = expr->check(env);
+    Symbol lookup_type = receiver == SELF_TYPE ? env.class_name() : receiver;
+
+    type = check_call(env, this, name,
+		      env.classtable->lookup_method(lookup_type, name),
+		      receiver, actual);
+    return type;
+}
+
+Symbol cond_class::check_node(TypeEnv &env)
+{
+    if (pred->check(env) != Bool)
+	env.semant_error(this) << "Predicate of 'if' does not have type Bool." << endl;
+    Symbol then_type = then_exp->check(env);
+    Symbol else_type = else_exp->check(env);
+    type = env.classtable->lub(then_type, else_type, env.class_name());
+    return type;
+}
+
+Symbol loop_class::check_node(TypeEnv &env)
+{
+    if (pred->check(env) != Bool)
+	env.semant_error(this) << "Loop condition does not have type Bool." << endl;
+    body->check(env);
+    return type = Object;
+}
+
+Symbol typcase_class::check_node(TypeEnv &env)
+{
+    std::set<Symbol> seen;
+    Symbol result = No_type;
+
+    expr->check(env);
+    for (int i = cases->first(); cases->more(i); i = cases->next(i)) {
+	Case c = cases->nth(i);
+	if (seen.find(c->get_type_decl()) != seen.end())
+	    env.semant_error(c) << "Duplicate branch " << c->get_type_decl()
+				<< " in case statement." << endl;
+	seen.insert(c->get_type_decl());
+	result = env.classtable->lub(result, c->check(env), env.class_name());
+    }
+    return type = result;
+}
+
+Symbol branch_class::check(TypeEnv &env)
+{
+    Symbol decl = type_decl;
+
+    if (type_decl == SELF_TYPE) {
+	env.semant_error(this) << "Identifier " << name
+			       << " declared with type SELF_TYPE in case branch." << endl;
+	decl = Object;
+    } else if (!env.classtable->is_defined(type_decl)) {
+	env.semant_error(this) << "Class " << type_decl
+			       << " of case branch is undefined." << endl;
+	decl = Object;
+    }
+
+    env.objects.enterscope();
+    if (name == self)
+	env.semant_error(this) << "'self' bound in 'case'." << endl;
+    else
+	env.objects.addid(name, decl);
+    Symbol result = expr->check(env);
+    env.objects.exitscope();
+    return result;
+}
+
+Symbol block_class::check_node(TypeEnv &env)
+{
+    for (int i = body->first(); body->more(i); i = body->next(i))
+	type = body->nth(i)->check(env);
+    return type;
+}
+
+Symbol let_class::check_node(TypeEnv &env)
+{
+    ClassTableP ct = env.classtable;
+    Symbol decl = type_decl;
+
+    if (type_decl != SELF_TYPE && !ct->is_defined(type_decl)) {
+	env.semant_error(this) << "Class " << type_decl << " of let-bound identifier "
+			       << identifier << " is undefined." << endl;
+	decl = Object;
+    }
+
+    Symbol init_type = init->check(env);
+    if (!ct->conforms(init_type, decl, env.class_name()))
+	env.semant_error(this) << "Inferred type " << init_type
+			       << " of initialization of " << identifier
+			       << " does not conform to identifier's declared type "
+			       << decl << "." << endl;
+
+    env.objects.enterscope();
+    if (identifier == self)
+	env.semant_error(this) << "'self' cannot be bound in a 'let' expression."
+			       << endl;
+    else
+	env.objects.addid(identifier, decl);
+    type = body->check(env);
+    env.objects.exitscope();
+    return type;
+}
+
+//
+// The arithmetic operators all take two Ints and return an Int.
+//
+static Symbol check_arith(TypeEnv &env, tree_node *t, Expression e1, Expression e2,
+			  char *op)
+{
+    Symbol t1 = e1->check(env);
+    Symbol t2 = e2->check(env);
+    if (t1 != Int || t2 != Int)
+	env.semant_error(t) << "non-Int arguments: " << t1 << " " << op << " " << t2
+			    << endl;
+    return Int;
+}
+
+Symbol plus_class::check_node(TypeEnv &env)
+{
+    return type = check_arith(env, this, e1, e2, "+");
+}
+
+Symbol sub_class::check_node(TypeEnv &env)
+{
+    return type = check_arith(env, this, e1, e2, "-");
+}
+
+Symbol mul_class::check_node(TypeEnv &env)
+{
+    return type = check_arith(env, this, e1, e2, "*");
+}
+
+Symbol divide_class::check_node(TypeEnv &env)
+{
+    return type = check_arith(env, this, e1, e2, "/");
+}
+
+Symbol neg_class::check_node(TypeEnv &env)
+{
+    Symbol t = e1->check(env);
+    if (t != Int)
+	env.semant_error(this) << "Argument of '~' has type " << t
+			       << " instead of Int." << endl;
+    return type = Int;
+}
+
+Symbol lt_class::check_node(TypeEnv &env)
+{
+    check_arith(env, this, e1, e2, "<");
+    return type = Bool;
+}
+
+Symbol leq_class::check_node(TypeEnv &env)
+{
+    check_arith(env, this, e1, e2, "<=");
+    return type = Bool;
+}
+
+Symbol eq_class::check_node(TypeEnv &env)
+{
+    Symbol t1 = e1->check(env);
+    Symbol t2 = e2->check(env);
+    bool basic1 = t1 == Int || t1 == Str || t1 == Bool;
+    bool basic2 = t2 == Int || t2 == Str || t2 == Bool;
+    if ((basic1 || basic2) && t1 != t2)
+	env.semant_error(this) << "Illegal comparison with a basic type." << endl;
+    return type = Bool;
+}
+
+Symbol comp_class::check_node(TypeEnv &env)
+{
+    Symbol t = e1->check(env);
+    if (t != Bool)
+	env.semant_error(this) << "Argument of 'not' has type " << t
+			       << " instead of Bool." << endl;
+    return type = Bool;
+}
+
+Symbol int_const_class::check_node(TypeEnv &env)
+{
+    return type = Int;
+}
+
+Symbol bool_const_class::check_node(TypeEnv &env)
+{
+    return type = Bool;
+}
+
+Symbol string_const_class::check_node(TypeEnv &env)
+{
+    return type = Str;
+}
+
+Symbol new__class::check_node(TypeEnv &env)
+{
+    if (type_name != SELF_TYPE && !env.classtable->is_defined(type_name)) {
+	env.semant_error(this) << "'new' used with undefined class " << type_name
+			       << "." << endl;
+	return type = Object;
+    }
+    return type = type_name;
+}
+
+Symbol isvoid_class::check_node(TypeEnv &env)
+{
+    e1->check(env);
+    return type = Bool;
+}
+
+Symbol no_expr_class::check_node(TypeEnv &env)
+{
+    return type = No_type;
+}
+
+Symbol object_class::check_node(TypeEnv &env)
+{
+    if (name == self)
+	return type = SELF_TYPE;
+
+    Symbol decl = env.objects.lookup(name);
+    if (decl == NULL) {
+	env.semant_error(this) << "Undeclared identifier " << name << "." << endl;
+	return type = Object;
+    }
+    return type = decl;
+}
+
+const char *semant_phase_names[NUM_SEMANT_PHASES] = {
+    "semant.class_table",
+    "semant.inheritance",
+    "semant.signatures",
+    "semant.typing"
+};
+
+PhaseStat semant_phase_stats[NUM_SEMANT_PHASES];
+
+
 /*   This is the entry point to the semantic checker.
 
      Your checker should do the following two things:
@@ -236,20 +994,47 @@ ostream& ClassTable::semant_error()
      You are free to first do 1), make sure you catch all semantic
      errors. Part 2) can be done in a second stage, when you want
      to build mycoolc.
+
+     Errors in the class hierarchy stop the checker before signatures
+     are collected, since the later phases rely on a well-formed
+     inheritance tree.
  */
 void program_class::semant()
+{
+    if (check(cerr)) {
+	cerr << "Compilation halted due to static semantic errors." << endl;
+	exit(1);
+    }
+}
+
+/*   check runs the phases of semant(), writing the errors to errors
+     instead of cerr, and returns the number of errors instead of
+     exiting.  semant-server uses it to check many programs in one
+     process.
+ */
+int program_class::check(ostream &errors)
 {
     initialize_constants();
 
     /* ClassTable constructor may do some semantic analysis */
-    ClassTable *classtable = new ClassTable(classes);
+    PhaseTimer class_table_timer(semant_phase_names[PHASE_CLASS_TABLE]);
+    delete classtable;          // from an earlier check of this program
+    classtable = new ClassTable(classes, errors);
+    semant_phase_stats[PHASE_CLASS_TABLE] = class_table_timer.stop();
 
-    /* some semantic analysis code may go here */
+    PhaseTimer inheritance_timer(semant_phase_names[PHASE_INHERITANCE]);
+    classtable->check_inheritance();
+    semant_phase_stats[PHASE_INHERITANCE] = inheritance_timer.stop();
 
-    if (classtable->errors()) {
-	cerr << "Compilation halted due to static semantic errors." << endl;
-	exit(1);
-    }
-}
+    if (!classtable->errors()) {
+	PhaseTimer signatures_timer(semant_phase_names[PHASE_SIGNATURES]);
+	classtable->collect_features();
+	semant_phase_stats[PHASE_SIGNATURES] = signatures_timer.stop();
 
+	PhaseTimer typing_timer(semant_phase_names[PHASE_TYPING]);
+	classtable->check_types();
+	semant_phase_stats[PHASE_TYPING] = typing_timer.stop();
+    }
 
+    return classtable->errors();
+}
@@ -2,11 +2,14 @@
 #define SEMANT_H_
 
 #include <assert.h>
-#include <iostream>  
+#include <iostream>
+#include <map>
+#include <vector>
 #include "cool-tree.h"
 #include "stringtab.h"
 #include "symtab.h"
 #include "list.h"
+#include "phase-stats.h"
 
 #define TRUE 1
 #define FALSE 0
@@ -14,6 +17,20 @@
 class ClassTable;
 typedef ClassTable *ClassTableP;
 
+// The phases of semantic analysis, in the order program_class::semant()
+// runs them.  Each phase is timed so that semant-bench can report
+// where the time goes as the input grows.
+enum SemantPhase {
+  PHASE_CLASS_TABLE,      // install basic and user classes
+  PHASE_INHERITANCE,      // undefined parents, illegal parents, cycles
+  PHASE_SIGNATURES,       // method and attribute tables, overriding
+  PHASE_TYPING,           // type checking of every expression
+  NUM_SEMANT_PHASES
+};
+
+extern const char *semant_phase_names[NUM_SEMANT_PHASES];
+extern PhaseStat semant_phase_stats[NUM_SEMANT_PHASES];
+
 // This is a structure that may be used to contain the semantic
 // information such as the inheritance graph.  You may use it or not as
 // you like: it is only here to provide a container for the supplied
@@ -21,18 +38,57 @@ typedef ClassTable *ClassTableP;
 
 class ClassTable {
 private:
+  typedef std::map<Symbol, method_class *> MethodTable;
+  typedef std::map<Symbol, attr_class *> AttrTable;
+
   int semant_errors;
   void install_basic_classes();
+  void install_class(Class_ c, bool basic);
+  void collect_class_features(Class_ c);
   ostream& error_stream;
 
+  std::vector<Class_> class_list;          // all classes, basic ones first
+  std::map<Symbol, Class_> class_map;      // class name -> class node
+  std::map<Symbol, int> depth_map;         // distance from Object
+  std::map<Symbol, MethodTable> methods;   // methods defined in each class
+  std::map<Symbol, AttrTable> attrs;       // attributes defined in each class
+
 public:
-  ClassTable(Classes);
+  ClassTable(Classes, ostream &errors = cerr);
+  void check_inheritance();
+  void collect_features();
+  void check_types();
+
   int errors() { return semant_errors; }
+  int class_count() { return class_list.size(); }
+  Class_ class_at(int i) { return class_list[i]; }
   ostream& semant_error();
   ostream& semant_error(Class_ c);
   ostream& semant_error(Symbol filename, tree_node *t);
+
+  bool is_defined(Symbol type);
+  Class_ lookup_class(Symbol type);
+  Symbol parent_of(Symbol type);
+  bool conforms(Symbol child, Symbol parent, Symbol self_class);
+  Symbol lub(Symbol t1, Symbol t2, Symbol self_class);
+  method_class *lookup_method(Symbol type, Symbol name);
+  attr_class *lookup_attr(Symbol type, Symbol name);
 };
 
+// The environment an expression is checked in: the object
+// environment O, the method environment M (the class table) and the
+// current class C of the Cool type rules.
+class TypeEnv {
+public:
+  SymbolTable<Symbol, Entry> objects;
+  ClassTableP classtable;
+  Class_ curr_class;
+
+  TypeEnv(ClassTableP ct, Class_ c) : classtable(ct), curr_class(c) { }
+  Symbol class_name() { return curr_class->get_name(); }
+  ostream& semant_error(tree_node *t)
+    { return classtable->semant_error(curr_class->get_filename(), t); }
+};
 
 #endif
 
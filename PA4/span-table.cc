@@ -0,0 +1,73 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+//  span-table.cc
+//
+//  Implements the span table (see span-table.h).  The side file is read
+//  whole when it is opened.  A node and the chain of nodes built just
+//  above it often have the same span, so a span equal to the last one
+//  in the table reuses it, as in the parser.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "span-table.h"
+
+#define MAX_SPANS ((1 << SPAN_REF_BITS) - 1)
+
+SpanRef node_span = NO_SPAN;
+
+static std::vector<Span> spans;  // spans[ref - 1]
+static std::vector<Span> unread; // the side file, while it is open
+static size_t next_unread;
+static bool reading;
+static bool too_few;             // some node found the file used up
+
+SpanRef node_span_ref()
+{
+  if (!reading)
+    return node_span;
+  if (next_unread == unread.size()) {
+    too_few = true;
+    return NO_SPAN;
+  }
+  Span s = unread[next_unread++];
+  if (spans.empty() || spans.back().first_line != s.first_line ||
+      spans.back().last_line != s.last_line) {
+    if (spans.size() == MAX_SPANS)
+      return NO_SPAN;
+    spans.push_back(s);
+  }
+  return spans.size();
+}
+
+Span span_lines(SpanRef ref)
+{
+  Span none = { 0, 0 };
+  return ref == NO_SPAN ? none : spans[ref - 1];
+}
+
+void span_read_open(char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  Span s;
+  while (fscanf(f, "%d %d", &s.first_line, &s.last_line) == 2)
+    unread.push_back(s);
+  fclose(f);
+  next_unread = 0;
+  reading = true;
+}
+
+void span_read_close()
+{
+  if (too_few || next_unread != unread.size())
+    fprintf(stderr, "warning: the spans do not match the AST\n");
+  unread.clear();
+  next_unread = 0;
+  reading = too_few = false;
+}
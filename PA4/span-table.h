@@ -0,0 +1,39 @@
+#ifndef SPAN_TABLE_H_
+#define SPAN_TABLE_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  span-table.h
+//
+//  Source spans of AST nodes, as read back from the side file the
+//  parser writes with -X (see PA3/span-table.h).  The file has one
+//  line "first last" per node, in the order the AST reader builds the
+//  nodes, so while it is open each new phylum node takes the next
+//  span.  Other nodes take node_span, which the optimizer sets to the
+//  span of the node it replaces, as it sets node_lineno; it is NO_SPAN
+//  for the basic classes and for nodes read from the binary AST cache.
+//
+//  A node keeps a SpanRef into one table of spans.  The Expression
+//  phylum packs it into 24 bits beside hc_flags and the others into
+//  the padding after line_number, so no node is bigger for it.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+struct Span {
+  int first_line, last_line;
+};
+
+typedef unsigned SpanRef;
+
+#define SPAN_REF_BITS 24
+#define NO_SPAN 0               // no side file, or the table filled up
+
+extern SpanRef node_span;       // the span of nodes not read with a span
+
+SpanRef node_span_ref();        // the span of the node built next
+Span span_lines(SpanRef ref);   // 0, 0 for NO_SPAN
+
+void span_read_open(char *path); // -X: give the nodes built next spans
+void span_read_close();          // warns if the AST did not use them all
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+//////////////////////////////////////////////////////////////////////////////
+//
+//  trace.h
+//
+//  Scoped trace events in Chrome trace format.  TRACE_SCOPE records
+//  the start of a scope and, when the scope ends, appends one complete
+//  event with nanosecond timestamps to a buffer owned by the current
+//  thread.  The buffers are written out at exit to the file named by
+//  -E (see handle_flags.cc), which can be loaded in chrome://tracing
+//  or Perfetto.
+//
+//  Each program in the csh pipeline appends its events to the same
+//  file, so remove the file before a run.  Timestamps come from the
+//  system-wide monotonic clock, so the phases line up across processes.
+//
+//  Without -E a scope costs one test of trace_file.  Without -DTRACE
+//  TRACE_SCOPE expands to nothing.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "stringtab.h"
+
+extern char *trace_file;          // set by -E; NULL when disabled
+
+class TraceScope {
+private:
+  const char *cat;
+  const char *name;
+  Symbol scope_sym;
+  Symbol name_sym;
+  long long start_ns;
+
+public:
+  TraceScope(const char *c, const char *n)
+    : cat(c), name(n), scope_sym(NULL), name_sym(NULL)
+    { start_ns = trace_file ? now() : 0; }
+  TraceScope(const char *c, Symbol n)
+    : cat(c), name(NULL), scope_sym(NULL), name_sym(n)
+    { start_ns = trace_file ? now() : 0; }
+  TraceScope(const char *c, Symbol scope, Symbol n)
+    : cat(c), name(NULL), scope_sym(scope), name_sym(n)
+    { start_ns = trace_file ? now() : 0; }
+  ~TraceScope()
+    { if (start_ns) record(); }
+
+  static long long now();
+  void record();
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+
+#ifdef TRACE
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(__VA_ARGS__)
+#else
+#define TRACE_SCOPE(...)
+#endif
+
+#endif
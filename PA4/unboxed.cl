@@ -0,0 +1,48 @@
+(*
+ *  Values whose static type -O narrows to Int or Bool inside a node of
+ *  a wider type.  Run with make interp-test; every line must print the
+ *  same with and without -O and -H.
+ *)
+
+class Main inherits IO {
+  a : Int;
+
+  -- A block whose last expression is a folded conditional.
+  block : Object <- { a; if true then 5 else "s" fi; };
+
+  -- A let whose body is one.
+  let_body : Object <- let x : Int <- 1 in if true then x + 4 else "s" fi;
+
+  flag : Object <- { a; if false then "s" else true fi; };
+
+  five : Object <- 5;
+
+  -- Under -H both 5s are one node, which must keep its type Int.
+  shared : Object <- if true then 5 else "s" fi;  six : Int <- if true then 5 else 6 fi + 1;
+
+  -- Inlined into a dispatch of type Object, with and without formals.
+  int_as_object() : Object { 5 };
+  succ_as_object(x : Int) : Object { x + 1 };
+
+  main() : Object {{
+    out_string(block.type_name()).out_string("\n");
+    out_string(let_body.type_name()).out_string("\n");
+    out_string(flag.type_name()).out_string("\n");
+    case let_body of i : Int => out_int(i).out_string("\n"); esac;
+    out_string(int_as_object().type_name()).out_string(" ");
+    out_string(succ_as_object(5).type_name()).out_string("\n");
+    if int_as_object() = five
+    then out_string("equal\n") else out_string("not equal\n") fi;
+    out_string(shared.type_name()).out_string(" ").out_int(six).out_string("\n");
+
+    -- = with an Int on one side and an Object on the other.
+    if (if true then 5 else new Object fi) = five
+    then out_string("equal\n") else out_string("not equal\n") fi;
+    if five = (if true then 5 else new Object fi)
+    then out_string("equal\n") else out_string("not equal\n") fi;
+    if (if true then 6 else new Object fi) = five
+    then out_string("equal\n") else out_string("not equal\n") fi;
+    if (if true then true else new Object fi) = flag
+    then out_string("equal\n") else out_string("not equal\n") fi;
+  }};
+};